@@ -0,0 +1,690 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include <unordered_map>
+
+#include "Clock.h"
+
+// Structured binary log. A call records the address of its format string, a timestamp and the raw arguments into a
+// lock-free byte ring of the calling thread, and a background thread writes them to disk. Formatting happens offline in
+// BinaryLogReader (see tools/BinaryLogDecoder.cpp), so a call costs a few copies instead of a printf.
+// Format strings must be string literals, they identify the call site and are read long after the call.
+//
+// File layout, little endian:
+//   Header   "PBTBLOG\0", u32 version, u32 reserved, u64 steady clock ns at open, u64 system clock ns at open.
+//   Chunks   u8 type, varint payload size, payload.
+//     format   varint id, NUL terminated format string.
+//     thread   varint thread id, NUL terminated name.
+//     data     varint thread id, records of: varint format id, varint ns since the previous record of the thread,
+//              varint argument bytes, arguments each as a u8 ArgType and its raw value. Strings are a varint length
+//              and the bytes.
+namespace BinaryLogFormat {
+    constexpr char      Magic[8]{ 'P', 'B', 'T', 'B', 'L', 'O', 'G', '\0' };
+    constexpr uint32_t  Version{ 1 };
+
+    enum class ChunkType : uint8_t {
+        format = 1,
+        thread,
+        data,
+    };
+
+    enum class ArgType : uint8_t {
+        i32 = 1,
+        u32,
+        i64,
+        u64,
+        f64,
+        str,
+        ptr,
+    };
+
+    inline void PutVarint(std::vector<uint8_t>& out, uint64_t v)
+    {
+        while (v >= 0x80) {
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+
+    inline void PutVarint(uint8_t*& p, uint64_t v)
+    {
+        while (v >= 0x80) {
+            *p++ = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = (uint8_t)v;
+    }
+
+    // Returns false at the end of the data or on a malformed value.
+    inline bool GetVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v)
+    {
+        v = 0;
+        for (uint32_t shift = 0; p < end && shift < 64; shift += 7) {
+            const uint8_t b{ *p++ };
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+class BinaryLog final
+{
+public:
+    static constexpr size_t RingCapacity{ 1 << 16 };        // Bytes per thread.
+    static constexpr size_t MaxRecordSize{ 1024 };          // Longer strings are truncated.
+    static constexpr size_t MaxStringLength{ 256 };
+
+private:
+    using ArgType = BinaryLogFormat::ArgType;
+
+    // Single producer, the owning thread, and single consumer, the writer thread.
+    class ThreadRing final {
+    public:
+        alignas(64) std::atomic<uint64_t>   writePos{};
+        alignas(64) std::atomic<uint64_t>   readPos{};
+        std::unique_ptr<uint8_t[]>          buf{ std::make_unique<uint8_t[]>(RingCapacity) };
+        uint32_t        tid{};
+        uint64_t        lastNs{};               // Writer.
+        std::string     name;                   // Under threadMtx.
+        bool            nameWritten{ true };
+
+        bool Write(const uint8_t* data, size_t n)
+        {
+            const uint64_t w{ writePos.load(std::memory_order_relaxed) };
+            if (RingCapacity - (w - readPos.load(std::memory_order_acquire)) < n)
+                return false;
+            const size_t offset{ (size_t)(w % RingCapacity) };
+            const size_t first{ std::min(n, RingCapacity - offset) };
+            memcpy(buf.get() + offset, data, first);
+            memcpy(buf.get(), data + first, n - first);
+            writePos.store(w + n, std::memory_order_release);
+            return true;
+        }
+
+        void Read(std::vector<uint8_t>& out)
+        {
+            const uint64_t r{ readPos.load(std::memory_order_relaxed) };
+            const uint64_t w{ writePos.load(std::memory_order_acquire) };
+            out.resize((size_t)(w - r));
+            const size_t offset{ (size_t)(r % RingCapacity) };
+            const size_t first{ std::min(out.size(), RingCapacity - offset) };
+            memcpy(out.data(), buf.get() + offset, first);
+            memcpy(out.data() + first, buf.get(), out.size() - first);
+            readPos.store(w, std::memory_order_release);
+        }
+    };
+
+    // Record header in the rings, before the format gets an id.
+    class RingRecordHeader final {
+    public:
+        const char* format;
+        uint64_t    ns;
+        uint16_t    argBytes;
+    };
+
+    const uint32_t      instanceId{ NextInstanceId() };
+    std::mutex          threadMtx;
+    std::vector<std::unique_ptr<ThreadRing>>    threads;
+
+    FILE*               fp{};
+    std::thread         writer;
+    std::atomic<bool>   exitReq{ false };
+    std::atomic<bool>   opened{ false };
+    std::atomic<uint64_t>   dropped{};
+    uint64_t            epochNs{};
+    std::unordered_map<const char*, uint32_t>   formatIds;
+    std::vector<uint8_t>    scratch;
+    std::vector<uint8_t>    chunk;
+    std::vector<uint8_t>    payload;
+
+    static uint32_t NextInstanceId()
+    {
+        static std::atomic<uint32_t> next{ 1 };
+        return next.fetch_add(1);
+    }
+
+    ThreadRing& CurrentThread()
+    {
+        class Cache final {
+        public:
+            uint32_t    instanceId{};
+            ThreadRing* ring{};
+        };
+        thread_local Cache cache;
+        if (cache.instanceId != instanceId) {
+            std::scoped_lock<std::mutex> l{ threadMtx };
+            threads.push_back(std::make_unique<ThreadRing>());
+            threads.back()->tid = (uint32_t)threads.size();
+            cache = { instanceId, threads.back().get() };
+        }
+        return *cache.ring;
+    }
+
+    template <typename T>
+    static void PutRaw(uint8_t*& p, ArgType type, const T& v)
+    {
+        *p++ = (uint8_t)type;
+        memcpy(p, &v, sizeof(v));
+        p += sizeof(v);
+    }
+
+    // Returns false when the argument doesn't fit, the remaining ones are left out.
+    template <typename T>
+    static bool PutArg(uint8_t*& p, const uint8_t* end, T v)
+    {
+        using U = std::decay_t<T>;
+        if ((size_t)(end - p) < 1 + sizeof(uint64_t))
+            return false;
+        if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+            const char* s{ v != nullptr ? v : "(null)" };
+            const size_t len{ std::min({ strlen(s), MaxStringLength, (size_t)(end - p) - 3 }) };
+            *p++ = (uint8_t)ArgType::str;
+            BinaryLogFormat::PutVarint(p, len);
+            memcpy(p, s, len);
+            p += len;
+        }
+        else if constexpr (std::is_same_v<U, const wchar_t*> || std::is_same_v<U, wchar_t*>) {
+            static_assert(!std::is_same_v<U, U>, "Wide strings are not supported, log them through a narrow conversion.");
+        }
+        else if constexpr (std::is_pointer_v<U>) {
+            PutRaw(p, ArgType::ptr, (uint64_t)(uintptr_t)v);
+        }
+        else if constexpr (std::is_floating_point_v<U>) {
+            PutRaw(p, ArgType::f64, (double)v);
+        }
+        else if constexpr (std::is_enum_v<U>) {
+            return PutArg(p, end, (std::underlying_type_t<U>)v);
+        }
+        else if constexpr (std::is_integral_v<U>) {
+            if constexpr (sizeof(U) > sizeof(uint32_t)) {
+                if constexpr (std::is_signed_v<U>)
+                    PutRaw(p, ArgType::i64, (int64_t)v);
+                else
+                    PutRaw(p, ArgType::u64, (uint64_t)v);
+            }
+            else {
+                // Promoted like a printf argument.
+                if constexpr (std::is_signed_v<U> || sizeof(U) < sizeof(uint32_t))
+                    PutRaw(p, ArgType::i32, (int32_t)v);
+                else
+                    PutRaw(p, ArgType::u32, (uint32_t)v);
+            }
+        }
+        else {
+            static_assert(std::is_integral_v<U>, "Unsupported log argument type.");
+        }
+        return true;
+    }
+
+    void PutChunk(BinaryLogFormat::ChunkType type, const std::vector<uint8_t>& data)
+    {
+        chunk.clear();
+        chunk.push_back((uint8_t)type);
+        BinaryLogFormat::PutVarint(chunk, data.size());
+        fwrite(chunk.data(), 1, chunk.size(), fp);
+        fwrite(data.data(), 1, data.size(), fp);
+    }
+
+    void PutString(std::vector<uint8_t>& out, const char* s)
+    {
+        out.insert(out.end(), s, s + strlen(s) + 1);
+    }
+
+    // Re-encodes the records of a thread with format ids and time deltas. Formats seen for the first time are
+    // written out before the data which refers to them.
+    void WriteRecords(ThreadRing& t)
+    {
+        payload.clear();
+        BinaryLogFormat::PutVarint(payload, t.tid);
+        t.lastNs = std::max(t.lastNs, epochNs);
+        for (size_t pos = 0; pos + sizeof(RingRecordHeader) <= scratch.size();) {
+            RingRecordHeader h;
+            memcpy(&h, scratch.data() + pos, sizeof(h));
+            pos += sizeof(h);
+
+            auto [itr, inserted] = formatIds.try_emplace(h.format, (uint32_t)formatIds.size());
+            if (inserted) {
+                std::vector<uint8_t> def;
+                BinaryLogFormat::PutVarint(def, itr->second);
+                PutString(def, h.format);
+                PutChunk(BinaryLogFormat::ChunkType::format, def);
+            }
+            BinaryLogFormat::PutVarint(payload, itr->second);
+            BinaryLogFormat::PutVarint(payload, h.ns >= t.lastNs ? h.ns - t.lastNs : 0);
+            BinaryLogFormat::PutVarint(payload, h.argBytes);
+            payload.insert(payload.end(), scratch.begin() + pos, scratch.begin() + pos + h.argBytes);
+            t.lastNs = std::max(t.lastNs, h.ns);
+            pos += h.argBytes;
+        }
+        PutChunk(BinaryLogFormat::ChunkType::data, payload);
+    }
+
+    // Returns the number of bytes taken from the rings.
+    size_t Drain()
+    {
+        std::vector<ThreadRing*> rings;
+        {
+            std::scoped_lock<std::mutex> l{ threadMtx };
+            for (auto& t : threads) {
+                if (!t->nameWritten) {
+                    payload.clear();
+                    BinaryLogFormat::PutVarint(payload, t->tid);
+                    PutString(payload, t->name.c_str());
+                    PutChunk(BinaryLogFormat::ChunkType::thread, payload);
+                    t->nameWritten = true;
+                }
+                rings.push_back(t.get());
+            }
+        }
+
+        size_t n{};
+        for (auto* t : rings) {
+            t->Read(scratch);
+            if (scratch.empty())
+                continue;
+            n += scratch.size();
+            WriteRecords(*t);
+        }
+        return n;
+    }
+
+public:
+    ~BinaryLog()
+    {
+        Close();
+    }
+
+    static uint64_t NowNs()
+    {
+        return Clock::Get().NowNs();
+    }
+
+    bool Open(const std::string& path)
+    {
+        if (opened.load())
+            return false;
+#ifdef _MSC_VER
+        if (fopen_s(&fp, path.c_str(), "wb") != 0)
+            fp = nullptr;
+#else
+        fp = fopen(path.c_str(), "wb");
+#endif
+        if (fp == nullptr)
+            return false;
+
+        epochNs = NowNs();
+        const uint64_t systemNs{ (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() };
+        const uint32_t header[2]{ BinaryLogFormat::Version, 0 };
+        fwrite(BinaryLogFormat::Magic, 1, sizeof(BinaryLogFormat::Magic), fp);
+        fwrite(header, 1, sizeof(header), fp);
+        fwrite(&epochNs, 1, sizeof(epochNs), fp);
+        fwrite(&systemNs, 1, sizeof(systemNs), fp);
+
+        formatIds.clear();
+        {
+            // Leftovers of a previous file and the names of the threads seen so far.
+            std::scoped_lock<std::mutex> l{ threadMtx };
+            for (auto& t : threads) {
+                t->readPos.store(t->writePos.load());
+                t->lastNs = epochNs;
+                t->nameWritten = t->name.empty();
+            }
+        }
+
+        exitReq.store(false);
+        writer = std::thread([this]() {
+            while (!exitReq.load()) {
+                if (Drain() == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            });
+        opened.store(true);
+        return true;
+    }
+
+    void Close()
+    {
+        if (!opened.exchange(false))
+            return;
+
+        exitReq.store(true);
+        writer.join();
+        Drain();
+        fclose(fp);
+        fp = nullptr;
+    }
+
+    bool IsOpen() const
+    {
+        return opened.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Dropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    void SetThreadName(const std::string& name)
+    {
+        ThreadRing& t{ CurrentThread() };
+        std::scoped_lock<std::mutex> l{ threadMtx };
+        t.name = name;
+        t.nameWritten = false;
+    }
+
+    // Any thread. Dropped when the ring of the thread is full.
+    template <typename... Args>
+    void Record(const char* format, Args... args)
+    {
+        if (!IsOpen())
+            return;
+
+        uint8_t rec[MaxRecordSize];
+        uint8_t* p{ rec + sizeof(RingRecordHeader) };
+        const uint8_t* end{ rec + MaxRecordSize };
+        bool fits{ true };
+        ((fits = fits && PutArg(p, end, args)), ...);
+        (void)fits;
+
+        const RingRecordHeader h{ format, NowNs(), (uint16_t)(p - rec - sizeof(RingRecordHeader)) };
+        memcpy(rec, &h, sizeof(h));
+        if (!CurrentThread().Write(rec, (size_t)(p - rec)))
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Decodes a binary log into text lines.
+class BinaryLogReader final
+{
+public:
+    class Line final {
+    public:
+        uint64_t    ns;                 // Since the log was opened.
+        uint32_t    tid;
+        std::string text;
+    };
+
+private:
+    using ArgType = BinaryLogFormat::ArgType;
+
+    class Arg final {
+    public:
+        ArgType     type{};
+        uint64_t    bits{};
+        std::string str;
+    };
+
+    std::vector<uint8_t>        data;
+    const uint8_t*              cur{};
+    uint64_t                    epochNs{};
+    uint64_t                    systemNs{};
+    std::vector<std::string>    formats;
+    std::vector<std::string>    threadNames;
+    std::vector<uint64_t>       threadLastNs;
+    std::vector<Line>           pending;
+    size_t                      pendingIdx{};
+    uint64_t                    malformed{};
+
+    static bool ReadArgs(const uint8_t* p, const uint8_t* end, std::vector<Arg>& args)
+    {
+        args.clear();
+        while (p < end) {
+            Arg a;
+            a.type = (ArgType)*p++;
+            size_t size{};
+            switch (a.type) {
+            case ArgType::i32:
+            case ArgType::u32:
+                size = 4;
+                break;
+            case ArgType::i64:
+            case ArgType::u64:
+            case ArgType::f64:
+            case ArgType::ptr:
+                size = 8;
+                break;
+            case ArgType::str: {
+                uint64_t len{};
+                if (!BinaryLogFormat::GetVarint(p, end, len) || len > (uint64_t)(end - p))
+                    return false;
+                a.str.assign((const char*)p, (size_t)len);
+                p += len;
+                break;
+            }
+            default:
+                return false;
+            }
+            if (size > (size_t)(end - p))
+                return false;
+            memcpy(&a.bits, p, size);
+            p += size;
+            args.push_back(std::move(a));
+        }
+        return true;
+    }
+
+    // printf conversion of a single argument, with the length modifier chosen by the recorded type.
+    static std::string FormatArg(std::string spec, char conv, const Arg& a)
+    {
+        std::array<char, 512> buf{};
+        auto is = [conv](const char* set) { return strchr(set, conv) != nullptr; };
+        switch (a.type) {
+        case ArgType::i32:
+        case ArgType::u32:
+        case ArgType::i64:
+        case ArgType::u64: {
+            const bool wide{ a.type == ArgType::i64 || a.type == ArgType::u64 };
+            const bool isSigned{ a.type == ArgType::i32 || a.type == ArgType::i64 };
+            const int64_t sv{ wide ? (int64_t)a.bits : (int64_t)(int32_t)(uint32_t)a.bits };
+            const uint64_t uv{ wide ? a.bits : (uint64_t)(uint32_t)a.bits };
+            if (is("c")) {
+                snprintf(buf.data(), buf.size(), (spec + "c").c_str(), (int)sv);
+            }
+            else if (is("eEfFgGaA")) {
+                snprintf(buf.data(), buf.size(), (spec + conv).c_str(), isSigned ? (double)sv : (double)uv);
+            }
+            else {
+                if (!is("diouxX"))
+                    conv = isSigned ? 'd' : 'u';
+                if (conv == 'd' || conv == 'i')
+                    snprintf(buf.data(), buf.size(), (spec + "ll" + conv).c_str(), (long long)sv);
+                else
+                    snprintf(buf.data(), buf.size(), (spec + "ll" + conv).c_str(), (unsigned long long)uv);
+            }
+            break;
+        }
+        case ArgType::f64: {
+            double d;
+            memcpy(&d, &a.bits, sizeof(d));
+            snprintf(buf.data(), buf.size(), (spec + (is("eEfFgGaA") ? conv : 'f')).c_str(), d);
+            break;
+        }
+        case ArgType::str:
+            snprintf(buf.data(), buf.size(), (spec + "s").c_str(), a.str.c_str());
+            break;
+        case ArgType::ptr:
+            snprintf(buf.data(), buf.size(), "0x%016llx", (unsigned long long)a.bits);
+            break;
+        }
+        return buf.data();
+    }
+
+    static std::string Format(const std::string& format, const std::vector<Arg>& args)
+    {
+        std::string out;
+        size_t argIdx{};
+        for (size_t i = 0; i < format.size(); ++i) {
+            if (format[i] != '%') {
+                out += format[i];
+                continue;
+            }
+            if (i + 1 < format.size() && format[i + 1] == '%') {
+                out += '%';
+                ++i;
+                continue;
+            }
+            // %[flags][width][.precision][length]conversion, the length is replaced.
+            size_t j{ i + 1 };
+            std::string spec{ "%" };
+            while (j < format.size() && strchr("-+ #0123456789.*", format[j]) != nullptr)
+                spec += format[j++];
+            while (j < format.size() && strchr("hljztLIw", format[j]) != nullptr)
+                ++j;
+            if (j >= format.size())
+                break;
+            const char conv{ format[j] };
+            // '*' takes its width or precision from an argument.
+            for (size_t s; (s = spec.find('*')) != std::string::npos;) {
+                const std::string v{ argIdx < args.size() ? std::to_string((int32_t)args[argIdx++].bits) : "0" };
+                spec.replace(s, 1, v);
+            }
+            if (argIdx < args.size())
+                out += FormatArg(spec, conv, args[argIdx++]);
+            else
+                out += format.substr(i, j - i + 1);
+            i = j;
+        }
+        return out;
+    }
+
+    bool ReadChunk()
+    {
+        const uint8_t* end{ data.data() + data.size() };
+        if (cur >= end)
+            return false;
+        const auto type{ (BinaryLogFormat::ChunkType)*cur++ };
+        uint64_t size{};
+        if (!BinaryLogFormat::GetVarint(cur, end, size) || size > (uint64_t)(end - cur)) {
+            ++malformed;
+            cur = end;
+            return false;
+        }
+        const uint8_t* p{ cur };
+        const uint8_t* chunkEnd{ cur + size };
+        cur = chunkEnd;
+
+        uint64_t id{};
+        if (!BinaryLogFormat::GetVarint(p, chunkEnd, id) || id > 0xffffff) {
+            ++malformed;
+            return true;
+        }
+        switch (type) {
+        case BinaryLogFormat::ChunkType::format:
+        case BinaryLogFormat::ChunkType::thread: {
+            auto& list{ type == BinaryLogFormat::ChunkType::format ? formats : threadNames };
+            if (list.size() <= id)
+                list.resize((size_t)id + 1);
+            list[(size_t)id].assign((const char*)p, strnlen((const char*)p, (size_t)(chunkEnd - p)));
+            break;
+        }
+        case BinaryLogFormat::ChunkType::data: {
+            if (threadLastNs.size() <= id)
+                threadLastNs.resize((size_t)id + 1, epochNs);
+            uint64_t& lastNs{ threadLastNs[(size_t)id] };
+            std::vector<Arg> args;
+            while (p < chunkEnd) {
+                uint64_t fmt{}, deltaNs{}, argBytes{};
+                if (!BinaryLogFormat::GetVarint(p, chunkEnd, fmt) || !BinaryLogFormat::GetVarint(p, chunkEnd, deltaNs) ||
+                    !BinaryLogFormat::GetVarint(p, chunkEnd, argBytes) || argBytes > (uint64_t)(chunkEnd - p)) {
+                    ++malformed;
+                    break;
+                }
+                lastNs += deltaNs;
+                Line l{ lastNs - epochNs, (uint32_t)id, {} };
+                if (fmt < formats.size() && ReadArgs(p, p + argBytes, args))
+                    l.text = Format(formats[(size_t)fmt], args);
+                else
+                    ++malformed;
+                pending.push_back(std::move(l));
+                p += argBytes;
+            }
+            break;
+        }
+        default:
+            ++malformed;
+            break;
+        }
+        return true;
+    }
+
+public:
+    bool Open(const std::string& path)
+    {
+        FILE* f{};
+#ifdef _MSC_VER
+        if (fopen_s(&f, path.c_str(), "rb") != 0)
+            f = nullptr;
+#else
+        f = fopen(path.c_str(), "rb");
+#endif
+        if (f == nullptr)
+            return false;
+        data.clear();
+        std::array<uint8_t, 1 << 16> buf;
+        for (size_t n; (n = fread(buf.data(), 1, buf.size(), f)) > 0;)
+            data.insert(data.end(), buf.begin(), buf.begin() + n);
+        fclose(f);
+
+        constexpr size_t headerSize{ sizeof(BinaryLogFormat::Magic) + sizeof(uint32_t) * 2 + sizeof(uint64_t) * 2 };
+        if (data.size() < headerSize || memcmp(data.data(), BinaryLogFormat::Magic, sizeof(BinaryLogFormat::Magic)) != 0)
+            return false;
+        uint32_t version{};
+        memcpy(&version, data.data() + 8, sizeof(version));
+        if (version != BinaryLogFormat::Version)
+            return false;
+        memcpy(&epochNs, data.data() + 16, sizeof(epochNs));
+        memcpy(&systemNs, data.data() + 24, sizeof(systemNs));
+        cur = data.data() + headerSize;
+        formats.clear();
+        threadNames.clear();
+        threadLastNs.clear();
+        pending.clear();
+        pendingIdx = 0;
+        malformed = 0;
+        return true;
+    }
+
+    // Lines in file order, which is time order per thread.
+    bool Next(Line& line)
+    {
+        while (pendingIdx >= pending.size()) {
+            pending.clear();
+            pendingIdx = 0;
+            if (!ReadChunk())
+                return false;
+        }
+        line = std::move(pending[pendingIdx++]);
+        return true;
+    }
+
+    std::string ThreadName(uint32_t tid) const
+    {
+        return tid < threadNames.size() && !threadNames[tid].empty() ? threadNames[tid] : "Thread " + std::to_string(tid);
+    }
+
+    // System clock at open, ns since the Unix epoch.
+    uint64_t SystemNs() const
+    {
+        return systemNs;
+    }
+
+    uint64_t Malformed() const
+    {
+        return malformed;
+    }
+};
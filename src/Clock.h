@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <semaphore>
+#include <thread>
+
+// Source of the time which everything timestamps and waits with, in nanoseconds. The process runs on the clock
+// installed with ScopedClock, the steady clock by default, so that the simulation can run the same code on virtual
+// time.
+class Clock
+{
+    friend class ScopedClock;
+    static inline std::atomic<Clock*>   current{};
+
+public:
+    static constexpr uint64_t NoDeadline{ UINT64_MAX };
+
+    virtual ~Clock() = default;
+
+    virtual uint64_t NowNs() = 0;
+    virtual void SleepUntilNs(uint64_t t) = 0;
+    // cv.wait_until on this clock, may wake up spuriously.
+    virtual std::cv_status WaitUntilNs(std::condition_variable& cv, std::unique_lock<std::mutex>& l, uint64_t deadlineNs) = 0;
+    virtual bool TryAcquireUntilNs(std::binary_semaphore& s, uint64_t deadlineNs) = 0;
+
+    // The clock of the process.
+    static Clock& Get();
+
+    void SleepForNs(uint64_t ns)
+    {
+        SleepUntilNs(NowNs() + ns);
+    }
+
+    // Returns pred(), false when the deadline passed first.
+    template <typename Pred>
+    bool WaitUntilNs(std::condition_variable& cv, std::unique_lock<std::mutex>& l, uint64_t deadlineNs, Pred pred)
+    {
+        while (!pred()) {
+            if (WaitUntilNs(cv, l, deadlineNs) == std::cv_status::timeout)
+                return pred();
+        }
+        return true;
+    }
+
+    template <typename Pred>
+    bool WaitForNs(std::condition_variable& cv, std::unique_lock<std::mutex>& l, uint64_t timeoutNs, Pred pred)
+    {
+        return WaitUntilNs(cv, l, NowNs() + timeoutNs, pred);
+    }
+
+    bool TryAcquireForNs(std::binary_semaphore& s, uint64_t timeoutNs)
+    {
+        return TryAcquireUntilNs(s, NowNs() + timeoutNs);
+    }
+};
+
+// The steady clock. Its nanoseconds count from the epoch of std::chrono::steady_clock.
+class RealClock final : public Clock
+{
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    static TimePoint ToTimePoint(uint64_t ns)
+    {
+        return TimePoint(std::chrono::duration_cast<TimePoint::duration>(std::chrono::nanoseconds((int64_t)ns)));
+    }
+
+    static bool Unbounded(uint64_t ns)
+    {
+        return ns > (uint64_t)INT64_MAX;
+    }
+
+public:
+    using Clock::WaitUntilNs;
+
+    static RealClock& Instance()
+    {
+        static RealClock clock;
+        return clock;
+    }
+
+    virtual uint64_t NowNs() override
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    virtual void SleepUntilNs(uint64_t t) override
+    {
+        std::this_thread::sleep_until(ToTimePoint(t));
+    }
+
+    virtual std::cv_status WaitUntilNs(std::condition_variable& cv, std::unique_lock<std::mutex>& l, uint64_t deadlineNs) override
+    {
+        if (Unbounded(deadlineNs)) {
+            cv.wait(l);
+            return std::cv_status::no_timeout;
+        }
+        return cv.wait_until(l, ToTimePoint(deadlineNs));
+    }
+
+    virtual bool TryAcquireUntilNs(std::binary_semaphore& s, uint64_t deadlineNs) override
+    {
+        if (Unbounded(deadlineNs)) {
+            s.acquire();
+            return true;
+        }
+        return s.try_acquire_until(ToTimePoint(deadlineNs));
+    }
+};
+
+// Deterministic clock of the simulation. Time stands still until the clock is advanced or a thread blocks on it: a
+// sleep jumps to its end, and a timed wait which nothing ends within idleWait of real time jumps to its deadline. So
+// hours of refreshes, timeouts and watchdogs run in seconds, and the waits only end early for the threads which
+// really are working.
+class VirtualClock final : public Clock
+{
+    std::atomic<uint64_t>       nowNs;
+    std::chrono::microseconds   idleWait;
+
+public:
+    explicit VirtualClock(uint64_t startNs = 0, std::chrono::microseconds inIdleWait = std::chrono::milliseconds(1))
+        : nowNs(startNs), idleWait(inIdleWait)
+    {
+    }
+
+    using Clock::WaitUntilNs;
+
+    // Never goes backwards.
+    void AdvanceTo(uint64_t t)
+    {
+        uint64_t now{ nowNs.load(std::memory_order_relaxed) };
+        while (now < t && !nowNs.compare_exchange_weak(now, t, std::memory_order_relaxed))
+            ;
+    }
+
+    void Advance(uint64_t ns)
+    {
+        nowNs.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    virtual uint64_t NowNs() override
+    {
+        return nowNs.load(std::memory_order_relaxed);
+    }
+
+    virtual void SleepUntilNs(uint64_t t) override
+    {
+        AdvanceTo(t);
+    }
+
+    virtual std::cv_status WaitUntilNs(std::condition_variable& cv, std::unique_lock<std::mutex>& l, uint64_t deadlineNs) override
+    {
+        if (NowNs() >= deadlineNs)
+            return std::cv_status::timeout;
+        if (cv.wait_for(l, idleWait) == std::cv_status::no_timeout || deadlineNs == NoDeadline)
+            return std::cv_status::no_timeout;
+        AdvanceTo(deadlineNs);
+        return std::cv_status::timeout;
+    }
+
+    virtual bool TryAcquireUntilNs(std::binary_semaphore& s, uint64_t deadlineNs) override
+    {
+        for (;;) {
+            if (NowNs() >= deadlineNs)
+                return s.try_acquire();
+            if (s.try_acquire_for(idleWait))
+                return true;
+            if (deadlineNs != NoDeadline)
+                AdvanceTo(deadlineNs);
+        }
+    }
+};
+
+inline Clock& Clock::Get()
+{
+    Clock* c{ current.load(std::memory_order_acquire) };
+    return c != nullptr ? *c : RealClock::Instance();
+}
+
+// Makes a clock the clock of the process for the lifetime of the object. Before the threads which use it start.
+class ScopedClock final
+{
+    Clock*  prev;
+
+public:
+    explicit ScopedClock(Clock& clock)
+        : prev(Clock::current.exchange(&clock))
+    {
+    }
+
+    ScopedClock(const ScopedClock&) = delete;
+    ScopedClock& operator=(const ScopedClock&) = delete;
+
+    ~ScopedClock()
+    {
+        Clock::current.store(prev);
+    }
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+#include "Clock.h"
+
+// Wake-up sources of a window loop.
+enum WakeupEvent : uint32_t
+{
+    wakeupNone = 0,
+    wakeupMessage = 1 << 0,
+    wakeupPresentFinished = 1 << 1,
+    wakeupDeadline = 1 << 2,
+};
+
+// Blocks a window loop on the union of its wake-up sources, so that it wakes up once per event instead of polling.
+// The Win32 implementation in PresentBarrierTest.cpp also wakes up on window messages.
+class EventWaiter
+{
+public:
+    static constexpr uint64_t NoDeadline{ Clock::NoDeadline };
+
+    virtual ~EventWaiter() = default;
+
+    // Can be called from any thread.
+    virtual void Notify(uint32_t events) = 0;
+
+    // Returns and clears the pending events. Returns wakeupDeadline when the deadline passes with nothing pending.
+    // The deadline is in nanoseconds of Clock::Get().
+    virtual uint32_t WaitUntil(uint64_t deadlineNs) = 0;
+};
+
+// Portable implementation on a condition variable.
+class PortableEventWaiter final : public EventWaiter
+{
+    std::mutex              mtx;
+    std::condition_variable cv;
+    uint32_t                pending{};
+
+public:
+    virtual void Notify(uint32_t events) override
+    {
+        {
+            std::scoped_lock<std::mutex> l{ mtx };
+            pending |= events;
+        }
+        cv.notify_one();
+    }
+
+    virtual uint32_t WaitUntil(uint64_t deadlineNs) override
+    {
+        std::unique_lock<std::mutex> l{ mtx };
+        if (deadlineNs == NoDeadline) {
+            cv.wait(l, [this] { return pending != 0; });
+        }
+        else if (!Clock::Get().WaitUntilNs(cv, l, deadlineNs, [this] { return pending != 0; })) {
+            return wakeupDeadline;
+        }
+
+        uint32_t events{ pending };
+        pending = 0;
+        return events;
+    }
+};
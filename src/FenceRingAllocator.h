@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <tuple>
+
+// Suballocates a linear range, such as a persistently mapped upload heap, as a ring. The allocations made since the
+// last Submit are tagged with the fence value the GPU signals after consuming them, and their space comes back once
+// Reclaim sees that value completed. Allocate never waits. When it fails, the owner either waits for
+// OldestPendingFence() and reclaims, or replaces the range with a larger one if nothing is pending.
+class FenceRingAllocator final
+{
+public:
+    static constexpr uint64_t InvalidOffset{ UINT64_MAX };
+
+private:
+    uint64_t    capacity{};
+    uint64_t    tail{};         // Next free byte.
+    uint64_t    used{};         // Live bytes, including the padding and the skipped end of the range on wrap around.
+    uint64_t    openBytes{};    // Allocated since the last Submit.
+    std::deque<std::tuple<uint64_t, uint64_t>>  submissions;    // fence value, bytes
+
+public:
+    explicit FenceRingAllocator(uint64_t inCapacity = 0)
+    {
+        Reset(inCapacity);
+    }
+
+    // Forgets every allocation.
+    void Reset(uint64_t inCapacity)
+    {
+        capacity = inCapacity;
+        tail = 0;
+        used = 0;
+        openBytes = 0;
+        submissions.clear();
+    }
+
+    // Returns the offset, or InvalidOffset when the ring can't hold the allocation until the GPU frees some space.
+    // alignment must be a power of two, and the start of the range is assumed to be aligned to it.
+    uint64_t Allocate(uint64_t size, uint64_t alignment = 1)
+    {
+        if (size == 0 || size > capacity || alignment == 0 || (alignment & (alignment - 1)) != 0)
+            return InvalidOffset;
+
+        uint64_t offset{ (tail + alignment - 1) & ~(alignment - 1) };
+        uint64_t padding{ offset - tail };
+        if (offset + size > capacity) {
+            // Skip the end of the range and start over.
+            padding = capacity - tail;
+            offset = 0;
+        }
+        if (padding + size > capacity - used)
+            return InvalidOffset;
+
+        used += padding + size;
+        openBytes += padding + size;
+        tail = offset + size == capacity ? 0 : offset + size;
+        return offset;
+    }
+
+    // The allocations since the previous Submit are in use until the fence reaches fenceValue.
+    void Submit(uint64_t fenceValue)
+    {
+        if (openBytes == 0)
+            return;
+        if (!submissions.empty() && std::get<0>(submissions.back()) >= fenceValue)
+            std::get<1>(submissions.back()) += openBytes;
+        else
+            submissions.push_back({ fenceValue, openBytes });
+        openBytes = 0;
+    }
+
+    // Frees the submissions the GPU is done with.
+    void Reclaim(uint64_t completedFenceValue)
+    {
+        while (!submissions.empty() && std::get<0>(submissions.front()) <= completedFenceValue) {
+            used -= std::get<1>(submissions.front());
+            submissions.pop_front();
+        }
+        if (used == 0)
+            tail = 0;
+    }
+
+    // 0 when nothing is waiting for the GPU.
+    uint64_t OldestPendingFence() const
+    {
+        return submissions.empty() ? 0 : std::get<0>(submissions.front());
+    }
+
+    uint64_t Capacity() const
+    {
+        return capacity;
+    }
+
+    uint64_t Used() const
+    {
+        return used;
+    }
+
+    uint64_t OpenBytes() const
+    {
+        return openBytes;
+    }
+
+    size_t NumPendingSubmissions() const
+    {
+        return submissions.size();
+    }
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <chrono>
+
+#include "PresentBackend.h"
+#include "FramePipeline.h"
+#include "FrameStartScheduler.h"
+#include "VblankEstimator.h"
+#include "TraceExporter.h"
+
+// How the present thread paces itself before recording a frame.
+enum class FramePacingMode : uint32_t
+{
+    fence,              // Wait for the GPU to release the back buffer to record. Excess frames block in Present.
+    latencyWaitable,    // Wait on the frame latency waitable of the swap chain first, so the frame is recorded as late as possible.
+};
+
+// Fence bookkeeping and back buffer pacing shared by the D3D12 path and the simulation.
+class FrameSync final
+{
+    using Status = PresentBackend::Status;
+
+    uint64_t    lastSignaledValue{};
+
+public:
+    uint64_t LastSignaledValue() const
+    {
+        return lastSignaledValue;
+    }
+
+    void Reset()
+    {
+        lastSignaledValue = {};
+    }
+
+    // Wait until the GPU reaches "behind" signals before the last one.
+    Status WaitForFence(PresentBackend& backend, uint64_t behind = 0, uint32_t timeoutMs = PresentBackend::INFINITE_WAIT)
+    {
+        if (lastSignaledValue == 0 || lastSignaledValue <= behind)
+            return Status::ok;
+        uint64_t targetValue = lastSignaledValue - behind;
+        if (backend.CompletedValue() >= targetValue)
+            return Status::ok;
+
+        return backend.WaitForValue(targetValue, timeoutMs);
+    }
+
+    // Wait for the rendering completion for the back buffer which is going to be recorded next.
+    // onPresentLock is called every time the wait exceeds timeoutMs, returning false aborts the wait.
+    Status WaitForBackBuffer(PresentBackend& backend, uint32_t timeoutMs, const std::function<bool()>& onPresentLock)
+    {
+        const uint64_t numBuffers{ backend.BackBufferCount() };
+        if (lastSignaledValue - backend.CompletedValue() < numBuffers)
+            return Status::ok;
+
+        for (;;) {
+            auto sts = WaitForFence(backend, numBuffers - 1, timeoutMs);
+            if (sts != Status::timeout)
+                return sts;
+            if (!onPresentLock())
+                return Status::error;
+        }
+    }
+
+    // Wait until the next frame can be recorded in the given pacing mode.
+    Status WaitForFrameStart(PresentBackend& backend, FramePacingMode mode, uint32_t timeoutMs, const std::function<bool()>& onPresentLock)
+    {
+        if (mode == FramePacingMode::latencyWaitable) {
+            for (;;) {
+                auto sts = backend.WaitForFrameLatency(timeoutMs);
+                if (sts == Status::ok)
+                    break;
+                if (sts != Status::timeout)
+                    return sts;
+                if (!onPresentLock())
+                    return Status::error;
+            }
+        }
+        // The command allocator of the back buffer still needs to be released by the GPU.
+        return WaitForBackBuffer(backend, timeoutMs, onPresentLock);
+    }
+
+    // Present and put a signal behind it. The signal is skipped when Present fails.
+    Status PresentAndSignal(PresentBackend& backend, uint32_t syncInterval)
+    {
+        auto sts = backend.Present(syncInterval);
+        if (sts == Status::error)
+            return sts;
+        if (!backend.Signal(++lastSignaledValue))
+            return Status::error;
+        return sts;
+    }
+};
+
+// The sequencing of the frames of a window, shared by D3DContext_Base and SimulatedWindow. The window thread asks it
+// when to start the next frame. The present thread then waits until the frame can be recorded, has it recorded, submits
+// and presents it, or in the pipelined mode takes it from a record thread which records up to a back buffer count - 1
+// frames ahead. The owner implements the steps: the clock, the recording, the submission and what to keep of a present.
+class FrameLoop final
+{
+public:
+    // A frame from the start of its recording to its present.
+    class Frame final {
+    public:
+        uint32_t        backbufferIdx{};
+        uint64_t        fenceValue{};       // Signaled behind its present.
+        FramePacingMode pacingMode{};
+        uint64_t        recordStartNs{};    // The request, until the recording starts.
+        uint64_t        recordEndNs{};
+        uint64_t        globalCounter{};    // Rendered in the frame.
+    };
+
+    // A present which succeeded, and the latest flip of the swap chain after it.
+    class Presented final {
+    public:
+        PresentBackend::Status  status{};   // ok or occluded.
+        uint64_t    presentNs{};            // Present returned.
+        bool        flipped{ false };       // The frame statistics reported a flip.
+        uint64_t    flipNs{};
+        uint32_t    flipPresentCount{};
+    };
+
+    class Steps {
+    public:
+        virtual ~Steps() = default;
+
+        // The time of the present thread.
+        virtual uint64_t NowNs() = 0;
+        // A wait for the GPU or for the record thread took longer than TIMEOUT_MS. Returning false gives up the frame.
+        virtual bool OnPresentLock() = 0;
+        // Pipelined mode, on the record thread, before its first frame.
+        virtual void OnRecordThreadStart() {}
+        // Pipelined mode, on the record thread: wait until the GPU is done with the back buffer of the frame. Long waits
+        // give up once cancel is set.
+        virtual bool WaitForRecordStart(const Frame& frame, const std::atomic<bool>& cancel) = 0;
+        // On the present thread, or on the record thread in the pipelined mode.
+        virtual bool RecordFrame(Frame& frame) = 0;
+        // The present thread waited for the frame: for its back buffer before recording it, or for the record thread.
+        virtual void OnFrameWaited(const Frame& frame) = 0;
+        virtual bool SubmitFrame(const Frame& frame) = 0;
+        // Right before the present call.
+        virtual void BeforePresent() {}
+        virtual void OnPresented(const Frame& frame, const Presented& presented) = 0;
+    };
+
+    enum class Status {
+        ok,
+        waitFailed,     // For the GPU, or given up on a present lock.
+        recordFailed,
+        submitFailed,
+        presentFailed,  // The present call or the signal behind it.
+    };
+
+    static constexpr uint32_t TIMEOUT_MS{ 2000 };
+
+    FrameSync               frameSync;
+    FrameStartScheduler     frameStartScheduler;
+    // Fitted to the flips, or to the presents where the swap chain doesn't report them.
+    VblankEstimator         vblankEstimator;
+    FramePipeline<Frame>    pipeline;
+    TraceExporter*          tracer{};
+
+    // Used by the present thread, and by the window thread while the present thread is idle.
+    FrameStartMode      frameStartMode{ FrameStartMode::fixedDelay };
+    FramePacingMode     pacingMode{ FramePacingMode::fence };
+    bool                pipelined{ false };
+    uint32_t            pipelineDepth{ UINT32_MAX };    // Frames recorded ahead of the presented one, up to back buffer count - 1.
+    uint32_t            syncInterval{ 1 };
+
+private:
+    PresentBackend&     backend;
+    Steps&              steps;
+
+public:
+    FrameLoop(PresentBackend& inBackend, Steps& inSteps)
+        : backend(inBackend), steps(inSteps)
+    {
+    }
+    FrameLoop(const FrameLoop&) = delete;
+    FrameLoop& operator=(const FrameLoop&) = delete;
+
+    // Window thread, while the present thread is idle: when to start the next frame, 0 for right away. In the just in
+    // time mode, call it again once the start is reached, a frame may have turned out late meanwhile.
+    uint64_t NextFrameStartNs(uint64_t lastPresentNs, float threadWaitMs)
+    {
+        switch (frameStartMode) {
+        case FrameStartMode::fixedDelay:
+            // The duration from the last present.
+            return lastPresentNs + (uint64_t)(threadWaitMs * 1'000'000.0);
+        case FrameStartMode::asFastAsPossible:
+            return 0;
+        case FrameStartMode::justInTime:
+            break;
+        }
+        const uint64_t now{ steps.NowNs() };
+        uint64_t flipNs{};
+        uint32_t presentCount{};
+        if (backend.LastFlip(flipNs, presentCount)) {
+            frameStartScheduler.OnFlip(presentCount, flipNs);
+        }
+        frameStartScheduler.OnTime(now);
+        const auto next{ vblankEstimator.Predict(now) };
+        return frameStartScheduler.Plan(now, next.valid ? next.vblankNs : 0, (uint64_t)vblankEstimator.PeriodNs());
+    }
+
+    // Present thread: the frame the window thread started at frameStartNs.
+    Status Present(uint64_t frameStartNs)
+    {
+        if (frameStartMode == FrameStartMode::justInTime) {
+            frameStartScheduler.OnStart(frameStartNs);
+        }
+        if (pipelined)
+            return PresentPipelined();
+
+        // Wait for the frame latency waitable if selected, then for the rendering completion for the current backbuffer index.
+        {
+            TraceExporter::Scope trace{ tracer, "WaitForFrameStart", "present" };
+            auto sts = frameSync.WaitForFrameStart(backend, pacingMode, TIMEOUT_MS, [this]() { return steps.OnPresentLock(); });
+            if (sts != PresentBackend::Status::ok)
+                return Status::waitFailed;
+        }
+        Frame frame{ backend.CurrentBackBufferIndex(), frameSync.LastSignaledValue() + 1, pacingMode, steps.NowNs() };
+        steps.OnFrameWaited(frame);
+        if (!steps.RecordFrame(frame))
+            return Status::recordFailed;
+        return SubmitAndPresent(frame);
+    }
+
+private:
+    // Frame N + 1 is recorded on the record thread while frame N is submitted and presented here.
+    Status PresentPipelined()
+    {
+        if (!pipeline.IsRunning()) {
+            pipeline.Start([this](Frame& f, const std::atomic<bool>& cancel) {
+                return steps.WaitForRecordStart(f, cancel) && steps.RecordFrame(f);
+                }, [this]() { steps.OnRecordThreadStart(); });
+        }
+
+        // Keep a frame per remaining back buffer, up to the pipeline depth, requested behind the one presented below.
+        // The back buffers and the fence values follow the order of the presents.
+        const uint32_t numBuffers{ backend.BackBufferCount() };
+        const uint64_t depth{ std::min<uint64_t>(pipelineDepth, numBuffers - 1) + 1 };
+        for (size_t inFlight = pipeline.InFlight(); inFlight < depth; ++inFlight) {
+            pipeline.Request({ (uint32_t)((backend.CurrentBackBufferIndex() + inFlight) % numBuffers),
+                frameSync.LastSignaledValue() + inFlight + 1, pacingMode, steps.NowNs() });
+        }
+
+        Frame frame;
+        for (;;) {
+            TraceExporter::Scope trace{ tracer, "WaitForRecordedFrame", "present" };
+            auto sts = pipeline.Take(frame, std::chrono::milliseconds(TIMEOUT_MS));
+            if (sts == FramePipeline<Frame>::Status::ok)
+                break;
+            if (sts != FramePipeline<Frame>::Status::timeout)
+                return Status::recordFailed;
+            if (!steps.OnPresentLock())
+                return Status::waitFailed;
+        }
+        steps.OnFrameWaited(frame);
+        return SubmitAndPresent(frame);
+    }
+
+    Status SubmitAndPresent(const Frame& frame)
+    {
+        if (!steps.SubmitFrame(frame))
+            return Status::submitFailed;
+        if (frameStartMode == FrameStartMode::justInTime) {
+            // Ready before the present call, which may block behind the frames queued ahead.
+            frameStartScheduler.OnReady(steps.NowNs(), backend.LastPresentCount() + 1);
+        }
+        steps.BeforePresent();
+
+        Presented presented;
+        {
+            TraceExporter::Scope trace{ tracer, "Present", "present" };
+            trace.argName = "fenceValue";
+            trace.arg = frameSync.LastSignaledValue() + 1;
+            presented.status = frameSync.PresentAndSignal(backend, syncInterval);
+            if (presented.status == PresentBackend::Status::error)
+                return Status::presentFailed;
+        }
+        presented.presentNs = steps.NowNs();
+        presented.flipped = backend.LastFlip(presented.flipNs, presented.flipPresentCount);
+        vblankEstimator.Update(presented.flipped ? presented.flipNs : presented.presentNs);
+        steps.OnPresented(frame, presented);
+        return Status::ok;
+    }
+};
+
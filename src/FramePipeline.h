@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <tuple>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "Clock.h"
+
+// Records frames on a worker thread while the thread which owns the pipeline submits and presents earlier ones.
+// The owner requests frames in presentation order and takes them back recorded in the same order, so it bounds the
+// number of frames in flight by how many it requests before taking one.
+template <typename Frame>
+class FramePipeline final
+{
+public:
+    // Runs on the worker. Returning false drops the frame. Long waits should give up once cancel is set.
+    using RecordFunc = std::function<bool(Frame& frame, const std::atomic<bool>& cancel)>;
+
+    enum class Status {
+        ok,
+        failed,     // The record function returned false.
+        timeout,
+        empty,      // Nothing requested.
+    };
+
+private:
+    std::mutex                  mtx;
+    std::condition_variable     cv;
+    std::deque<Frame>                       requested;
+    std::deque<std::tuple<Frame, bool>>     recorded;   // frame, succeeded
+    bool                        recording{ false };
+    bool                        paused{ false };
+    bool                        exitReq{ false };
+    std::atomic<bool>           cancel{ false };
+    std::thread                 worker;
+    RecordFunc                  record;
+
+public:
+    FramePipeline() = default;
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    ~FramePipeline()
+    {
+        Stop();
+    }
+
+    // onStart runs first on the worker, e.g. to name the thread.
+    bool Start(RecordFunc inRecord, std::function<void()> onStart = {})
+    {
+        if (worker.joinable())
+            return false;
+        record = std::move(inRecord);
+        exitReq = false;
+        worker = std::thread([this, onStart = std::move(onStart)]() {
+            if (onStart)
+                onStart();
+            std::unique_lock<std::mutex> l{ mtx };
+            for (;;) {
+                cv.wait(l, [this] { return exitReq || (!paused && !requested.empty()); });
+                if (exitReq)
+                    break;
+                Frame f{ requested.front() };
+                requested.pop_front();
+                recording = true;
+                l.unlock();
+                const bool sts{ record(f, cancel) };
+                l.lock();
+                recording = false;
+                // Discarded while it was recorded.
+                if (!cancel.load(std::memory_order_relaxed))
+                    recorded.push_back({ f, sts });
+                cv.notify_all();
+            }
+            });
+        return true;
+    }
+
+    // Drops the frames which haven't been taken.
+    void Stop()
+    {
+        if (!worker.joinable())
+            return;
+        {
+            std::scoped_lock<std::mutex> l{ mtx };
+            exitReq = true;
+            cancel.store(true);
+        }
+        cv.notify_all();
+        worker.join();
+        requested.clear();
+        recorded.clear();
+        paused = false;
+        cancel.store(false);
+    }
+
+    bool IsRunning() const
+    {
+        return worker.joinable();
+    }
+
+    // Requested and not taken yet, including the frame being recorded.
+    size_t InFlight()
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        return requested.size() + (recording ? 1 : 0) + recorded.size();
+    }
+
+    void Request(const Frame& f)
+    {
+        {
+            std::scoped_lock<std::mutex> l{ mtx };
+            requested.push_back(f);
+        }
+        cv.notify_all();
+    }
+
+    // Takes the oldest requested frame once it has been recorded. The timeout is on Clock::Get().
+    Status Take(Frame& f, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> l{ mtx };
+        if (requested.empty() && !recording && recorded.empty())
+            return Status::empty;
+        const uint64_t timeoutNs{ (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count() };
+        if (!Clock::Get().WaitForNs(cv, l, timeoutNs, [this] { return !recorded.empty(); }))
+            return Status::timeout;
+        bool sts;
+        std::tie(f, sts) = recorded.front();
+        recorded.pop_front();
+        return sts ? Status::ok : Status::failed;
+    }
+
+    // Holds the worker back from the requested frames, once it's done with the one it records. They are kept and get
+    // recorded after Resume. The frames recorded until then can still be taken.
+    void Pause()
+    {
+        std::unique_lock<std::mutex> l{ mtx };
+        paused = true;
+        cv.wait(l, [this] { return !recording; });
+    }
+
+    void Resume()
+    {
+        {
+            std::scoped_lock<std::mutex> l{ mtx };
+            paused = false;
+        }
+        cv.notify_all();
+    }
+
+    // Drops the frames which haven't been taken, after the worker is done with the one it records. Returns their number.
+    size_t Discard()
+    {
+        std::unique_lock<std::mutex> l{ mtx };
+        cancel.store(true);
+        size_t dropped{ requested.size() + recorded.size() + (recording ? 1 : 0) };
+        requested.clear();
+        cv.wait(l, [this] { return !recording; });
+        recorded.clear();
+        cancel.store(false);
+        return dropped;
+    }
+};
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <deque>
+#include <algorithm>
+
+// When the window loop starts the next frame of a display.
+enum class FrameStartMode : uint32_t {
+    fixedDelay,         // The thread wait after the last present.
+    asFastAsPossible,   // Right after the last present, only held back by the pacing mode.
+    justInTime,         // As late as the next vblank allows, see FrameStartScheduler.
+};
+
+// Starts each frame just in time for a vblank: at the vblank, minus the measured cost of a frame from its start until
+// it's ready to flip, minus a safety margin. A frame which flips after its vblank is a miss. A miss widens the margin by
+// a step and a hit narrows it by step * target / (1 - target), so the margin settles where the miss rate is the
+// target, and the content is as young at scan out as that miss rate allows.
+// The frames in flight flip one per vblank. A frame known to be late pushes the next one past its flip, so the next one
+// doesn't queue behind it, and a frame which did queue behind a late one isn't counted as a miss of its own.
+class FrameStartScheduler final
+{
+public:
+    class Config final {
+    public:
+        double      targetMissRate{ 0.01 };
+        uint64_t    initialMarginNs{ 2'000'000 };
+        uint64_t    minMarginNs{};
+        uint64_t    maxMarginNs{ 20'000'000 };
+        uint64_t    missStepNs{ 250'000 };      // Margin added by a miss.
+    };
+
+    class Stats final {
+    public:
+        uint64_t    frames{};           // Flipped or late.
+        uint64_t    misses{};
+        double      recentMissRate{};   // Over about the last thousand frames.
+        double      marginNs{};
+        double      costNs{};
+        double      costDevNs{};        // Mean absolute deviation.
+        double      meanAgeNs{};        // From the start of a frame to its scan out.
+    };
+
+private:
+    class Frame final {
+    public:
+        uint64_t    id{};
+        uint64_t    startNs{};
+        uint64_t    targetNs{};
+        bool        late{ false };      // Past its vblank, waiting for its flip.
+        uint64_t    lateFlipNs{};       // Late: the first vblank it can flip on.
+    };
+
+    static constexpr double CostAlpha{ 1.0 / 16.0 };
+    static constexpr double MissRateAlpha{ 1.0 / 1024.0 };
+    static constexpr size_t MaxInFlight{ 16 };
+    static constexpr uint64_t LostAfterPeriods{ 4 };
+
+    Config              cfg;
+    double              marginNs{};
+    double              costNs{};
+    double              costDevNs{};
+    bool                costKnown{ false };
+    uint64_t            periodNs{};
+    uint64_t            plannedNs{};        // Vblank of the next frame, 0 until planned.
+    uint64_t            lastTargetNs{};     // Of the last started frame.
+    uint64_t            startNs{};          // Of the frame being rendered, 0 when none is.
+    uint64_t            startTargetNs{};
+    uint64_t            lastFlipNs{};
+    std::deque<Frame>   inFlight;           // Ready, not flipped yet.
+    Stats               stats;
+    double              sumAgeNs{};
+    uint64_t            agedFrames{};
+
+    void Result(bool missed)
+    {
+        ++stats.frames;
+        const double step{ (double)cfg.missStepNs };
+        if (missed) {
+            ++stats.misses;
+            marginNs += step;
+        }
+        else {
+            marginNs -= step * cfg.targetMissRate / (1.0 - cfg.targetMissRate);
+        }
+        marginNs = std::clamp(marginNs, (double)cfg.minMarginNs, (double)cfg.maxMarginNs);
+        stats.recentMissRate += ((missed ? 1.0 : 0.0) - stats.recentMissRate) * MissRateAlpha;
+    }
+
+    void MarkLate(Frame& f, uint64_t nowNs)
+    {
+        f.late = true;
+        f.lateFlipNs = f.targetNs + (nowNs - f.targetNs + periodNs - 1) / periodNs * periodNs;
+    }
+
+    void Age(const Frame& f, uint64_t flipNs)
+    {
+        if (flipNs <= f.startNs)
+            return;
+        sumAgeNs += (double)(flipNs - f.startNs);
+        ++agedFrames;
+    }
+
+public:
+    FrameStartScheduler()
+    {
+        Reset(Config{});
+    }
+
+    explicit FrameStartScheduler(const Config& inCfg)
+    {
+        Reset(inCfg);
+    }
+
+    void Reset(const Config& inCfg)
+    {
+        cfg = inCfg;
+        cfg.targetMissRate = std::clamp(cfg.targetMissRate, 0.0001, 0.5);
+        marginNs = (double)std::clamp(cfg.initialMarginNs, cfg.minMarginNs, cfg.maxMarginNs);
+        costNs = costDevNs = 0.0;
+        costKnown = false;
+        periodNs = 0;
+        plannedNs = lastTargetNs = startNs = startTargetNs = lastFlipNs = 0;
+        inFlight.clear();
+        stats = {};
+        sumAgeNs = 0.0;
+        agedFrames = 0;
+    }
+
+    // From the start of a frame to its vblank.
+    uint64_t LeadNs() const
+    {
+        return (uint64_t)(costNs + 2.0 * costDevNs + marginNs);
+    }
+
+    // Start of the next frame, may be in the past. nextVblankNs is the first vblank after nowNs, 0 while no vblank is
+    // known, which starts the frame now. Call OnTime first. The planned vblank is kept until the frame starts, unless a
+    // late frame takes it, so call it again once the start is reached.
+    uint64_t Plan(uint64_t nowNs, uint64_t nextVblankNs, uint64_t inPeriodNs)
+    {
+        if (nextVblankNs == 0) {
+            plannedNs = 0;
+            return nowNs;
+        }
+        periodNs = std::max<uint64_t>(inPeriodNs, 1);
+        const uint64_t half{ periodNs / 2 };
+
+        // After the vblank of the last frame, and the projected flips of the frames in flight, which queue behind the
+        // last flip. So a backlog behind a late frame gets drained.
+        uint64_t floorNs{ lastTargetNs + half };
+        uint64_t flipNs{ lastFlipNs };
+        for (auto& f : inFlight)
+            flipNs = std::max(f.late ? f.lateFlipNs : f.targetNs, flipNs + periodNs);
+        floorNs = std::max(floorNs, flipNs + half);
+        // Keep the planned vblank on the latest estimate.
+        if (plannedNs != 0)
+            plannedNs = plannedNs + half >= nextVblankNs ? nextVblankNs + (plannedNs + half - nextVblankNs) / periodNs * periodNs : 0;
+        if (plannedNs != 0 && plannedNs >= floorNs)
+            return plannedNs > LeadNs() ? plannedNs - LeadNs() : 0;
+
+        const uint64_t lead{ LeadNs() };
+        floorNs = std::max(floorNs, nowNs + lead);
+        uint64_t v{ nextVblankNs };
+        if (v < floorNs)
+            v += (floorNs - v + periodNs - 1) / periodNs * periodNs;
+        plannedNs = v;
+        return v - lead;
+    }
+
+    // The frame starts rendering. Only its cost is measured when it had no vblank planned.
+    void OnStart(uint64_t nowNs)
+    {
+        startNs = nowNs;
+        startTargetNs = plannedNs;
+        lastTargetNs = std::max(lastTargetNs, startTargetNs);
+        plannedNs = 0;
+    }
+
+    // The frame is ready to be presented, before the present call, which may block behind the frames queued ahead.
+    // id orders the frames, like the present count.
+    void OnReady(uint64_t readyNs, uint64_t id)
+    {
+        if (startNs == 0)
+            return;
+        const double cost{ (double)(readyNs > startNs ? readyNs - startNs : 0) };
+        if (!costKnown) {
+            costNs = cost;
+            costKnown = true;
+        }
+        else {
+            costDevNs += (std::abs(cost - costNs) - costDevNs) * CostAlpha;
+            costNs += (cost - costNs) * CostAlpha;
+        }
+        if (startTargetNs != 0) {
+            if (inFlight.size() >= MaxInFlight)
+                inFlight.pop_front();
+            const bool behindLate{ !inFlight.empty() && inFlight.back().late };
+            inFlight.push_back({ id, startNs, startTargetNs });
+            // Ready after its vblank.
+            if (readyNs > startTargetNs) {
+                MarkLate(inFlight.back(), readyNs);
+                if (!behindLate)
+                    Result(true);
+            }
+        }
+        startNs = 0;
+    }
+
+    // The frame id was scanned out at flipNs, the ones before it earlier.
+    void OnFlip(uint64_t id, uint64_t flipNs)
+    {
+        while (!inFlight.empty() && inFlight.front().id <= id) {
+            const Frame f{ inFlight.front() };
+            inFlight.pop_front();
+            if (!f.late) {
+                // Missed unless the frame ahead still held its vblank.
+                const bool flipKnown{ f.id == id };
+                Result(flipKnown && flipNs > f.targetNs + periodNs / 2 && lastFlipNs + periodNs / 2 <= f.targetNs);
+            }
+            if (f.id == id) {
+                Age(f, flipNs);
+                lastFlipNs = flipNs;
+            }
+        }
+    }
+
+    // Frames still not flipped half a period after their vblank are late. It's their miss unless the frame ahead of
+    // them is late too. Those which never get reported flipped are dropped after a few periods.
+    void OnTime(uint64_t nowNs)
+    {
+        while (!inFlight.empty() && inFlight.front().late && nowNs > inFlight.front().targetNs + LostAfterPeriods * periodNs)
+            inFlight.pop_front();
+        for (size_t i = 0; i < inFlight.size(); ++i) {
+            auto& f{ inFlight[i] };
+            if (f.late || nowNs <= f.targetNs + periodNs / 2)
+                continue;
+            MarkLate(f, nowNs);
+            if (i > 0 ? !inFlight[i - 1].late : lastFlipNs + periodNs / 2 <= f.targetNs)
+                Result(true);
+        }
+    }
+
+    Stats GetStats() const
+    {
+        Stats s{ stats };
+        s.marginNs = marginNs;
+        s.costNs = costNs;
+        s.costDevNs = costDevNs;
+        s.meanAgeNs = agedFrames > 0 ? sumAgeNs / agedFrames : 0.0;
+        return s;
+    }
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+
+#include "Clock.h"
+
+// Per-window record of the frame timeline, written by the present thread and read concurrently by analysis threads.
+// The ring has a fixed capacity and never blocks or allocates. When a reader falls behind, the oldest records are
+// overwritten and the reader skips them. Slots are versioned like a seqlock, so torn reads are detected and dropped.
+class alignas(64) FrameTimeline final
+{
+public:
+    static constexpr uint32_t Capacity{ 1024 };
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+    // All times are nanoseconds of the steady clock, or of the virtual clock in the simulation.
+    class Record final {
+    public:
+        uint64_t    frameIdx{};
+        uint64_t    globalCounter{};    // Counter value rendered in the frame.
+        uint64_t    recordStartNs{};
+        uint64_t    submitNs{};         // ExecuteCommandLists returned.
+        uint64_t    presentNs{};        // Present returned.
+        uint64_t    fenceValue{};       // Signaled behind the Present.
+        uint64_t    fenceCompleteNs{};  // The completion got observed by the present thread.
+    };
+
+    static uint64_t NowNs()
+    {
+        return Clock::Get().NowNs();
+    }
+
+private:
+    static constexpr uint32_t NumFields{ 7 };
+    static constexpr uint32_t MaxInFlight{ 16 };
+
+    // One cache line per record. seq is 2 * frameIdx + 1 while the slot is written, 2 * frameIdx + 2 once published.
+    class alignas(64) Slot final {
+    public:
+        std::atomic<uint64_t>                           seq{};
+        std::array<std::atomic<uint64_t>, NumFields>    fields{};
+    };
+    std::array<Slot, Capacity>  slots;
+
+    // Number of published records.
+    alignas(64) std::atomic<uint64_t>   head{};
+
+    // Producer only. Frames are kept here from Present until their fence completion is observed.
+    alignas(64) std::array<Record, MaxInFlight> inFlight{};
+    uint32_t    inFlightBegin{};
+    uint32_t    inFlightCount{};
+    Record      current{};
+    uint64_t    nextFrameIdx{};
+
+    void Publish(const Record& r)
+    {
+        const uint64_t idx{ head.load(std::memory_order_relaxed) };
+        Slot& s{ slots[idx & (Capacity - 1)] };
+        s.seq.store(2 * idx + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.fields[0].store(r.frameIdx, std::memory_order_relaxed);
+        s.fields[1].store(r.globalCounter, std::memory_order_relaxed);
+        s.fields[2].store(r.recordStartNs, std::memory_order_relaxed);
+        s.fields[3].store(r.submitNs, std::memory_order_relaxed);
+        s.fields[4].store(r.presentNs, std::memory_order_relaxed);
+        s.fields[5].store(r.fenceValue, std::memory_order_relaxed);
+        s.fields[6].store(r.fenceCompleteNs, std::memory_order_relaxed);
+        s.seq.store(2 * idx + 2, std::memory_order_release);
+        head.store(idx + 1, std::memory_order_release);
+    }
+
+public:
+    // Producer: the present thread.
+    void BeginFrame(uint64_t recordStartNs, uint64_t globalCounter)
+    {
+        current = {};
+        current.frameIdx = nextFrameIdx++;
+        current.recordStartNs = recordStartNs;
+        current.globalCounter = globalCounter;
+    }
+
+    void SetGlobalCounter(uint64_t globalCounter)
+    {
+        current.globalCounter = globalCounter;
+    }
+
+    void MarkSubmit(uint64_t ns)
+    {
+        current.submitNs = ns;
+    }
+
+    void MarkPresent(uint64_t ns, uint64_t fenceValue)
+    {
+        current.presentNs = ns;
+        current.fenceValue = fenceValue;
+
+        // More frames in flight than the swap chain can queue means completions are not being observed. Publish without one.
+        if (inFlightCount == MaxInFlight) {
+            Publish(inFlight[inFlightBegin]);
+            inFlightBegin = (inFlightBegin + 1) % MaxInFlight;
+            --inFlightCount;
+        }
+        inFlight[(inFlightBegin + inFlightCount) % MaxInFlight] = current;
+        ++inFlightCount;
+    }
+
+    // Publish the frames whose fence is completed. Call after fence waits with the completed value of the fence.
+    void CompleteFence(uint64_t completedValue, uint64_t ns)
+    {
+        while (inFlightCount > 0 && inFlight[inFlightBegin].fenceValue <= completedValue) {
+            inFlight[inFlightBegin].fenceCompleteNs = ns;
+            Publish(inFlight[inFlightBegin]);
+            inFlightBegin = (inFlightBegin + 1) % MaxInFlight;
+            --inFlightCount;
+        }
+    }
+
+    // Consumer: any thread. Several readers can read concurrently with their own cursors.
+    uint64_t Published() const
+    {
+        return head.load(std::memory_order_acquire);
+    }
+
+    // Copy up to maxRecords records from cursor on and advance cursor. Records which got overwritten before they
+    // could be read are skipped and counted in lost.
+    uint32_t Read(uint64_t& cursor, Record* out, uint32_t maxRecords, uint64_t* lost = nullptr) const
+    {
+        const uint64_t end{ head.load(std::memory_order_acquire) };
+        uint64_t numLost{};
+        if (end - cursor > Capacity) {
+            numLost += end - Capacity - cursor;
+            cursor = end - Capacity;
+        }
+
+        uint32_t n{};
+        for (; cursor < end && n < maxRecords; ++cursor) {
+            const Slot& s{ slots[cursor & (Capacity - 1)] };
+            const uint64_t seq1{ s.seq.load(std::memory_order_acquire) };
+            Record r;
+            r.frameIdx = s.fields[0].load(std::memory_order_relaxed);
+            r.globalCounter = s.fields[1].load(std::memory_order_relaxed);
+            r.recordStartNs = s.fields[2].load(std::memory_order_relaxed);
+            r.submitNs = s.fields[3].load(std::memory_order_relaxed);
+            r.presentNs = s.fields[4].load(std::memory_order_relaxed);
+            r.fenceValue = s.fields[5].load(std::memory_order_relaxed);
+            r.fenceCompleteNs = s.fields[6].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t seq2{ s.seq.load(std::memory_order_relaxed) };
+
+            if (seq1 != 2 * cursor + 2 || seq2 != seq1) {
+                // Overwritten by the producer while reading.
+                ++numLost;
+                continue;
+            }
+            out[n++] = r;
+        }
+        if (lost != nullptr)
+            *lost = numLost;
+        return n;
+    }
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <algorithm>
+#include <bit>
+
+// Log-linear histogram in the style of HdrHistogram. Every power of two range is split into 2^SubBucketBits linear
+// sub-buckets, so a recorded value is off by less than 1 / 2^SubBucketBits relative to its bucket. Memory is fixed
+// and histograms of the same shape merge by adding the bucket counts.
+class LogLinearHistogram final
+{
+public:
+    static constexpr uint32_t SubBucketBits{ 7 };
+    static constexpr uint32_t MaxValueBits{ 40 };     // 2^40 ns is about 18 minutes.
+    static constexpr uint64_t MaxValue{ (1ull << MaxValueBits) - 1 };
+
+private:
+    static constexpr uint64_t SubBuckets{ 1ull << SubBucketBits };
+    static constexpr size_t   NumBuckets{ (MaxValueBits - SubBucketBits + 1) * SubBuckets };
+
+    std::array<uint64_t, NumBuckets>    counts{};
+    uint64_t    totalCount{};
+    uint64_t    minValue{ UINT64_MAX };
+    uint64_t    maxValue{};
+    double      sum{};
+    double      sumSq{};
+
+    static size_t BucketIndex(uint64_t v)
+    {
+        if (v < SubBuckets)
+            return (size_t)v;
+        const uint32_t shift{ (uint32_t)std::bit_width(v) - 1 - SubBucketBits };
+        return (size_t)((shift + 1) * SubBuckets + ((v >> shift) - SubBuckets));
+    }
+
+    static uint64_t BucketLowest(size_t idx)
+    {
+        if (idx < SubBuckets)
+            return idx;
+        const uint64_t shift{ idx / SubBuckets - 1 };
+        return (SubBuckets + idx % SubBuckets) << shift;
+    }
+
+    static uint64_t BucketHighest(size_t idx)
+    {
+        if (idx < SubBuckets)
+            return idx;
+        const uint64_t shift{ idx / SubBuckets - 1 };
+        return ((SubBuckets + idx % SubBuckets + 1) << shift) - 1;
+    }
+
+public:
+    void Reset()
+    {
+        *this = {};
+    }
+
+    // O(1).
+    void Record(uint64_t v)
+    {
+        v = std::min(v, MaxValue);
+        ++counts[BucketIndex(v)];
+        ++totalCount;
+        minValue = std::min(minValue, v);
+        maxValue = std::max(maxValue, v);
+        sum += (double)v;
+        sumSq += (double)v * (double)v;
+    }
+
+    void Merge(const LogLinearHistogram& other)
+    {
+        for (size_t i = 0; i < NumBuckets; ++i)
+            counts[i] += other.counts[i];
+        totalCount += other.totalCount;
+        minValue = std::min(minValue, other.minValue);
+        maxValue = std::max(maxValue, other.maxValue);
+        sum += other.sum;
+        sumSq += other.sumSq;
+    }
+
+    uint64_t Count() const
+    {
+        return totalCount;
+    }
+
+    uint64_t Min() const
+    {
+        return totalCount > 0 ? minValue : 0;
+    }
+
+    uint64_t Max() const
+    {
+        return maxValue;
+    }
+
+    double Mean() const
+    {
+        return totalCount > 0 ? sum / totalCount : 0.0;
+    }
+
+    double StdDev() const
+    {
+        if (totalCount < 2)
+            return 0.0;
+        const double mean{ Mean() };
+        return std::sqrt(std::max(0.0, sumSq / totalCount - mean * mean));
+    }
+
+    // Value at the quantile q in [0, 1], the midpoint of the bucket clamped to the recorded range. O(number of buckets).
+    uint64_t Percentile(double q) const
+    {
+        if (totalCount == 0)
+            return 0;
+        const uint64_t rank{ std::max<uint64_t>(1, (uint64_t)std::ceil(std::clamp(q, 0.0, 1.0) * totalCount)) };
+        uint64_t acc{};
+        for (size_t i = 0; i < NumBuckets; ++i) {
+            acc += counts[i];
+            if (acc >= rank) {
+                const uint64_t mid{ BucketLowest(i) + (BucketHighest(i) - BucketLowest(i)) / 2 };
+                return std::clamp(mid, minValue, maxValue);
+            }
+        }
+        return maxValue;
+    }
+};
+
+// Present-to-present interval statistics of a display, fed with the time of every present.
+class PresentIntervalStats final
+{
+public:
+    class Summary final {
+    public:
+        uint64_t    intervals{};
+        double      minMs{};
+        double      meanMs{};
+        double      p50Ms{};
+        double      p99Ms{};
+        double      p999Ms{};
+        double      maxMs{};
+        double      jitterMs{};         // Standard deviation of the interval.
+        uint64_t    missedVblanks{};    // Refreshes over syncInterval per present.
+    };
+
+private:
+    LogLinearHistogram  histogram;
+    uint64_t    refreshPeriodNs{};
+    uint32_t    syncInterval{ 1 };
+    uint64_t    lastPresentNs{};
+    bool        hasLastPresent{ false };
+    uint64_t    missedVblanks{};
+
+public:
+    void SetRefreshPeriod(uint64_t periodNs, uint32_t inSyncInterval = 1)
+    {
+        refreshPeriodNs = periodNs;
+        syncInterval = inSyncInterval;
+    }
+
+    void Reset()
+    {
+        histogram.Reset();
+        hasLastPresent = false;
+        missedVblanks = 0;
+    }
+
+    // O(1).
+    void OnPresent(uint64_t presentNs)
+    {
+        if (hasLastPresent && presentNs >= lastPresentNs) {
+            const uint64_t interval{ presentNs - lastPresentNs };
+            histogram.Record(interval);
+            if (refreshPeriodNs > 0 && syncInterval > 0) {
+                // Round to the nearest refresh count, presents wobble around the vblank.
+                const uint64_t refreshes{ (interval + refreshPeriodNs / 2) / refreshPeriodNs };
+                if (refreshes > syncInterval)
+                    missedVblanks += refreshes - syncInterval;
+            }
+        }
+        lastPresentNs = presentNs;
+        hasLastPresent = true;
+    }
+
+    const LogLinearHistogram& Histogram() const
+    {
+        return histogram;
+    }
+
+    Summary Summarize() const
+    {
+        constexpr double nsToMs{ 1.0 / 1'000'000.0 };
+        Summary s;
+        s.intervals = histogram.Count();
+        s.minMs = histogram.Min() * nsToMs;
+        s.meanMs = histogram.Mean() * nsToMs;
+        s.p50Ms = histogram.Percentile(0.5) * nsToMs;
+        s.p99Ms = histogram.Percentile(0.99) * nsToMs;
+        s.p999Ms = histogram.Percentile(0.999) * nsToMs;
+        s.maxMs = histogram.Max() * nsToMs;
+        s.jitterMs = histogram.StdDev() * nsToMs;
+        s.missedVblanks = missedVblanks;
+        return s;
+    }
+};
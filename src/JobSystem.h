@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+// Fixed pool of workers running the per-frame jobs of every window. Each worker has its own queue. It runs its newest
+// job first, and steals the oldest job of another queue when it runs out. Jobs are counted by the group they were
+// added to, usually the frame of a window, and a window waits for its own group only. While it waits, it runs the
+// queued jobs of its group itself instead of those of other windows.
+class JobSystem final
+{
+public:
+    using Job = std::function<void()>;
+
+    class Group final {
+        friend class JobSystem;
+        std::atomic<uint32_t>   pending{};
+
+    public:
+        Group() = default;
+        Group(const Group&) = delete;
+        Group& operator=(const Group&) = delete;
+
+        bool Done() const
+        {
+            return pending.load(std::memory_order_acquire) == 0;
+        }
+    };
+
+    class Stats final {
+    public:
+        uint64_t    executed{};
+        uint64_t    stolen{};       // Taken from the queue of another worker.
+        uint64_t    helped{};       // Run by a thread waiting for its group.
+    };
+
+private:
+    class Entry final {
+    public:
+        Group*  group{};
+        Job     job;
+    };
+
+    class alignas(64) Worker final {
+    public:
+        std::mutex              mtx;
+        std::deque<Entry>       queue;
+        std::thread             thd;
+        std::atomic<uint64_t>   executed{};
+        std::atomic<uint64_t>   stolen{};
+    };
+
+    std::vector<std::unique_ptr<Worker>>    workers;
+    std::atomic<uint32_t>                   nextQueue{};
+    std::atomic<uint64_t>                   helped{};
+
+    // Idle workers sleep until a job is queued.
+    std::mutex                  sleepMtx;
+    std::condition_variable     sleepCv;
+    std::atomic<uint32_t>       queued{};
+    bool                        exitReq{ false };
+
+    // Index of the calling thread in the pool it works for.
+    static inline thread_local const JobSystem*     currentSystem{};
+    static inline thread_local uint32_t             currentWorker{};
+
+    static void Finish(Group& g)
+    {
+        if (g.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            g.pending.notify_all();
+    }
+
+    bool Pop(uint32_t self, Entry& e)
+    {
+        {
+            Worker& w{ *workers[self] };
+            std::scoped_lock<std::mutex> l{ w.mtx };
+            if (!w.queue.empty()) {
+                e = std::move(w.queue.back());
+                w.queue.pop_back();
+                return true;
+            }
+        }
+        for (uint32_t i = 1; i < workers.size(); ++i) {
+            Worker& victim{ *workers[(self + i) % workers.size()] };
+            std::scoped_lock<std::mutex> l{ victim.mtx };
+            if (!victim.queue.empty()) {
+                e = std::move(victim.queue.front());
+                victim.queue.pop_front();
+                workers[self]->stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkerLoop(uint32_t self)
+    {
+        currentSystem = this;
+        currentWorker = self;
+        Entry e;
+        for (;;) {
+            if (Pop(self, e)) {
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                e.job();
+                workers[self]->executed.fetch_add(1, std::memory_order_relaxed);
+                Finish(*e.group);
+                e = {};
+                continue;
+            }
+            std::unique_lock<std::mutex> l{ sleepMtx };
+            sleepCv.wait(l, [this] { return exitReq || queued.load(std::memory_order_relaxed) > 0; });
+            if (exitReq)
+                break;
+        }
+    }
+
+public:
+    JobSystem() = default;
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    ~JobSystem()
+    {
+        Stop();
+    }
+
+    // onStart runs first on each worker with its index, e.g. to name it.
+    bool Start(uint32_t numWorkers, std::function<void(uint32_t)> onStart = {})
+    {
+        if (!workers.empty() || numWorkers == 0)
+            return false;
+        exitReq = false;
+        for (uint32_t i = 0; i < numWorkers; ++i)
+            workers.push_back(std::make_unique<Worker>());
+        for (uint32_t i = 0; i < numWorkers; ++i) {
+            workers[i]->thd = std::thread([this, i, onStart]() {
+                if (onStart)
+                    onStart(i);
+                WorkerLoop(i);
+                });
+        }
+        return true;
+    }
+
+    // Jobs still queued are dropped, the groups waiting for them should be done first.
+    void Stop()
+    {
+        {
+            std::scoped_lock<std::mutex> l{ sleepMtx };
+            exitReq = true;
+        }
+        sleepCv.notify_all();
+        for (auto& w : workers) {
+            if (w->thd.joinable())
+                w->thd.join();
+        }
+        workers.clear();
+        queued.store(0);
+    }
+
+    uint32_t NumWorkers() const
+    {
+        return (uint32_t)workers.size();
+    }
+
+    // Any thread. A worker queues on its own queue, other threads spread their jobs over the queues.
+    void Run(Group& g, Job job)
+    {
+        g.pending.fetch_add(1, std::memory_order_relaxed);
+        if (workers.empty()) {
+            job();
+            Finish(g);
+            return;
+        }
+        const uint32_t q{ currentSystem == this ? currentWorker : nextQueue.fetch_add(1, std::memory_order_relaxed) % (uint32_t)workers.size() };
+        {
+            // Counted first, so a worker doesn't go to sleep once it's queued. Ordered with that check by the lock.
+            std::scoped_lock<std::mutex> l{ sleepMtx };
+            queued.fetch_add(1, std::memory_order_relaxed);
+        }
+        {
+            std::scoped_lock<std::mutex> l{ workers[q]->mtx };
+            workers[q]->queue.push_back({ &g, std::move(job) });
+        }
+        sleepCv.notify_one();
+    }
+
+    // Returns once every job of the group has run.
+    void Wait(Group& g)
+    {
+        Entry e;
+        while (!g.Done()) {
+            // Take a queued job of this group, the newest first.
+            bool found{ false };
+            for (auto& w : workers) {
+                std::scoped_lock<std::mutex> l{ w->mtx };
+                auto itr = std::find_if(w->queue.rbegin(), w->queue.rend(), [&g](const Entry& q) { return q.group == &g; });
+                if (itr != w->queue.rend()) {
+                    e = std::move(*itr);
+                    w->queue.erase(std::next(itr).base());
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                break;
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            e.job();
+            helped.fetch_add(1, std::memory_order_relaxed);
+            Finish(g);
+            e = {};
+        }
+        // The rest is running on the workers.
+        for (uint32_t p = g.pending.load(std::memory_order_acquire); p != 0; p = g.pending.load(std::memory_order_acquire))
+            g.pending.wait(p, std::memory_order_acquire);
+    }
+
+    Stats GetStats() const
+    {
+        Stats s;
+        for (auto& w : workers) {
+            s.executed += w->executed.load(std::memory_order_relaxed);
+            s.stolen += w->stolen.load(std::memory_order_relaxed);
+        }
+        s.helped = helped.load(std::memory_order_relaxed);
+        s.executed += s.helped;
+        return s;
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+#include "MpscRing.h"
+
+// Log lines formatted by the calling thread into a fixed-size lock-free ring and written out by a drain thread,
+// so that a thread which logs never takes a lock, allocates or waits for the console.
+// Lines longer than MaxLineLength are truncated, and lines are dropped and counted while the ring is full.
+class LogRing final
+{
+public:
+    static constexpr size_t MaxLineLength{ 248 };
+    static constexpr size_t Capacity{ 1024 };
+
+    class Entry final {
+    public:
+        uint32_t    length;
+        char        text[MaxLineLength];
+    };
+
+    // Called on the drain thread for every line.
+    using Sink = std::function<void(const char* text, size_t length)>;
+
+private:
+    MpscRing<Entry, Capacity>   ring;
+    std::atomic<uint32_t>       pushed{};   // Wakes up the drain thread.
+    std::atomic<bool>           sleeping{ false };
+    std::atomic<uint64_t>       dropped{};
+    std::atomic<bool>           running{ false };
+    std::atomic<bool>           exitReq{ false };
+    std::thread                 drainThread;
+    Sink                        sink;
+
+    bool Drain()
+    {
+        bool drained{ false };
+        while (ring.TryPopWith([this](const Entry& e) { sink(e.text, e.length); }))
+            drained = true;
+        return drained;
+    }
+
+    void Notify()
+    {
+        pushed.fetch_add(1, std::memory_order_release);
+        pushed.notify_one();
+    }
+
+    // Only notifies when the drain thread went to sleep, the first producer to see it asleep does. The fence pairs
+    // with the one of the drain thread: either the drain thread sees the line, or the producer sees it asleep.
+    void Wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false, std::memory_order_relaxed))
+            Notify();
+    }
+
+public:
+    ~LogRing()
+    {
+        Stop();
+    }
+
+    bool Start(Sink inSink)
+    {
+        if (running.load())
+            return false;
+        sink = std::move(inSink);
+        exitReq.store(false);
+        drainThread = std::thread([this]() {
+            uint32_t seen{ pushed.load(std::memory_order_acquire) };
+            while (!exitReq.load(std::memory_order_acquire)) {
+                Drain();
+                sleeping.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!Drain())
+                    pushed.wait(seen, std::memory_order_acquire);
+                sleeping.store(false, std::memory_order_relaxed);
+                seen = pushed.load(std::memory_order_acquire);
+            }
+            Drain();
+            });
+        running.store(true);
+        return true;
+    }
+
+    // Writes out the remaining lines.
+    void Stop()
+    {
+        if (!running.exchange(false))
+            return;
+        exitReq.store(true, std::memory_order_release);
+        Notify();
+        drainThread.join();
+    }
+
+    bool IsRunning() const
+    {
+        return running.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Dropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    // Producers: any thread.
+    bool PushV(const char* format, va_list args)
+    {
+        const bool sts = ring.TryPushWith([format, &args](Entry& e) {
+            va_list a;
+            va_copy(a, args);
+            const int n{ vsnprintf(e.text, MaxLineLength, format, a) };
+            va_end(a);
+            e.length = (uint32_t)(n < 0 ? 0 : std::min<size_t>((size_t)n, MaxLineLength - 1));
+            });
+        if (!sts) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        Wake();
+        return true;
+    }
+
+    bool Push(const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        const bool sts{ PushV(format, args) };
+        va_end(args);
+        return sts;
+    }
+
+    // Push a line which the caller fills, e.g. with a converted wide string. fill returns the length.
+    template <typename Fill>
+    bool PushWith(Fill&& fill)
+    {
+        const bool sts = ring.TryPushWith([&fill](Entry& e) {
+            e.length = (uint32_t)std::min<size_t>(fill(e.text, MaxLineLength), MaxLineLength - 1);
+            e.text[e.length] = '\0';
+            });
+        if (!sts) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        Wake();
+        return true;
+    }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <type_traits>
+
+// Bounded lock-free queue with any number of producers and a single consumer.
+// Each cell carries a sequence number which tells whether it is free for the producer of the current lap or
+// holds data for the consumer, so producers only contend on the tail index. TryPush fails instead of blocking when
+// the ring is full, so a producer on a latency critical thread never waits for the consumer.
+template <typename T, size_t Capacity>
+class MpscRing final
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+    static_assert(std::is_trivially_copyable_v<T>, "Elements are copied in and out of the cells.");
+
+    class alignas(64) Cell final {
+    public:
+        std::atomic<size_t> seq;
+        T                   data;
+    };
+    std::array<Cell, Capacity>  cells;
+
+    alignas(64) std::atomic<size_t> tail{};     // Producers.
+    alignas(64) size_t              head{};     // Consumer.
+
+public:
+    MpscRing()
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // Producers: any thread.
+    bool TryPush(const T& v)
+    {
+        return TryPushWith([&v](T& data) { data = v; });
+    }
+
+    // Fill the claimed cell in place, for large elements which would otherwise be built and copied.
+    template <typename Fill>
+    bool TryPushWith(Fill&& fill)
+    {
+        size_t pos{ tail.load(std::memory_order_relaxed) };
+        for (;;) {
+            Cell& c{ cells[pos & (Capacity - 1)] };
+            const size_t seq{ c.seq.load(std::memory_order_acquire) };
+            const intptr_t diff{ (intptr_t)seq - (intptr_t)pos };
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    fill(c.data);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                // Full. The consumer hasn't freed the cell of the previous lap yet.
+                return false;
+            }
+            else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer: a single thread.
+    bool TryPop(T& v)
+    {
+        return TryPopWith([&v](const T& data) { v = data; });
+    }
+
+    // Consume the cell in place before it is handed back to the producers.
+    template <typename Consume>
+    bool TryPopWith(Consume&& consume)
+    {
+        Cell& c{ cells[head & (Capacity - 1)] };
+        if (c.seq.load(std::memory_order_acquire) != head + 1)
+            return false;
+        consume(c.data);
+        c.seq.store(head + Capacity, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+    // Approximate, for statistics.
+    size_t Size() const
+    {
+        return tail.load(std::memory_order_relaxed) - head;
+    }
+};
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <list>
+#include <span>
+#include <tuple>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// On-disk store of compiled pipeline blobs, so that a launch doesn't rebuild the pipelines a previous one compiled.
+// Blobs are keyed by a hash of the device and driver identity and a hash of everything the pipeline is built from.
+// Whatever the store can't vouch for is a miss, and the caller compiles and inserts again.
+//
+// Two files, little endian:
+//   <base>.idx  Header, then Entry records appended in insertion order. A later entry of a key replaces an earlier one.
+//   <base>.bin  Header, then the blobs.
+// A file with a wrong magic or version is recreated. Entries pointing outside the blob file or left incomplete by a
+// crash are dropped when the store is opened, and a blob whose checksum doesn't match is dropped when it is looked up.
+// The blob is written before its entry, so a crash while inserting leaves at most some unreferenced blob bytes.
+namespace PipelineCacheFormat {
+    constexpr char      IndexMagic[8]{ 'P', 'B', 'T', 'P', 'S', 'O', 'I', '\0' };
+    constexpr char      BlobMagic[8]{ 'P', 'B', 'T', 'P', 'S', 'O', 'B', '\0' };
+    constexpr uint32_t  Version{ 1 };
+
+    class Header final {
+    public:
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    reserved;
+    };
+
+    class Entry final {
+    public:
+        uint64_t    deviceKey;
+        uint64_t    pipelineKey;
+        uint64_t    offset;     // In the blob file.
+        uint64_t    size;
+        uint64_t    checksum;   // Fnv1a of the blob.
+    };
+
+    static_assert(sizeof(Header) == 16 && sizeof(Entry) == 40, "The records are written as they are.");
+
+    constexpr uint64_t  FnvOffset{ 0xcbf29ce484222325ull };
+
+    // 64-bit FNV-1a. Pass the previous result as seed to hash several pieces as one.
+    inline uint64_t Fnv1a(const void* data, size_t size, uint64_t seed = FnvOffset)
+    {
+        const uint8_t* p{ (const uint8_t*)data };
+        uint64_t h{ seed };
+        for (size_t i = 0; i < size; ++i) {
+            h ^= p[i];
+            h *= 0x100000001b3ull;
+        }
+        return h;
+    }
+}
+
+// Read-only view of a whole file.
+class MappedFile final
+{
+    const uint8_t*  data{};
+    uint64_t        size{};
+#ifdef _WIN32
+    HANDLE          file{ INVALID_HANDLE_VALUE };
+    HANDLE          mapping{};
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    // An empty file opens with a null view.
+    bool Open(const std::filesystem::path& path)
+    {
+        Close();
+#ifdef _WIN32
+        file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize{};
+        if (!GetFileSizeEx(file, &fileSize)) {
+            Close();
+            return false;
+        }
+        size = (uint64_t)fileSize.QuadPart;
+        if (size == 0)
+            return true;
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            Close();
+            return false;
+        }
+        data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data == nullptr) {
+            Close();
+            return false;
+        }
+#else
+        const int fd{ open(path.c_str(), O_RDONLY) };
+        if (fd < 0)
+            return false;
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        size = (uint64_t)st.st_size;
+        if (size > 0) {
+            void* p{ mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) };
+            if (p == MAP_FAILED) {
+                close(fd);
+                size = 0;
+                return false;
+            }
+            data = (const uint8_t*)p;
+        }
+        close(fd);
+#endif
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (data != nullptr)
+            UnmapViewOfFile(data);
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data != nullptr)
+            munmap((void*)data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const uint8_t* Data() const
+    {
+        return data;
+    }
+
+    uint64_t Size() const
+    {
+        return size;
+    }
+};
+
+class PipelineCacheStore final
+{
+public:
+    class Key final {
+    public:
+        uint64_t    device;     // Adapter and driver version.
+        uint64_t    pipeline;   // Shaders, root signature and fixed function state.
+
+        bool operator==(const Key&) const = default;
+    };
+
+    class Stats final {
+    public:
+        uint64_t    entries;
+        uint64_t    hits;
+        uint64_t    misses;
+        uint64_t    inserts;
+        uint64_t    dropped;    // Entries discarded as corrupted.
+    };
+
+private:
+    class KeyHash final {
+    public:
+        size_t operator()(const Key& k) const
+        {
+            return (size_t)(k.device ^ (k.pipeline * 0x9e3779b97f4a7c15ull));
+        }
+    };
+
+    mutable std::mutex          mtx;
+    std::filesystem::path       indexPath;
+    std::filesystem::path       blobPath;
+    MappedFile                  indexFile;
+    MappedFile                  blobFile;
+    FILE*                       indexFp{};
+    FILE*                       blobFp{};
+    uint64_t                    blobFileSize{};
+    // Blob address, size and checksum. Blobs read at Open point into the mapped blob file, inserted ones into inserted.
+    std::unordered_map<Key, std::tuple<const uint8_t*, uint64_t, uint64_t>, KeyHash>    entries;
+    std::list<std::vector<uint8_t>> inserted;
+    Stats                       stats{};
+
+    static FILE* OpenFile(const std::filesystem::path& path, const char* mode)
+    {
+        FILE* fp{};
+#ifdef _MSC_VER
+        if (_wfopen_s(&fp, path.c_str(), mode[0] == 'w' ? L"wb" : L"ab") != 0)
+            fp = nullptr;
+#else
+        fp = fopen(path.c_str(), mode);
+#endif
+        return fp;
+    }
+
+    static bool WriteFile(const std::filesystem::path& path, const void* data, size_t size)
+    {
+        FILE* fp{ OpenFile(path, "wb") };
+        if (fp == nullptr)
+            return false;
+        const bool sts{ fwrite(data, 1, size, fp) == size };
+        return fclose(fp) == 0 && sts;
+    }
+
+    static bool HasHeader(const MappedFile& f, const char (&magic)[8])
+    {
+        if (f.Size() < sizeof(PipelineCacheFormat::Header))
+            return false;
+        PipelineCacheFormat::Header h;
+        memcpy(&h, f.Data(), sizeof(h));
+        return memcmp(h.magic, magic, sizeof(h.magic)) == 0 && h.version == PipelineCacheFormat::Version;
+    }
+
+    static PipelineCacheFormat::Header MakeHeader(const char (&magic)[8])
+    {
+        PipelineCacheFormat::Header h{};
+        memcpy(h.magic, magic, sizeof(h.magic));
+        h.version = PipelineCacheFormat::Version;
+        return h;
+    }
+
+    // Recreates both files empty.
+    bool Recreate()
+    {
+        indexFile.Close();
+        blobFile.Close();
+        entries.clear();
+        const auto ih{ MakeHeader(PipelineCacheFormat::IndexMagic) };
+        const auto bh{ MakeHeader(PipelineCacheFormat::BlobMagic) };
+        return WriteFile(blobPath, &bh, sizeof(bh)) && WriteFile(indexPath, &ih, sizeof(ih))
+            && blobFile.Open(blobPath) && indexFile.Open(indexPath);
+    }
+
+public:
+    PipelineCacheStore() = default;
+    PipelineCacheStore(const PipelineCacheStore&) = delete;
+    PipelineCacheStore& operator=(const PipelineCacheStore&) = delete;
+
+    ~PipelineCacheStore()
+    {
+        Close();
+    }
+
+    // Opens or creates <basePath>.idx and <basePath>.bin.
+    bool Open(const std::filesystem::path& basePath)
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        if (indexFp != nullptr)
+            return false;
+        indexPath = basePath;
+        indexPath += ".idx";
+        blobPath = basePath;
+        blobPath += ".bin";
+        stats = {};
+
+        const bool indexOk{ indexFile.Open(indexPath) && HasHeader(indexFile, PipelineCacheFormat::IndexMagic) };
+        const bool blobOk{ blobFile.Open(blobPath) && HasHeader(blobFile, PipelineCacheFormat::BlobMagic) };
+        if (!indexOk || !blobOk) {
+            if (!Recreate())
+                return false;
+        }
+
+        // Collect the entries which point inside the blob file.
+        constexpr uint64_t headerSize{ sizeof(PipelineCacheFormat::Header) };
+        constexpr uint64_t entrySize{ sizeof(PipelineCacheFormat::Entry) };
+        const uint64_t numEntries{ (indexFile.Size() - headerSize) / entrySize };
+        std::vector<PipelineCacheFormat::Entry> valid;
+        valid.reserve(numEntries);
+        for (uint64_t i = 0; i < numEntries; ++i) {
+            PipelineCacheFormat::Entry e;
+            memcpy(&e, indexFile.Data() + headerSize + i * entrySize, entrySize);
+            if (e.offset < headerSize || e.size == 0 || e.offset > blobFile.Size() || e.size > blobFile.Size() - e.offset) {
+                ++stats.dropped;
+                continue;
+            }
+            valid.push_back(e);
+        }
+        const bool partialEntry{ headerSize + numEntries * entrySize != indexFile.Size() };
+        stats.dropped += partialEntry;
+
+        // Rewrite the index with the valid entries only, so that appended entries stay aligned.
+        if (valid.size() != numEntries || partialEntry) {
+            std::vector<uint8_t> rewritten(headerSize + valid.size() * entrySize);
+            const auto ih{ MakeHeader(PipelineCacheFormat::IndexMagic) };
+            memcpy(rewritten.data(), &ih, headerSize);
+            if (!valid.empty())
+                memcpy(rewritten.data() + headerSize, valid.data(), valid.size() * entrySize);
+            indexFile.Close();
+            if (!WriteFile(indexPath, rewritten.data(), rewritten.size()) || !indexFile.Open(indexPath))
+                return false;
+        }
+        for (auto& e : valid)
+            entries[{ e.deviceKey, e.pipelineKey }] = { blobFile.Data() + e.offset, e.size, e.checksum };
+        blobFileSize = blobFile.Size();
+
+        indexFp = OpenFile(indexPath, "ab");
+        blobFp = OpenFile(blobPath, "ab");
+        if (indexFp == nullptr || blobFp == nullptr) {
+            if (indexFp != nullptr)
+                fclose(indexFp);
+            if (blobFp != nullptr)
+                fclose(blobFp);
+            indexFp = blobFp = nullptr;
+            entries.clear();
+            indexFile.Close();
+            blobFile.Close();
+            return false;
+        }
+        return true;
+    }
+
+    // Invalidates the blobs returned by Find.
+    void Close()
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        if (indexFp != nullptr)
+            fclose(indexFp);
+        if (blobFp != nullptr)
+            fclose(blobFp);
+        indexFp = blobFp = nullptr;
+        entries.clear();
+        inserted.clear();
+        indexFile.Close();
+        blobFile.Close();
+    }
+
+    bool IsOpen() const
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        return indexFp != nullptr;
+    }
+
+    // Returns the blob, valid until Close, or an empty span on a miss.
+    std::span<const uint8_t> Find(const Key& key)
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        auto it{ entries.find(key) };
+        if (it == entries.end()) {
+            ++stats.misses;
+            return {};
+        }
+        auto [data, size, checksum] = it->second;
+        if (PipelineCacheFormat::Fnv1a(data, size) != checksum) {
+            entries.erase(it);
+            ++stats.dropped;
+            ++stats.misses;
+            return {};
+        }
+        ++stats.hits;
+        return { data, (size_t)size };
+    }
+
+    // Appends the blob, replacing a previous one of the key.
+    bool Insert(const Key& key, const void* data, size_t size)
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        if (indexFp == nullptr || size == 0)
+            return false;
+
+        const PipelineCacheFormat::Entry e{ key.device, key.pipeline, blobFileSize, size, PipelineCacheFormat::Fnv1a(data, size) };
+        if (fwrite(data, 1, size, blobFp) != size || fflush(blobFp) != 0)
+            return false;
+        blobFileSize += size;
+        if (fwrite(&e, sizeof(e), 1, indexFp) != 1 || fflush(indexFp) != 0)
+            return false;
+
+        inserted.emplace_back((const uint8_t*)data, (const uint8_t*)data + size);
+        entries[key] = { inserted.back().data(), size, e.checksum };
+        ++stats.inserts;
+        return true;
+    }
+
+    Stats GetStats() const
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        Stats s{ stats };
+        s.entries = entries.size();
+        return s;
+    }
+};
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <tuple>
+#include <algorithm>
+#include <functional>
+
+// Presentation backend driven by D3DContext_Base.
+// The D3D12/DXGI implementation lives in PresentBarrierTest.cpp, the simulated one below runs headless
+// so that the frame pacing logic can be exercised without a display or a GPU.
+class PresentBackend
+{
+public:
+    enum class Status {
+        ok,
+        occluded,
+        timeout,
+        error
+    };
+    static constexpr uint32_t INFINITE_WAIT{ 0xFFFFFFFFu };
+    static constexpr uint32_t MAX_FRAME_LATENCY{ 16 };     // DXGI_MAX_SWAP_CHAIN_BUFFERS
+
+    virtual ~PresentBackend() = default;
+
+    virtual uint32_t BackBufferCount() const = 0;
+    virtual uint32_t CurrentBackBufferIndex() = 0;
+
+    // Present with DXGI semantics. syncInterval 0 means no vsync.
+    virtual Status   Present(uint32_t syncInterval) = 0;
+    // Equivalent of Present(0, DXGI_PRESENT_TEST).
+    virtual Status   TestOcclusion() = 0;
+
+    virtual bool     Signal(uint64_t value) = 0;
+    virtual uint64_t CompletedValue() = 0;
+    virtual Status   WaitForValue(uint64_t value, uint32_t timeoutMs) = 0;
+
+    // Number of presents which can be queued before Present blocks, 1..MAX_FRAME_LATENCY.
+    virtual bool     SetMaximumFrameLatency(uint32_t maxLatency) = 0;
+    // Wait on the frame latency waitable, which is signaled while fewer presents than the maximum frame latency are queued.
+    virtual Status   WaitForFrameLatency(uint32_t timeoutMs) = 0;
+
+    // The latest flip the frame statistics report: the vblank it happened on and the present count of the frame.
+    // Fails before the first flip and while the swap chain doesn't own the display.
+    virtual bool     LastFlip(uint64_t& ns, uint32_t& presentCount) = 0;
+    // Present count of the latest Present call.
+    virtual uint32_t LastPresentCount() = 0;
+};
+
+// Virtual vblank clock of a simulated display. All times are nanoseconds from the simulation epoch.
+class SimulatedDisplayClock final
+{
+public:
+    uint64_t    periodNs{ 16'666'667 };
+    uint64_t    phaseNs{};
+
+public:
+    static SimulatedDisplayClock FromRefreshRate(uint32_t numerator, uint32_t denominator, uint64_t phaseNs = 0)
+    {
+        if (numerator == 0 || denominator == 0)
+            return { 16'666'667, phaseNs };
+        return { (uint64_t)((1'000'000'000.0 * denominator) / numerator + 0.5), phaseNs };
+    }
+
+    // Index of the last vblank at or before t.
+    uint64_t VblankIndex(uint64_t t) const
+    {
+        if (t < phaseNs)
+            return 0;
+        return (t - phaseNs) / periodNs;
+    }
+
+    // The first vblank strictly after t.
+    uint64_t NextVblank(uint64_t t) const
+    {
+        if (t < phaseNs)
+            return phaseNs;
+        return phaseNs + (VblankIndex(t) + 1) * periodNs;
+    }
+};
+
+// Simulated swap chain, fence and present queue on a virtual timeline.
+// Blocking calls advance the virtual time instead of sleeping, so thousands of frames run per real second.
+class SimulatedPresentBackend final : public PresentBackend
+{
+public:
+    class Config final {
+    public:
+        SimulatedDisplayClock   display;
+        uint32_t    backBufferCount{ 2 };
+        uint32_t    maxFrameLatency{ 2 };
+        uint64_t    presentLatencyNs{ 200'000 };    // CPU time spent in the Present call.
+        uint64_t    gpuFrameNs{ 2'000'000 };        // GPU time of a frame.
+    };
+
+    class PresentRecord final {
+    public:
+        uint64_t    presentNs;      // Present call.
+        uint64_t    returnNs;       // Present returned.
+        uint64_t    flipNs;         // Frame got scanned out.
+    };
+
+    std::function<void(const PresentRecord&)>   onPresent;
+    bool    occluded{ false };
+
+private:
+    Config      cfg;
+    uint64_t    nowNs{};
+    uint32_t    backBufferIdx{};
+
+    std::deque<std::tuple<uint64_t, uint64_t>>  pendingSignals;     // value, completion time
+    uint64_t                                    completedValue{};
+    uint64_t                                    lastGpuDoneNs{};
+
+    std::deque<uint64_t>    flipQueue;
+    uint64_t                lastFlipNs{};
+
+    uint32_t                presentCount{};
+    std::deque<std::tuple<uint64_t, uint32_t>>  unreportedFlips;    // flip time, present count
+    std::tuple<uint64_t, uint32_t>              reportedFlip{};     // The latest flip by now, present count 0 before the first.
+
+    uint64_t UpdateCompletedValue()
+    {
+        while (!pendingSignals.empty() && std::get<1>(pendingSignals.front()) <= nowNs) {
+            completedValue = std::get<0>(pendingSignals.front());
+            pendingSignals.pop_front();
+        }
+        return completedValue;
+    }
+
+    void RetireFlips()
+    {
+        while (!flipQueue.empty() && flipQueue.front() <= nowNs)
+            flipQueue.pop_front();
+    }
+
+public:
+    explicit SimulatedPresentBackend(const Config& inCfg, uint64_t startNs = 0)
+        : cfg(inCfg), nowNs(startNs), lastGpuDoneNs(startNs), lastFlipNs(startNs)
+    {
+        cfg.backBufferCount = std::max(cfg.backBufferCount, 1u);
+        cfg.maxFrameLatency = std::clamp(cfg.maxFrameLatency, 1u, MAX_FRAME_LATENCY);
+    }
+
+    const Config& GetConfig() const
+    {
+        return cfg;
+    }
+
+    uint64_t Now() const
+    {
+        return nowNs;
+    }
+
+    // Consume CPU time on the calling thread.
+    void Advance(uint64_t ns)
+    {
+        nowNs += ns;
+    }
+
+    void AdvanceTo(uint64_t t)
+    {
+        nowNs = std::max(nowNs, t);
+    }
+
+    // The GPU hangs for ns from now on, the frames submitted meanwhile complete after it.
+    void StallGpu(uint64_t ns)
+    {
+        lastGpuDoneNs = std::max(nowNs, lastGpuDoneNs) + ns;
+    }
+
+    virtual uint32_t BackBufferCount() const override
+    {
+        return cfg.backBufferCount;
+    }
+
+    // Like IDXGISwapChain::ResizeBuffers with a new buffer count, which fails while the GPU may still use a back
+    // buffer. The frames queued for scan out still flip.
+    bool ResizeBuffers(uint32_t count)
+    {
+        UpdateCompletedValue();
+        if (count < 1 || !pendingSignals.empty())
+            return false;
+        cfg.backBufferCount = count;
+        backBufferIdx = 0;
+        return true;
+    }
+
+    virtual uint32_t CurrentBackBufferIndex() override
+    {
+        return backBufferIdx;
+    }
+
+    virtual Status Present(uint32_t syncInterval) override
+    {
+        const uint64_t presentNs{ nowNs };
+
+        // DXGI blocks in Present while the maximum frame latency worth of presents is queued.
+        RetireFlips();
+        while (flipQueue.size() >= cfg.maxFrameLatency) {
+            nowNs = std::max(nowNs, flipQueue.front());
+            flipQueue.pop_front();
+        }
+
+        lastGpuDoneNs = std::max(nowNs, lastGpuDoneNs) + cfg.gpuFrameNs;
+
+        uint64_t flipNs{ lastGpuDoneNs };
+        if (syncInterval > 0) {
+            // Each frame stays on screen for at least syncInterval refreshes.
+            flipNs = cfg.display.NextVblank(std::max(lastGpuDoneNs, lastFlipNs + (syncInterval - 1) * cfg.display.periodNs));
+        }
+        flipQueue.push_back(flipNs);
+        lastFlipNs = flipNs;
+        unreportedFlips.push_back({ flipNs, ++presentCount });
+
+        nowNs += cfg.presentLatencyNs;
+        backBufferIdx = (backBufferIdx + 1) % cfg.backBufferCount;
+
+        if (onPresent)
+            onPresent({ presentNs, nowNs, flipNs });
+
+        return occluded ? Status::occluded : Status::ok;
+    }
+
+    virtual Status TestOcclusion() override
+    {
+        return occluded ? Status::occluded : Status::ok;
+    }
+
+    virtual bool Signal(uint64_t value) override
+    {
+        if (value <= completedValue || (!pendingSignals.empty() && value <= std::get<0>(pendingSignals.back())))
+            return false;
+        pendingSignals.push_back({ value, std::max(nowNs, lastGpuDoneNs) });
+        return true;
+    }
+
+    virtual uint64_t CompletedValue() override
+    {
+        return UpdateCompletedValue();
+    }
+
+    // When the GPU reaches value, 0 if it already has, UINT64_MAX if nothing is going to signal it. Models a wait on
+    // another thread than the one driving the virtual time.
+    uint64_t CompletionTimeNs(uint64_t value)
+    {
+        if (UpdateCompletedValue() >= value)
+            return 0;
+        auto itr = std::find_if(pendingSignals.begin(), pendingSignals.end(), [value](auto& s) { return std::get<0>(s) >= value; });
+        return itr == pendingSignals.end() ? UINT64_MAX : std::get<1>(*itr);
+    }
+
+    virtual Status WaitForValue(uint64_t value, uint32_t timeoutMs) override
+    {
+        if (UpdateCompletedValue() >= value)
+            return Status::ok;
+
+        auto itr = std::find_if(pendingSignals.begin(), pendingSignals.end(), [value](auto& s) { return std::get<0>(s) >= value; });
+        const bool infinite{ timeoutMs == INFINITE_WAIT };
+        const uint64_t timeoutNs{ (uint64_t)timeoutMs * 1'000'000 };
+
+        if (itr == pendingSignals.end()) {
+            // Never going to be signaled. A real fence would hang here.
+            if (infinite)
+                return Status::error;
+            nowNs += timeoutNs;
+            return Status::timeout;
+        }
+        if (!infinite && std::get<1>(*itr) > nowNs + timeoutNs) {
+            nowNs += timeoutNs;
+            return Status::timeout;
+        }
+        nowNs = std::max(nowNs, std::get<1>(*itr));
+        UpdateCompletedValue();
+        return Status::ok;
+    }
+
+    virtual bool SetMaximumFrameLatency(uint32_t maxLatency) override
+    {
+        if (maxLatency < 1 || maxLatency > MAX_FRAME_LATENCY)
+            return false;
+        cfg.maxFrameLatency = maxLatency;
+        return true;
+    }
+
+    // The waitable gets signaled when a queued frame is scanned out.
+    virtual Status WaitForFrameLatency(uint32_t timeoutMs) override
+    {
+        RetireFlips();
+        if (flipQueue.size() < cfg.maxFrameLatency)
+            return Status::ok;
+
+        const uint64_t readyNs{ flipQueue[flipQueue.size() - cfg.maxFrameLatency] };
+        if (timeoutMs != INFINITE_WAIT && readyNs > nowNs + (uint64_t)timeoutMs * 1'000'000) {
+            nowNs += (uint64_t)timeoutMs * 1'000'000;
+            return Status::timeout;
+        }
+        nowNs = std::max(nowNs, readyNs);
+        RetireFlips();
+        return Status::ok;
+    }
+
+    virtual bool LastFlip(uint64_t& ns, uint32_t& count) override
+    {
+        for (; !unreportedFlips.empty() && std::get<0>(unreportedFlips.front()) <= nowNs; unreportedFlips.pop_front())
+            reportedFlip = unreportedFlips.front();
+        std::tie(ns, count) = reportedFlip;
+        return count > 0;
+    }
+
+    virtual uint32_t LastPresentCount() override
+    {
+        return presentCount;
+    }
+};
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "Clock.h"
+
+// Values mirror NV_PRESENT_BARRIER_SYNC_MODE.
+enum class PresentBarrierSyncMode : uint32_t
+{
+    notJoined = 0,
+    syncClient = 1,
+    syncSystem = 2,
+    syncCluster = 3,
+};
+
+// Same layout as NV_PRESENT_BARRIER_FRAME_STATISTICS.
+class PresentBarrierFrameStatistics final
+{
+public:
+    uint32_t                dwVersion{};
+    PresentBarrierSyncMode  SyncMode{ PresentBarrierSyncMode::notJoined };
+    uint32_t                PresentCount{};
+    uint32_t                PresentInSyncCount{};
+    uint32_t                FlipInSyncCount{};
+    uint32_t                RefreshCount{};
+};
+
+// In-process software emulation of NvAPI's PresentBarrier.
+// Follows the client handle lifecycle of NvAPI: create, register resources, join, leave and destroy.
+// Joined clients rendezvous in Present() on a lock-free barrier, so all present threads are released together. The
+// clients which arrive early spin shortly, then sleep until the release.
+class PresentBarrierEmulator final
+{
+public:
+    using ClientHandle = uint32_t;
+    static constexpr ClientHandle   InvalidHandle{ 0xFFFFFFFFu };
+    static constexpr uint32_t       MaxClients{ 64 };
+
+    enum class Result {
+        ok,
+        invalidHandle,
+        invalidState,
+        noClientSlot,
+        timeout,
+    };
+
+private:
+    enum class ClientState : uint32_t {
+        free,
+        created,
+        registered,
+        joined,
+    };
+
+    // Each client is only touched by its own present thread except for statistics reads.
+    class alignas(64) Client final {
+    public:
+        std::atomic<ClientState>    state{ ClientState::free };
+        std::atomic<uint32_t>       syncMode{ (uint32_t)PresentBarrierSyncMode::notJoined };
+        std::atomic<uint32_t>       presentCount{};
+        std::atomic<uint32_t>       presentInSyncCount{};
+        std::atomic<uint32_t>       flipInSyncCount{};
+        std::atomic<uint64_t>       joinedNs{};
+        uint64_t                    refreshPeriodNs{};
+        uint32_t                    numResources{};
+    };
+    std::array<Client, MaxClients>  clients;
+
+    // Barrier word. generation[63:32] arrived[31:16] members[15:0]
+    alignas(64) std::atomic<uint64_t>   barrier{};
+    // Time from the first arrival to the release, indexed by the parity of the released generation.
+    // A generation can't be released twice before every member has read it, so two slots are enough.
+    alignas(64) std::array<std::atomic<uint64_t>, 2>    releaseSpreadNs{};
+    std::atomic<uint64_t>               firstArrivalNs{};
+
+    // The arrived clients which went to sleep. The release only takes the mutex to wake them when there are some.
+    alignas(64) std::atomic<uint32_t>   sleepers{};
+    std::mutex                          releaseMutex;
+    std::condition_variable             releaseCv;
+
+    static constexpr uint64_t Pack(uint64_t gen, uint64_t arrived, uint64_t members)
+    {
+        return (gen << 32) | ((arrived & 0xFFFF) << 16) | (members & 0xFFFF);
+    }
+    static constexpr uint32_t Generation(uint64_t b) { return (uint32_t)(b >> 32); }
+    static constexpr uint32_t Arrived(uint64_t b) { return (uint32_t)((b >> 16) & 0xFFFF); }
+    static constexpr uint32_t Members(uint64_t b) { return (uint32_t)(b & 0xFFFF); }
+
+    static uint64_t NowNs()
+    {
+        return Clock::Get().NowNs();
+    }
+
+    Client* GetClient(ClientHandle h)
+    {
+        if (h >= MaxClients || clients[h].state.load(std::memory_order_acquire) == ClientState::free)
+            return nullptr;
+        return &clients[h];
+    }
+
+    // Release the current generation. b must be the value observed in the barrier word.
+    bool TryRelease(uint64_t b, uint32_t members)
+    {
+        uint64_t released{ Pack(Generation(b) + 1, 0, members) };
+        // Sequentially consistent with the sleepers count, see WaitForRelease.
+        if (!barrier.compare_exchange_strong(b, released))
+            return false;
+        releaseSpreadNs[Generation(b) & 1].store(NowNs() - firstArrivalNs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        if (sleepers.load() > 0) {
+            // A sleeper between its check of the generation and its wait holds the mutex.
+            { std::lock_guard<std::mutex> l{ releaseMutex }; }
+            releaseCv.notify_all();
+        }
+        return true;
+    }
+
+    // Sleep until generation gen gets released or the deadline passes. Either the release sees the sleeper counted, or
+    // the sleeper sees the release.
+    void WaitForRelease(uint32_t gen, uint64_t deadlineNs)
+    {
+        std::unique_lock<std::mutex> l{ releaseMutex };
+        sleepers.fetch_add(1);
+        Clock::Get().WaitUntilNs(releaseCv, l, deadlineNs, [this, gen]() { return Generation(barrier.load()) != gen; });
+        sleepers.fetch_sub(1);
+    }
+
+public:
+    ClientHandle CreateClient(uint64_t refreshPeriodNs)
+    {
+        for (ClientHandle h = 0; h < MaxClients; ++h) {
+            auto expected{ ClientState::free };
+            auto& c{ clients[h] };
+            if (c.state.compare_exchange_strong(expected, ClientState::created, std::memory_order_acq_rel)) {
+                c.syncMode.store((uint32_t)PresentBarrierSyncMode::notJoined);
+                c.presentCount.store(0);
+                c.presentInSyncCount.store(0);
+                c.flipInSyncCount.store(0);
+                c.joinedNs.store(0);
+                c.refreshPeriodNs = refreshPeriodNs;
+                c.numResources = 0;
+                return h;
+            }
+        }
+        return InvalidHandle;
+    }
+
+    Result RegisterResources(ClientHandle h, uint32_t numResources)
+    {
+        Client* c{ GetClient(h) };
+        if (c == nullptr)
+            return Result::invalidHandle;
+        if (c->state.load() == ClientState::joined || numResources == 0)
+            return Result::invalidState;
+
+        c->numResources = numResources;
+        c->state.store(ClientState::registered, std::memory_order_release);
+        return Result::ok;
+    }
+
+    Result Join(ClientHandle h)
+    {
+        Client* c{ GetClient(h) };
+        if (c == nullptr)
+            return Result::invalidHandle;
+        if (c->state.load() != ClientState::registered)
+            return Result::invalidState;
+
+        c->state.store(ClientState::joined, std::memory_order_release);
+        c->joinedNs.store(NowNs());
+        c->syncMode.store((uint32_t)PresentBarrierSyncMode::syncClient);
+        barrier.fetch_add(1, std::memory_order_acq_rel);
+        return Result::ok;
+    }
+
+    Result Leave(ClientHandle h)
+    {
+        Client* c{ GetClient(h) };
+        if (c == nullptr)
+            return Result::invalidHandle;
+        if (c->state.load() != ClientState::joined)
+            return Result::invalidState;
+
+        c->state.store(ClientState::registered, std::memory_order_release);
+        c->syncMode.store((uint32_t)PresentBarrierSyncMode::notJoined);
+
+        // Leaving may complete the generation the remaining members are waiting for.
+        uint64_t b{ barrier.load(std::memory_order_acquire) };
+        for (;;) {
+            uint32_t members{ Members(b) - 1 };
+            if (members > 0 && Arrived(b) >= members) {
+                if (TryRelease(b, members))
+                    break;
+                b = barrier.load(std::memory_order_acquire);
+                continue;
+            }
+            if (barrier.compare_exchange_weak(b, Pack(Generation(b), Arrived(b), members), std::memory_order_acq_rel))
+                break;
+        }
+        return Result::ok;
+    }
+
+    Result DestroyClient(ClientHandle h)
+    {
+        Client* c{ GetClient(h) };
+        if (c == nullptr)
+            return Result::invalidHandle;
+        if (c->state.load() == ClientState::joined)
+            Leave(h);
+        c->state.store(ClientState::free, std::memory_order_release);
+        return Result::ok;
+    }
+
+    // Called by the present thread right before presenting.
+    // Blocks until every joined client has arrived, or times out and leaves the client out of sync for this frame.
+    Result Present(ClientHandle h, uint32_t timeoutMs)
+    {
+        Client* c{ GetClient(h) };
+        if (c == nullptr)
+            return Result::invalidHandle;
+
+        c->presentCount.fetch_add(1, std::memory_order_relaxed);
+        if (c->state.load(std::memory_order_acquire) != ClientState::joined)
+            return Result::ok;
+
+        // Arrive.
+        uint64_t b{ barrier.load(std::memory_order_acquire) };
+        for (;;) {
+            if (Arrived(b) + 1 >= Members(b)) {
+                if (Arrived(b) == 0)
+                    firstArrivalNs.store(NowNs(), std::memory_order_relaxed);
+                if (TryRelease(b, Members(b)))
+                    break;
+                b = barrier.load(std::memory_order_acquire);
+                continue;
+            }
+            if (Arrived(b) == 0)
+                firstArrivalNs.store(NowNs(), std::memory_order_relaxed);
+            if (barrier.compare_exchange_weak(b, Pack(Generation(b), Arrived(b) + 1, Members(b)), std::memory_order_acq_rel)) {
+                // Wait for the release. Spin shortly, then sleep so that the present threads don't take the cores
+                // from the clients still recording.
+                const uint32_t gen{ Generation(b) };
+                const uint64_t deadlineNs{ NowNs() + (uint64_t)timeoutMs * 1'000'000 };
+                for (uint32_t i = 0;; ++i) {
+                    b = barrier.load(std::memory_order_acquire);
+                    if (Generation(b) != gen)
+                        break;
+                    if (i < 64)
+                        continue;
+                    if (NowNs() >= deadlineNs) {
+                        // Withdraw the arrival unless the generation got released in the meantime.
+                        if (barrier.compare_exchange_strong(b, Pack(gen, Arrived(b) - 1, Members(b)), std::memory_order_acq_rel)) {
+                            c->syncMode.store((uint32_t)PresentBarrierSyncMode::syncClient, std::memory_order_relaxed);
+                            return Result::timeout;
+                        }
+                        continue;
+                    }
+                    WaitForRelease(gen, deadlineNs);
+                }
+                b = Pack(gen, 0, Members(b));
+                break;
+            }
+        }
+
+        // Released together with the other members.
+        const bool inSync{ Members(b) > 1 };
+        c->syncMode.store((uint32_t)(inSync ? PresentBarrierSyncMode::syncSystem : PresentBarrierSyncMode::syncClient), std::memory_order_relaxed);
+        if (inSync) {
+            c->presentInSyncCount.fetch_add(1, std::memory_order_relaxed);
+            if (releaseSpreadNs[Generation(b) & 1].load(std::memory_order_relaxed) <= c->refreshPeriodNs)
+                c->flipInSyncCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        return Result::ok;
+    }
+
+    Result QueryFrameStatistics(ClientHandle h, PresentBarrierFrameStatistics* stats)
+    {
+        Client* c{ GetClient(h) };
+        if (c == nullptr || stats == nullptr)
+            return Result::invalidHandle;
+
+        stats->SyncMode = (PresentBarrierSyncMode)c->syncMode.load(std::memory_order_relaxed);
+        stats->PresentCount = c->presentCount.load(std::memory_order_relaxed);
+        stats->PresentInSyncCount = c->presentInSyncCount.load(std::memory_order_relaxed);
+        stats->FlipInSyncCount = c->flipInSyncCount.load(std::memory_order_relaxed);
+        stats->RefreshCount = 0;
+        if (c->state.load() == ClientState::joined && c->refreshPeriodNs > 0)
+            stats->RefreshCount = (uint32_t)((NowNs() - c->joinedNs.load()) / c->refreshPeriodNs);
+        return Result::ok;
+    }
+
+    uint32_t NumJoinedClients() const
+    {
+        return Members(barrier.load(std::memory_order_acquire));
+    }
+};
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "PresentBarrierEmulator.h"
+
+// Turns successive PresentBarrier frame statistics snapshots into rates, totals and a bounded SyncMode history.
+// The counters are 32 bit and compared with modular arithmetic, so they may wrap. A counter going backwards by more
+// than half its range is taken as a reset of the client and starts a new baseline.
+class PresentBarrierStatsTracker final
+{
+public:
+    static constexpr uint32_t HistorySize{ 256 };
+
+    class Transition final {
+    public:
+        uint64_t                timeNs{};           // From the first snapshot.
+        PresentBarrierSyncMode  from{};
+        PresentBarrierSyncMode  to{};
+        uint64_t                fromDurationNs{};   // How long "from" lasted.
+    };
+
+    class Rates final {
+    public:
+        double      presentsPerSec{};
+        double      inSyncRatio{};                  // Presents in sync over presents.
+        double      flipsOutOfSyncPerSec{};
+        double      refreshesWithoutPresentPerSec{};
+    };
+
+    class Totals final {
+    public:
+        uint64_t    presents{};
+        uint64_t    presentsInSync{};
+        uint64_t    flipsOutOfSync{};
+        uint64_t    refreshesWithoutPresent{};
+        uint32_t    outOfSyncEpisodes{};            // Left SYNC_SYSTEM/SYNC_CLUSTER after being in sync.
+        uint64_t    outOfSyncNs{};                  // Ongoing episode included.
+        uint64_t    longestOutOfSyncNs{};
+        uint32_t    counterResets{};
+    };
+
+    static bool IsInSync(PresentBarrierSyncMode m)
+    {
+        return m == PresentBarrierSyncMode::syncSystem || m == PresentBarrierSyncMode::syncCluster;
+    }
+
+    static const char* SyncModeName(PresentBarrierSyncMode m)
+    {
+        switch (m) {
+        case PresentBarrierSyncMode::notJoined:
+            return "NOT_JOINED";
+        case PresentBarrierSyncMode::syncClient:
+            return "SYNC_CLIENT";
+        case PresentBarrierSyncMode::syncSystem:
+            return "SYNC_SYSTEM";
+        case PresentBarrierSyncMode::syncCluster:
+            return "SYNC_CLUSTER";
+        }
+        return "UNKNOWN";
+    }
+
+private:
+    uint64_t    rateWindowNs{ 1'000'000'000 };
+
+    bool        hasLast{ false };
+    PresentBarrierFrameStatistics   last{};
+    uint64_t    firstNs{};
+    uint64_t    lastNs{};
+    uint64_t    modeSinceNs{};
+
+    // Rates are computed over windows of rateWindowNs.
+    Totals      windowStartTotals{};
+    uint64_t    windowStartNs{};
+    Rates       rates{};
+
+    Totals      totals{};
+    uint64_t    outOfSyncSinceNs{};
+    uint64_t    lastOutOfSyncNs{};
+    bool        outOfSync{ false };
+
+    std::vector<Transition> history;    // Ring of HistorySize.
+    uint64_t    numTransitions{};
+
+    static uint32_t Delta(uint32_t now, uint32_t before)
+    {
+        return now - before;
+    }
+
+    void PushTransition(uint64_t nowNs, PresentBarrierSyncMode to)
+    {
+        Transition t{ nowNs - firstNs, last.SyncMode, to, nowNs - modeSinceNs };
+        if (history.size() < HistorySize)
+            history.push_back(t);
+        else
+            history[numTransitions % HistorySize] = t;
+        ++numTransitions;
+        modeSinceNs = nowNs;
+    }
+
+public:
+    void SetRateWindow(uint64_t ns)
+    {
+        rateWindowNs = std::max<uint64_t>(ns, 1);
+    }
+
+    void Reset()
+    {
+        const uint64_t window{ rateWindowNs };
+        *this = {};
+        rateWindowNs = window;
+    }
+
+    void Update(const PresentBarrierFrameStatistics& s, uint64_t nowNs)
+    {
+        if (!hasLast) {
+            hasLast = true;
+            last = s;
+            firstNs = lastNs = modeSinceNs = windowStartNs = nowNs;
+            return;
+        }
+
+        const uint32_t dPresent{ Delta(s.PresentCount, last.PresentCount) };
+        const uint32_t dPresentInSync{ Delta(s.PresentInSyncCount, last.PresentInSyncCount) };
+        const uint32_t dFlipInSync{ Delta(s.FlipInSyncCount, last.FlipInSyncCount) };
+        const uint32_t dRefresh{ Delta(s.RefreshCount, last.RefreshCount) };
+        if (std::max({ dPresent, dPresentInSync, dFlipInSync, dRefresh }) > 0x80000000u) {
+            ++totals.counterResets;
+        }
+        else {
+            totals.presents += dPresent;
+            totals.presentsInSync += dPresentInSync;
+            totals.flipsOutOfSync += dPresent > dFlipInSync ? dPresent - dFlipInSync : 0;
+            totals.refreshesWithoutPresent += dRefresh > dPresent ? dRefresh - dPresent : 0;
+        }
+
+        if (s.SyncMode != last.SyncMode) {
+            if (IsInSync(last.SyncMode) && !IsInSync(s.SyncMode)) {
+                outOfSync = true;
+                outOfSyncSinceNs = nowNs;
+                ++totals.outOfSyncEpisodes;
+            }
+            else if (!IsInSync(last.SyncMode) && IsInSync(s.SyncMode)) {
+                if (outOfSync) {
+                    const uint64_t ns{ nowNs - outOfSyncSinceNs };
+                    totals.longestOutOfSyncNs = std::max(totals.longestOutOfSyncNs, ns);
+                    totals.outOfSyncNs += ns;
+                    lastOutOfSyncNs = ns;
+                    outOfSync = false;
+                }
+            }
+            PushTransition(nowNs, s.SyncMode);
+        }
+
+        if (nowNs - windowStartNs >= rateWindowNs) {
+            const double sec{ (nowNs - windowStartNs) / 1'000'000'000.0 };
+            const uint64_t presents{ totals.presents - windowStartTotals.presents };
+            rates.presentsPerSec = presents / sec;
+            rates.inSyncRatio = presents > 0 ? (double)(totals.presentsInSync - windowStartTotals.presentsInSync) / presents : 0.0;
+            rates.flipsOutOfSyncPerSec = (totals.flipsOutOfSync - windowStartTotals.flipsOutOfSync) / sec;
+            rates.refreshesWithoutPresentPerSec = (totals.refreshesWithoutPresent - windowStartTotals.refreshesWithoutPresent) / sec;
+            windowStartTotals = totals;
+            windowStartNs = nowNs;
+        }
+
+        last = s;
+        lastNs = nowNs;
+    }
+
+    const Rates& GetRates() const
+    {
+        return rates;
+    }
+
+    Totals GetTotals() const
+    {
+        Totals t{ totals };
+        if (outOfSync) {
+            t.outOfSyncNs += lastNs - outOfSyncSinceNs;
+            t.longestOutOfSyncNs = std::max(t.longestOutOfSyncNs, lastNs - outOfSyncSinceNs);
+        }
+        return t;
+    }
+
+    // In an out of sync episode.
+    bool IsOutOfSync() const
+    {
+        return outOfSync;
+    }
+
+    // Duration of the latest finished out of sync episode.
+    uint64_t LastOutOfSyncNs() const
+    {
+        return lastOutOfSyncNs;
+    }
+
+    PresentBarrierSyncMode CurrentMode() const
+    {
+        return last.SyncMode;
+    }
+
+    uint64_t ElapsedNs() const
+    {
+        return lastNs - firstNs;
+    }
+
+    uint64_t NumTransitions() const
+    {
+        return numTransitions;
+    }
+
+    // Up to HistorySize of the latest transitions, the oldest first.
+    std::vector<Transition> History() const
+    {
+        std::vector<Transition> ret;
+        ret.reserve(history.size());
+        const uint64_t first{ numTransitions > HistorySize ? numTransitions % HistorySize : 0 };
+        for (size_t i = 0; i < history.size(); ++i)
+            ret.push_back(history[(first + i) % history.size()]);
+        return ret;
+    }
+};
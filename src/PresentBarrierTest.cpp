@@ -44,6 +44,32 @@
 #pragma comment(lib, "dxgi.lib")
 #pragma comment(lib, "d3d12.lib")
 
+#include "Clock.h"
+#include "PresentBackend.h"
+#include "FrameLoop.h"
+#include "FrameTimeline.h"
+#include "IntervalStats.h"
+#include "SkewAnalyzer.h"
+#include "PresentBarrierEmulator.h"
+#include "PresentBarrierStatsTracker.h"
+#include "EventWaiter.h"
+#include "Simulation.h"
+#include "TraceExporter.h"
+#include "LogRing.h"
+#include "BinaryLog.h"
+#include "SeqLock.h"
+#include "SpscRing.h"
+#include "FenceRingAllocator.h"
+#include "PipelineCacheStore.h"
+#include "FramePipeline.h"
+#include "RenderScheduler.h"
+#include "JobSystem.h"
+#include "SubmissionBatcher.h"
+#include "Timebase.h"
+#include "VblankEstimator.h"
+#include "FrameStartScheduler.h"
+#include "SwapChainConfigStats.h"
+
 using Microsoft::WRL::ComPtr;
 
 namespace {
@@ -152,6 +178,33 @@ namespace {
         ImGui::EndChild();
     }
 
+    void OpenConsole()
+    {
+        FILE* fp;
+
+        AllocConsole();
+        freopen_s(&fp, "CONIN$", "r", stdin);
+        freopen_s(&fp, "CONOUT$", "w", stdout);
+        freopen_s(&fp, "CONOUT$", "w", stderr);
+    }
+
+    // Log lines go through logRing while it runs, so a render thread which logs never waits for the console or
+    // the UI. Otherwise, e.g. before App::Init, they are written out directly.
+    LogRing     logRing;
+    // With "-binlog <file>", Log() records the format string and the raw arguments instead of text, and
+    // tools/BinaryLogDecoder formats them offline.
+    BinaryLog   binaryLog;
+
+    void WriteLogLine(const char* text)
+    {
+        printf("%s", text);
+        OutputDebugStringA(text);
+
+        if (std::shared_ptr<LogBuffer> t = weak_logBuffer.lock()) {
+            t->Addline(text);
+        }
+    }
+
     void Log(const wchar_t* format, ...)
     {
         std::array<wchar_t, 1024> str;
@@ -159,30 +212,51 @@ namespace {
         va_start(args, format);
 
         vswprintf_s(str.data(), str.size(), format, args);
-        wprintf(str.data());
-        OutputDebugStringW(str.data());
+        va_end(args);
 
-        if (std::shared_ptr<LogBuffer> t = weak_logBuffer.lock()) {
-            t->Addline(ToUTF8(str.data()).c_str());
+        if (binaryLog.IsOpen()) {
+            std::array<char, BinaryLog::MaxStringLength + 1> mbs;
+            size_t converted{};
+            wcstombs_s(&converted, mbs.data(), mbs.size(), str.data(), _TRUNCATE);
+            binaryLog.Record("%s", (const char*)mbs.data());
+            return;
         }
-
-        va_end(args);
+        if (logRing.IsRunning()) {
+            logRing.PushWith([&str](char* dst, size_t dstSize) {
+                size_t converted{};
+                wcstombs_s(&converted, dst, dstSize, str.data(), _TRUNCATE);
+                return converted > 0 ? converted - 1 : 0;
+                });
+            return;
+        }
+        WriteLogLine(ToUTF8(str.data()).c_str());
     }
-    void Log(const char* format, ...)
+    void LogText(const char* format, ...)
     {
-        std::array<char, 1024> str;
         va_list args;
         va_start(args, format);
 
-        vsprintf_s(str.data(), str.size(), format, args);
-        printf(str.data());
-        OutputDebugStringA(str.data());
-
-        if (std::shared_ptr<LogBuffer> t = weak_logBuffer.lock()) {
-            t->Addline(str.data());
+        if (logRing.IsRunning()) {
+            logRing.PushV(format, args);
+            va_end(args);
+            return;
         }
 
+        std::array<char, 1024> str;
+        vsprintf_s(str.data(), str.size(), format, args);
         va_end(args);
+
+        WriteLogLine(str.data());
+    }
+    // The format must be a string literal.
+    template <typename... Args>
+    void Log(const char* format, Args... args)
+    {
+        if (binaryLog.IsOpen()) {
+            binaryLog.Record(format, args...);
+            return;
+        }
+        LogText(format, args...);
     }
 };
 
@@ -212,26 +286,133 @@ public:
             control,
             test,
             exit
-        } mode{ Mode::control };
+        };
+        std::atomic<Mode> mode{ Mode::control };
 
         class Display {
         public:
+            // UI actions sent to the present thread of the display, which applies them at the start of a frame and
+            // acknowledges each one.
+            class Command final {
+            public:
+                enum class Type : uint32_t {
+                    setWindowMode,
+                    joinPresentBarrier,
+                    leavePresentBarrier,
+                    setThreadWait,
+                    setPacing,
+                    setFrameStart,
+                    resetIntervalStats,
+                    quit,
+                };
+                Type            type{};
+                uint32_t        seq{};
+                uint64_t        issuedNs{};
+                WindowMode      windowMode{};           // setWindowMode
+                float           threadWaitMs{};         // setThreadWait
+                FramePacingMode pacingMode{};           // setPacing
+                uint32_t        maxFrameLatency{};      // setPacing
+                uint32_t        backBufferCount{};      // setPacing
+                bool            pipelined{};            // setPacing
+                FrameStartMode  frameStartMode{};       // setFrameStart
+                float           targetMissRate{};       // setFrameStart
+            };
+            class Ack final {
+            public:
+                uint32_t        seq{};
+                Command::Type   type{};
+                bool            ok{};
+                uint64_t        latencyNs{};            // From the click to its effect.
+            };
+
+            // State shared with the threads of the display, apart from the other displays so that present threads
+            // never wait for each other.
+            class alignas(64) Shard final {
+            public:
+                static constexpr size_t COMMAND_QUEUE_SIZE{ 64 };
+                SpscRing<Command, COMMAND_QUEUE_SIZE>   commands;       // UI -> present thread.
+                SpscRing<Ack, COMMAND_QUEUE_SIZE>       acks;           // Present or window thread -> UI, see D3DContext_Base::Ack.
+                // Applied by the present thread, read by the window thread.
+                std::atomic<float>                      threadWaitMs{};
+
+                // Published by the present thread of the display.
+                SeqLocked<PresentIntervalStats::Summary>    intervalStats;
+                SeqLocked<VblankEstimator::Summary>         vblank;
+                SeqLocked<FrameStartScheduler::Stats>       frameStart;
+                SeqLocked<SwapChainConfigStats::Table>      swapChain;
+
+#ifdef NVAPI_ENABLED
+                // Updated by the present thread every frame and read by the UI.
+                std::mutex                          pbMtx;
+                NV_PRESENT_BARRIER_FRAME_STATISTICS nvapi_PBStats{};
+                PresentBarrierStatsTracker          nvapi_PBTracker;
+#endif
+            };
+
+            // Settings as the UI shows them, they reach the display through commands.
+            class Settings final {
+            public:
+                float           threadWaitMs{};
+                FrameStartMode  frameStartMode{ FrameStartMode::fixedDelay };
+                float           targetMissRatePct{ 1.0f };
+                FramePacingMode pacingMode{ FramePacingMode::fence };
+                uint32_t        maxFrameLatency{ 2 };
+                uint32_t        backBufferCount{ 2 };   // Changing it rebuilds the swap chain.
+                bool            pipelined{ false };     // Record the next frame while the current one is presented.
+            };
+
+            class CommandStats final {
+            public:
+                uint32_t    sent{};
+                uint32_t    acked{};
+                uint32_t    failed{};
+                double      lastLatencyMs{};
+                double      maxLatencyMs{};
+            };
+
             bool        selected{ false };
-            WindowMode  windowMode{ WindowMode::windowed };
             uint32_t    adapterIdx{};
             uint32_t    outputIdx{};
             std::string description;
+            std::unique_ptr<Shard>  shard{ std::make_unique<Shard>() };
+            Settings        settings;
+            CommandStats    commandStats;
 
-            float       threadWaitMs{};
+            // UI thread.
+            bool Send(Command c)
+            {
+                c.seq = commandStats.sent + 1;
+                c.issuedNs = FrameTimeline::NowNs();
+                if (!shard->commands.TryPush(c))
+                    return false;
+                ++commandStats.sent;
+                return true;
+            }
 
-#ifdef NVAPI_ENABLED
-            NV_PRESENT_BARRIER_FRAME_STATISTICS nvapi_PBStats{};
-            PresentBarrierMode                  nvapi_PresentBarrierMode{ PresentBarrierMode::leave };
-#endif
+            void DrainAcks()
+            {
+                for (Ack a; shard->acks.TryPop(a);) {
+                    ++commandStats.acked;
+                    if (!a.ok)
+                        ++commandStats.failed;
+                    commandStats.lastLatencyMs = a.latencyNs / 1'000'000.0;
+                    commandStats.maxLatencyMs = std::max(commandStats.maxLatencyMs, commandStats.lastLatencyMs);
+                }
+            }
         };
 
+        // Under App::mtx. The list is fixed once the test starts, so the threads of a display access its shard directly.
         std::vector<Display> displays;
-        uint64_t globalCounter{};
+
+        // globalCounter rendered by the test windows, see Timebase. "-timebase <timer[:hz]|vblank|pb>"
+        Timebase            timebase{ FrameTimeline::NowNs };
+        TimebaseSource      timebaseSource{ TimebaseSource::vblank };
+        uint32_t            timerHz{ 60 };
+        uint32_t            timebaseDisplayIdx{};   // Master display of the vblank and PresentBarrier sources, set before the test windows start.
+
+        // Present skew across the test windows, published by the main thread.
+        SeqLocked<SkewAnalyzer::Summary>    skew;
+        std::vector<uint32_t>   skewDisplayIdx;     // Display of each analyzed window, under App::mtx.
     } ctx;
 
     class Adapter final
@@ -243,14 +424,314 @@ public:
             DXGI_OUTPUT_DESC      desc;
             DXGI_MODE_DESC        currentModeDesc;
         };
+        // Pipeline objects shared by the windows on the adapter. They are built with the device, so that no window
+        // stalls on PSO creation in its first frame.
+        class ShaderAssets final {
+        public:
+            ComPtr<ID3D12RootSignature> rootSig;
+            ComPtr<ID3D12PipelineState> pso;
+
+            // The PSO is loaded from the pipeline cache when it holds one compiled for deviceKey, otherwise it is
+            // compiled and stored.
+            bool Init(ComPtr<ID3D12Device>& dev, PipelineCacheStore& pipelineCache, uint64_t deviceKey)
+            {
+                ComPtr<ID3DBlob> sig;
+                {
+                    D3D12_ROOT_SIGNATURE_DESC desc{ 0, nullptr, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT };
+                    ComPtr<ID3DBlob> err;
+                    if (FAILED(D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1, &sig, &err))) {
+                        Log("Failed to serialize a root signature.\n");
+                        return false;
+                    }
+                    if (FAILED(dev->CreateRootSignature(0, sig->GetBufferPointer(), sig->GetBufferSize(), IID_PPV_ARGS(&rootSig)))) {
+                        Log("Failed to create a root signature.\n");
+                    }
+                }
+                {
+                    std::array<D3D12_INPUT_ELEMENT_DESC, 2> ieDesc{ {
+                        { "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+                        { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+                    } };
+
+                    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
+                    psoDesc.InputLayout = { ieDesc.data(), (UINT)ieDesc.size() };
+                    psoDesc.pRootSignature = rootSig.Get();
+                    psoDesc.VS = { VSMain_cso, VSMain_cso_len };
+                    psoDesc.PS = { PSMain_cso, PSMain_cso_len };
+                    psoDesc.RasterizerState = {
+                        D3D12_FILL_MODE_SOLID,
+                        D3D12_CULL_MODE_NONE,
+                        FALSE,
+                        0,
+                        0.0f,
+                        0.0f,
+                        FALSE,
+                        FALSE,
+                        FALSE,
+                        0,
+                        D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF
+                    };
+                    psoDesc.BlendState = { FALSE, FALSE, {FALSE, FALSE, D3D12_BLEND_ONE, D3D12_BLEND_ONE, D3D12_BLEND_OP_ADD,D3D12_BLEND_ONE, D3D12_BLEND_ONE, D3D12_BLEND_OP_ADD, D3D12_LOGIC_OP_SET, (UINT8)0x000F } };
+                    psoDesc.DepthStencilState.DepthEnable = FALSE;
+                    psoDesc.DepthStencilState.StencilEnable = FALSE;
+                    psoDesc.SampleMask = UINT_MAX;
+                    psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+                    psoDesc.NumRenderTargets = 1;
+                    psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+                    psoDesc.SampleDesc.Count = 1;
+
+                    const PipelineCacheStore::Key key{ deviceKey, PipelineKey(psoDesc, sig.Get()) };
+                    if (auto blob{ pipelineCache.Find(key) }; !blob.empty()) {
+                        psoDesc.CachedPSO = { blob.data(), blob.size() };
+                        if (FAILED(dev->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pso)))) {
+                            // Rejected by the driver, e.g. after an update which kept its version.
+                            Log("Cached PSO rejected, compiling it.\n");
+                        }
+                        psoDesc.CachedPSO = {};
+                    }
+                    if (!pso) {
+                        if (FAILED(dev->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pso)))) {
+                            Log("Failed to create a PSO.\n");
+                            return false;
+                        }
+                        ComPtr<ID3DBlob> blob;
+                        if (SUCCEEDED(pso->GetCachedBlob(&blob)) && blob->GetBufferSize() > 0) {
+                            pipelineCache.Insert(key, blob->GetBufferPointer(), blob->GetBufferSize());
+                        }
+                    }
+                }
+                return true;
+            }
+
+            // Everything the compiled pipeline depends on, apart from the device.
+            static uint64_t PipelineKey(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& d, ID3DBlob* rootSig)
+            {
+                uint64_t h{ PipelineCacheFormat::FnvOffset };
+                auto add = [&h](const void* data, size_t size) { h = PipelineCacheFormat::Fnv1a(data, size, h); };
+                auto addValue = [&add](const auto& v) { add(&v, sizeof(v)); };
+
+                add(d.VS.pShaderBytecode, d.VS.BytecodeLength);
+                add(d.PS.pShaderBytecode, d.PS.BytecodeLength);
+                add(rootSig->GetBufferPointer(), rootSig->GetBufferSize());
+                for (UINT i = 0; i < d.InputLayout.NumElements; ++i) {
+                    const auto& e{ d.InputLayout.pInputElementDescs[i] };
+                    add(e.SemanticName, strlen(e.SemanticName));
+                    addValue(e.SemanticIndex);
+                    addValue(e.Format);
+                    addValue(e.InputSlot);
+                    addValue(e.AlignedByteOffset);
+                    addValue(e.InputSlotClass);
+                    addValue(e.InstanceDataStepRate);
+                }
+                // Structs without padding are hashed whole.
+                addValue(d.RasterizerState);
+                addValue(d.DepthStencilState.DepthEnable);
+                addValue(d.DepthStencilState.DepthWriteMask);
+                addValue(d.DepthStencilState.DepthFunc);
+                addValue(d.DepthStencilState.StencilEnable);
+                addValue(d.DepthStencilState.StencilReadMask);
+                addValue(d.DepthStencilState.StencilWriteMask);
+                addValue(d.DepthStencilState.FrontFace);
+                addValue(d.DepthStencilState.BackFace);
+                addValue(d.SampleMask);
+                addValue(d.PrimitiveTopologyType);
+                addValue(d.NumRenderTargets);
+                addValue(d.RTVFormats);
+                addValue(d.DSVFormat);
+                addValue(d.SampleDesc);
+                addValue(d.BlendState.AlphaToCoverageEnable);
+                addValue(d.BlendState.IndependentBlendEnable);
+                for (const auto& rt : d.BlendState.RenderTarget) {
+                    // The write mask is followed by padding.
+                    addValue(rt.BlendEnable);
+                    addValue(rt.LogicOpEnable);
+                    addValue(rt.SrcBlend);
+                    addValue(rt.DestBlend);
+                    addValue(rt.BlendOp);
+                    addValue(rt.SrcBlendAlpha);
+                    addValue(rt.DestBlendAlpha);
+                    addValue(rt.BlendOpAlpha);
+                    addValue(rt.LogicOp);
+                    addValue(rt.RenderTargetWriteMask);
+                }
+                return h;
+            }
+        };
+
+        // Persistently mapped upload heaps, leased to the windows on the adapter in blocks of whole pages. Every window
+        // suballocates its own block, so the pool is only locked when a window starts, grows its block or exits.
+        class UploadHeapPool final {
+        public:
+            static constexpr uint64_t PAGE_SIZE{ 65536 };
+            static constexpr uint32_t PAGES_PER_HEAP{ 16 };
+
+            class Block final {
+            public:
+                uint32_t                    heapIdx{};
+                uint32_t                    firstPage{};
+                uint32_t                    numPages{};
+                uintptr_t                   cpuPtr{};
+                D3D12_GPU_VIRTUAL_ADDRESS   gpuPtr{};
+                uint64_t                    size{};
+            };
+
+        private:
+            class Heap final {
+            public:
+                ComPtr<ID3D12Resource>      resource;
+                uintptr_t                   cpuPtr{};
+                D3D12_GPU_VIRTUAL_ADDRESS   gpuPtr{};
+                std::vector<bool>           usedPages;
+            };
+
+            std::mutex              mtx;
+            ComPtr<ID3D12Device>    device;
+            std::vector<Heap>       heaps;
+
+            bool AddHeap(uint32_t numPages)
+            {
+                D3D12_HEAP_PROPERTIES       heapProp{
+                    D3D12_HEAP_TYPE_UPLOAD,
+                    D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+                    D3D12_MEMORY_POOL_UNKNOWN,
+                    1, 1 };
+                D3D12_RESOURCE_DESC         resDesc{
+                    D3D12_RESOURCE_DIMENSION_BUFFER,
+                    D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT,
+                    numPages * PAGE_SIZE, 1, 1,
+                    1,
+                    DXGI_FORMAT_UNKNOWN,
+                    {1, 0},
+                    D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+                    D3D12_RESOURCE_FLAG_NONE
+                };
+
+                ComPtr<ID3D12Resource> heap;
+                if (FAILED(device->CreateCommittedResource(
+                    &heapProp, D3D12_HEAP_FLAG_NONE,
+                    &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ,
+                    nullptr, IID_PPV_ARGS(&heap)))) {
+                    Log("Failed to create a upload heap.\n");
+                    return false;
+                }
+
+                // permanently mapped until it gets destructed.
+                uintptr_t mapped{};
+                D3D12_RANGE readRange{};
+                if (FAILED(heap->Map(0, &readRange, (void**)&mapped))) {
+                    Log("Failed to map buffer.\n");
+                    return false;
+                }
+                heaps.push_back({ heap, mapped, heap->GetGPUVirtualAddress(), std::vector<bool>(numPages, false) });
+                return true;
+            }
+
+            // The first run of numPages free pages of the heap, or the number of pages of the heap.
+            static uint32_t FindFreePages(const Heap& h, uint32_t numPages)
+            {
+                uint32_t run{};
+                for (uint32_t i = 0; i < (uint32_t)h.usedPages.size(); ++i) {
+                    run = h.usedPages[i] ? 0 : run + 1;
+                    if (run == numPages)
+                        return i + 1 - numPages;
+                }
+                return (uint32_t)h.usedPages.size();
+            }
+
+        public:
+            ~UploadHeapPool()
+            {
+                for (auto& h : heaps) {
+                    h.resource->Unmap(0, nullptr);
+                }
+            }
+
+            bool Init(ComPtr<ID3D12Device>& dev)
+            {
+                std::scoped_lock<std::mutex> l{ mtx };
+                device = dev;
+                return AddHeap(PAGES_PER_HEAP);
+            }
+
+            // Leases at least size bytes. Adds a heap when none of them has enough contiguous free pages.
+            bool Acquire(uint64_t size, Block* outBlock)
+            {
+                const uint32_t numPages{ (uint32_t)((size + PAGE_SIZE - 1) / PAGE_SIZE) };
+                std::scoped_lock<std::mutex> l{ mtx };
+
+                uint32_t heapIdx{}, firstPage{};
+                for (heapIdx = 0; heapIdx < (uint32_t)heaps.size(); ++heapIdx) {
+                    firstPage = FindFreePages(heaps[heapIdx], numPages);
+                    if (firstPage < (uint32_t)heaps[heapIdx].usedPages.size())
+                        break;
+                }
+                if (heapIdx == (uint32_t)heaps.size()) {
+                    if (!AddHeap(std::max(numPages, PAGES_PER_HEAP)))
+                        return false;
+                    Log("Upload heap pool grown to %u heaps.\n", (uint32_t)heaps.size());
+                    firstPage = 0;
+                }
+
+                auto& h{ heaps[heapIdx] };
+                std::fill_n(h.usedPages.begin() + firstPage, numPages, true);
+                *outBlock = { heapIdx, firstPage, numPages,
+                    h.cpuPtr + firstPage * PAGE_SIZE, h.gpuPtr + firstPage * PAGE_SIZE, numPages * PAGE_SIZE };
+                return true;
+            }
+
+            // The GPU has to be done with the block.
+            void Release(const Block& block)
+            {
+                std::scoped_lock<std::mutex> l{ mtx };
+                auto& h{ heaps.at(block.heapIdx) };
+                std::fill_n(h.usedPages.begin() + block.firstPage, block.numPages, false);
+            }
+        };
+
         ComPtr<IDXGIAdapter4>       adapter;
         DXGI_ADAPTER_DESC           desc{};
         ComPtr<ID3D12Device>        device;
         ComPtr<ID3D12CommandQueue>  queue;
         std::vector<Output>         outputs;
+        // Referenced by the windows on the adapter, so they are released with the last of them.
+        std::shared_ptr<ShaderAssets>   shaderAssets;
+        std::shared_ptr<UploadHeapPool> uploadHeapPool;
+        // With "-batchSubmit <us>", the windows on the adapter share one ExecuteCommandLists call and one fence signal
+        // per frame.
+        using SubmitBatcher = SubmissionBatcher<ID3D12CommandList*>;
+        std::shared_ptr<SubmitBatcher>  submitBatcher;
 
     public:
-        bool Init(ComPtr<IDXGIAdapter>& a)
+        // Identifies the adapter model and the driver a compiled pipeline is valid for.
+        uint64_t DeviceKey() const
+        {
+            LARGE_INTEGER umdVersion{};
+            if (FAILED(adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umdVersion))) {
+                umdVersion = {};
+            }
+            const std::array<uint64_t, 5> identity{ desc.VendorId, desc.DeviceId, desc.SubSysId, desc.Revision, (uint64_t)umdVersion.QuadPart };
+            return PipelineCacheFormat::Fnv1a(identity.data(), sizeof(identity));
+        }
+
+        // Before the windows are created.
+        bool EnableBatchedSubmit(std::chrono::microseconds collectWindow)
+        {
+            ComPtr<ID3D12Fence> fence;
+            if (FAILED(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)))) {
+                Log("Failed to create the fence of the batched submissions.\n");
+                return false;
+            }
+            submitBatcher->Configure([queue = queue, fence, value = uint64_t{}](const std::vector<ID3D12CommandList*>& lists) mutable {
+                queue->ExecuteCommandLists((UINT)lists.size(), lists.data());
+                if (FAILED(queue->Signal(fence.Get(), ++value))) {
+                    Log("Failed to signal the fence of the batched submissions.\n");
+                }
+                return value;
+                }, collectWindow);
+            return true;
+        }
+
+        bool Init(ComPtr<IDXGIAdapter>& a, PipelineCacheStore& pipelineCache)
         {
             a->GetDesc(&desc);
 
@@ -301,6 +782,18 @@ public:
                     return false;
             }
 
+            shaderAssets = std::make_shared<ShaderAssets>();
+            if (!shaderAssets->Init(device, pipelineCache, DeviceKey())) {
+                Log("Failed to create the shader assets.\n");
+                return false;
+            }
+            uploadHeapPool = std::make_shared<UploadHeapPool>();
+            if (!uploadHeapPool->Init(device)) {
+                Log("Failed to create the upload heap pool.\n");
+                return false;
+            }
+            submitBatcher = std::make_shared<SubmitBatcher>();
+
             ComPtr<IDXGIOutput> dxgiOut;
             for (UINT i = 0; adapter->EnumOutputs(i, &dxgiOut) != DXGI_ERROR_NOT_FOUND; i++) {
                 DXGI_OUTPUT_DESC desc;
@@ -334,6 +827,9 @@ public:
         {
             outputs.clear();
 
+            shaderAssets.reset();
+            uploadHeapPool.reset();
+            submitBatcher.reset();
             queue.Reset();
             device.Reset();
             adapter.Reset();
@@ -374,18 +870,37 @@ public:
     ComPtr<IDXGIFactory7>                   dxgiFactory;
     std::vector<std::unique_ptr<Adapter>>   adapters;
     std::shared_ptr<LogBuffer>              logBuffer;
+    // Streams a Chrome trace with "-trace <file>". Thread names are collected from the start.
+    std::unique_ptr<TraceExporter>          traceExporter{ std::make_unique<TraceExporter>() };
+    // Compiled PSOs of previous launches, "-pipelineCache <path>".
+    PipelineCacheStore                      pipelineCache;
+    // Render threads shared by the windows with "-renderThreads <n>". A present thread per window without it.
+    std::unique_ptr<RenderScheduler>        renderScheduler;
+    // Workers for the per-frame jobs of the windows with "-jobWorkers <n>". Jobs run on the calling thread without them.
+    JobSystem                               jobSystem;
 
 #ifdef NVAPI_ENABLED
     bool            nvapi_Initialized{ false };
+    // Serializes the PresentBarrier client lifecycle calls. The per frame statistics query of a client only takes
+    // the lock of its display.
+    std::mutex      nvapiMtx;
+    // Software PresentBarrier used instead of NvAPI with -emulatePresentBarrier.
+    std::unique_ptr<PresentBarrierEmulator> pbEmulator;
 #endif
 
 public:
-    bool Init(HINSTANCE hInstance)
+    // Pipelines are compiled every time when pipelineCachePath is empty.
+    bool Init(HINSTANCE hInstance, const std::filesystem::path& pipelineCachePath)
     {
         std::scoped_lock<std::mutex> l{ mtx };
 
         logBuffer = std::make_shared<LogBuffer>();
         weak_logBuffer = logBuffer;
+        logRing.Start([](const char* text, size_t) { WriteLogLine(text); });
+
+        if (!pipelineCachePath.empty() && !pipelineCache.Open(pipelineCachePath)) {
+            Log("Failed to open the pipeline cache.\n");
+        }
 
 #ifdef NVAPI_ENABLED
         if (NvAPI_Initialize() != NVAPI_OK) {
@@ -412,11 +927,15 @@ public:
         ComPtr<IDXGIAdapter> adapter;
         for (UINT i = 0; dxgiFactory->EnumAdapters(i, &adapter) != DXGI_ERROR_NOT_FOUND; i++) {
             auto a = std::make_unique<Adapter>();
-            if (!a->Init(adapter)) {
+            if (!a->Init(adapter, pipelineCache)) {
                 continue;
             }
             adapters.push_back(std::move(a));
         }
+        if (pipelineCache.IsOpen()) {
+            const auto st{ pipelineCache.GetStats() };
+            Log("Pipeline cache: %llu hits, %llu misses, %llu dropped as corrupted.\n", st.hits, st.misses, st.dropped);
+        }
 
         return true;
     };
@@ -425,10 +944,16 @@ public:
     {
         std::scoped_lock<std::mutex> l{ mtx };
 
+        if (renderScheduler) {
+            renderScheduler->Stop();
+            renderScheduler.reset();
+        }
+        jobSystem.Stop();
         for (auto& a : adapters) {
             a->Terminate();
         }
         adapters.clear();
+        pipelineCache.Close();
 
         dxgiFactory.Reset();
 
@@ -449,13 +974,195 @@ public:
         }
 #endif
 
+        // Flushes the pending lines.
+        logRing.Stop();
+        if (logRing.Dropped() > 0) {
+            Log("%llu log lines were dropped.\n", logRing.Dropped());
+        }
         logBuffer.reset();
 
         return true;
     }
 };
 
-class D3DContext_Base
+// D3D12/DXGI implementation of the presentation backend.
+class D3D12PresentBackend final : public PresentBackend
+{
+public:
+    ComPtr<ID3D12CommandQueue>  queue;
+    ComPtr<ID3D12Fence>         fence;
+    ComPtr<IDXGISwapChain3>     swapChain;
+    HANDLE                      frameLatencyWaitable{};
+    uint32_t                    numBackBuffers{};
+
+public:
+    bool Init(ComPtr<ID3D12Device>& dev, ComPtr<ID3D12CommandQueue>& q, uint32_t numBuffers)
+    {
+        queue = q;
+        numBackBuffers = numBuffers;
+
+        if (FAILED(dev->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence))))
+            return false;
+
+        return true;
+    }
+
+    // The record and the present threads of the pipelined mode wait for the fence concurrently, so every thread waits
+    // on an event of its own.
+    static HANDLE ThreadFenceEvent()
+    {
+        class Event final {
+        public:
+            HANDLE h{ CreateEventW(nullptr, TRUE, FALSE, nullptr) };
+            ~Event()
+            {
+                if (h != nullptr)
+                    CloseHandle(h);
+            }
+        };
+        static thread_local Event ev;
+        return ev.h;
+    }
+
+    // The waitable belongs to the current swap chain and has to be reopened when it gets recreated.
+    bool OpenFrameLatencyWaitable()
+    {
+        CloseFrameLatencyWaitable();
+        frameLatencyWaitable = swapChain->GetFrameLatencyWaitableObject();
+        return frameLatencyWaitable != nullptr;
+    }
+
+    void CloseFrameLatencyWaitable()
+    {
+        if (frameLatencyWaitable != nullptr) {
+            CloseHandle(frameLatencyWaitable);
+            frameLatencyWaitable = nullptr;
+        }
+    }
+
+    void Terminate()
+    {
+        CloseFrameLatencyWaitable();
+        swapChain.Reset();
+        fence.Reset();
+        queue.Reset();
+    }
+
+    virtual uint32_t BackBufferCount() const override
+    {
+        return numBackBuffers;
+    }
+
+    virtual uint32_t CurrentBackBufferIndex() override
+    {
+        return swapChain->GetCurrentBackBufferIndex();
+    }
+
+    virtual Status Present(uint32_t syncInterval) override
+    {
+        HRESULT hr = swapChain->Present(syncInterval, 0);
+#if 0
+        {
+            // emurate present lock.
+            static uint32_t i;
+            if (++i % 512 == 511) {
+                Sleep(5000);
+            }
+
+        }
+#endif
+        if (FAILED(hr)) {
+            Log("Present call failed with: %d.\n", hr);
+            return Status::error;
+        }
+        return hr == DXGI_STATUS_OCCLUDED ? Status::occluded : Status::ok;
+    }
+
+    virtual Status TestOcclusion() override
+    {
+        return swapChain->Present(0, DXGI_PRESENT_TEST) == DXGI_STATUS_OCCLUDED ? Status::occluded : Status::ok;
+    }
+
+    virtual bool Signal(uint64_t value) override
+    {
+        return SUCCEEDED(queue->Signal(fence.Get(), value));
+    }
+
+    virtual uint64_t CompletedValue() override
+    {
+        return fence->GetCompletedValue();
+    }
+
+    virtual Status WaitForValue(uint64_t value, uint32_t timeoutMs) override
+    {
+        const HANDLE fenceEvent{ ThreadFenceEvent() };
+        if (fenceEvent == nullptr || !ResetEvent(fenceEvent)) {
+            Log("Failed to reset event.\n");
+            return Status::error;
+        };
+        if (FAILED(fence->SetEventOnCompletion(value, fenceEvent))) {
+            Log("Failed to SetEventOnCompletion.\n");
+            return Status::error;
+        };
+
+        switch (WaitForSingleObject(fenceEvent, timeoutMs)) {
+        case WAIT_OBJECT_0:
+            return Status::ok;
+        case WAIT_TIMEOUT:
+            return Status::timeout;
+        }
+        return Status::error;
+    }
+
+    virtual bool SetMaximumFrameLatency(uint32_t maxLatency) override
+    {
+        if (FAILED(swapChain->SetMaximumFrameLatency(maxLatency))) {
+            Log("Failed to set the maximum frame latency to %u.\n", maxLatency);
+            return false;
+        }
+        return true;
+    }
+
+    virtual Status WaitForFrameLatency(uint32_t timeoutMs) override
+    {
+        switch (WaitForSingleObject(frameLatencyWaitable, timeoutMs)) {
+        case WAIT_OBJECT_0:
+            return Status::ok;
+        case WAIT_TIMEOUT:
+            return Status::timeout;
+        }
+        Log("Failed to wait for the frame latency waitable object.\n");
+        return Status::error;
+    }
+
+    // The flip time is in QPC time in nanoseconds, as the steady clock counts them.
+    virtual bool LastFlip(uint64_t& ns, uint32_t& presentCount) override
+    {
+        static const uint64_t qpcFrequency{ []() {
+            LARGE_INTEGER f{};
+            QueryPerformanceFrequency(&f);
+            return (uint64_t)f.QuadPart;
+            }() };
+
+        DXGI_FRAME_STATISTICS st{};
+        if (!swapChain || FAILED(swapChain->GetFrameStatistics(&st)) || st.SyncQPCTime.QuadPart <= 0 || qpcFrequency == 0)
+            return false;
+        const uint64_t qpc{ (uint64_t)st.SyncQPCTime.QuadPart };
+        ns = qpc / qpcFrequency * 1'000'000'000 + qpc % qpcFrequency * 1'000'000'000 / qpcFrequency;
+        presentCount = st.PresentCount;
+        return true;
+    }
+
+    virtual uint32_t LastPresentCount() override
+    {
+        UINT count{};
+        if (!swapChain || FAILED(swapChain->GetLastPresentCount(&count)))
+            return 0;
+        return count;
+    }
+};
+
+class D3DContext_Base : public FrameLoop::Steps
 {
 public:
     enum class WindowModeTransitionStatus {
@@ -464,177 +1171,203 @@ public:
         error
     };
 
+    // The per buffer resources are created for the largest back buffer count, the swap chain has backBufferCount.
+    static constexpr uint32_t MIN_BACK_BUFFERS{ 2 };
+    static constexpr uint32_t MAX_BACK_BUFFERS{ 4 };
+
 protected:
-    static constexpr size_t NUM_BACK_BUFFERS{ 2 };
     static constexpr size_t DESC_HEAP_SIZE{ 256 };
 
+    // Requested by the present thread in ApplyCommands, transitioned to by the window thread while the present thread
+    // is idle and the record thread paused. The record thread reads currentWindowMode.
     WindowMode currentWindowMode{ WindowMode::windowed };
     WindowMode requestedWindowMode{ WindowMode::windowed };
     WindowMode setWindowMode{ WindowMode::windowed };
     bool       internalWindowModeChange{ false };
+    WindowMode commandedWindowMode{ WindowMode::windowed };    // Requested by the UI.
+    using Command = App::Context::Display::Command;
+    // Commands acked once their effect completes. The present thread adds them, and they are acked by the present
+    // thread or by the window thread while the present thread is idle.
+    std::vector<Command>    windowModeAcks;         // At the end of the window mode transition.
+    std::vector<std::tuple<Command, bool>>  swapChainAcks;      // Once the swap chain is rebuilt. With the result so far.
+    std::atomic<bool>   quitRequested{ false };    // Set by the present thread, read by the thread which records.
 
     std::shared_ptr<App>    app;
     uint32_t                appListIdx{};
+    App::Context::Display::Shard*   shard{};    // State of the display shared with the UI.
+    TraceExporter*          tracer{};
 
     ComPtr<IDXGIFactory7>   factory;
     ComPtr<ID3D12Device>    dev;
     ComPtr<IDXGIOutput6>    output;
     DXGI_OUTPUT_DESC        outputDesc{};
+    DXGI_RATIONAL           outputRefreshRate{};
     ComPtr<ID3D12CommandQueue>          queue;
-    ComPtr<ID3D12GraphicsCommandList>   cList;
 
-    std::array<ComPtr<ID3D12DescriptorHeap>, NUM_BACK_BUFFERS>   rtvDescHeap;
-    std::array<ComPtr<ID3D12DescriptorHeap>, NUM_BACK_BUFFERS>   descHeap;
-    std::array<ComPtr<ID3D12CommandAllocator>, NUM_BACK_BUFFERS> cAllocator;
-
-    ComPtr<ID3D12Fence> fence;
-    HANDLE      fenceEvent{};
-    uint64_t    fenceLastSignaledValue{};
-
-    ComPtr<IDXGISwapChain3> swapChain;
-    std::array<ComPtr<ID3D12Resource>, NUM_BACK_BUFFERS>  backbuffers;
+    std::array<ComPtr<ID3D12DescriptorHeap>, MAX_BACK_BUFFERS>   rtvDescHeap;
+    std::array<ComPtr<ID3D12DescriptorHeap>, MAX_BACK_BUFFERS>   descHeap;
+    std::array<ComPtr<ID3D12CommandAllocator>, MAX_BACK_BUFFERS> cAllocator;
+    std::array<ComPtr<ID3D12GraphicsCommandList>, MAX_BACK_BUFFERS> cLists;   // A frame can be recorded while the previous one is presented.
+
+    using RecordedFrame = FrameLoop::Frame;
+    // Written by the thread which records, the present thread or the record thread in the pipelined mode.
+    RecordedFrame       recording;
+    // Jobs of the frame being recorded, see App::jobSystem.
+    JobSystem::Group    frameJobs;
+    HWND                presentHWnd{};      // Of the frames recorded, set by Present.
+
+    D3D12PresentBackend presentBackend;
+    // Sequences the frames, with the steps below. In the pipelined mode, frames are recorded on a record thread up to
+    // back buffer count - 1 frames ahead of the one the present thread submits and presents. Each of them needs a back
+    // buffer the GPU is done with.
+    FrameLoop           frameLoop{ presentBackend, *this };
+    uint32_t            maxFrameLatency{ 2 };
+    // Set by the present thread, the window thread rebuilds the swap chain with it while the present thread is idle.
+    uint32_t            backBufferCount{ 2 };
+    FrameTimeline       timeline;
+    PresentIntervalStats    intervalStats;
+    uint32_t                intervalStatsFrames{};
+    static constexpr uint32_t INTERVAL_STATS_PUBLISH_FRAMES{ 16 };
+    uint64_t                refreshPeriodNs{};
+    // The next vblank after the last present, a refresh after it until the estimate converged. Orders the windows on
+    // a shared render thread.
+    std::atomic<uint64_t>   predictedVblankNs{};
+    // Per back buffer count and maximum frame latency the window ran with.
+    SwapChainConfigStats    swapChainStats;
+
+    std::array<ComPtr<ID3D12Resource>, MAX_BACK_BUFFERS>  backbuffers;
     bool   swapChainOccluded{ false };
-    HANDLE swapChainWaitableObject{};
     std::array<uint32_t, 2> currentSwapchainSize{ (uint32_t)-1, (uint32_t)-1};
     RECT                    storedWindowPosition{};
 
-    class ShaderAssets {
-    public:
-        ComPtr<ID3D12RootSignature> rootSig;
-        ComPtr<ID3D12PipelineState> pso;
-        ComPtr<ID3D12Resource>      uploadHeap;
-        static constexpr uint64_t   uploadHeapSize{ 65536 * 32 };
-        std::list<std::tuple<uintptr_t, uintptr_t, size_t>> mappedHeapChunks;
+    std::shared_ptr<App::Adapter::ShaderAssets>     shaderAssets;
+    std::shared_ptr<App::Adapter::UploadHeapPool>   uploadHeapPool;
+    // Set when the adapter batches the submissions of its windows.
+    std::shared_ptr<App::Adapter::SubmitBatcher>    submitBatcher;
+
+    // Vertex data of the frames, suballocated as a ring from a block of the adapter's upload heap pool and tracked
+    // with the fence of the present queue.
+    class VertexUploadRing final {
+        using Pool = App::Adapter::UploadHeapPool;
+        static constexpr uint32_t   UPLOAD_WAIT_TIMEOUT_MS{ 2000 };
+
+        std::shared_ptr<Pool>   pool;
+        Pool::Block             block;
+        FenceRingAllocator      ring;
+        // Blocks replaced by a larger one, returned once the fence passes the last frame which used them.
+        std::deque<std::tuple<Pool::Block, uint64_t>>  retiredBlocks;
 
     public:
-        bool Init(ComPtr<ID3D12Device>& dev)
+        bool Init(std::shared_ptr<Pool> inPool)
         {
-            {
-                D3D12_ROOT_SIGNATURE_DESC desc{ 0, nullptr, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT };
-                ComPtr<ID3DBlob> sig;
-                ComPtr<ID3DBlob> err;
-                if (FAILED(D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1, &sig, &err))) {
-                    Log("Failed to serialize a root signature.\n");
-                }
-                if (FAILED(dev->CreateRootSignature(0, sig->GetBufferPointer(), sig->GetBufferSize(), IID_PPV_ARGS(&rootSig)))) {
-                    Log("Failed to create a root signature.\n");
-                }
-            }
-            {
-                std::array<D3D12_INPUT_ELEMENT_DESC, 2> ieDesc{ {
-                    { "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-                    { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-                } };
-
-                D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
-                psoDesc.InputLayout = { ieDesc.data(), (UINT)ieDesc.size() };
-                psoDesc.pRootSignature = rootSig.Get();
-                psoDesc.VS = { VSMain_cso, VSMain_cso_len };
-                psoDesc.PS = { PSMain_cso, PSMain_cso_len };
-                psoDesc.RasterizerState = {
-                    D3D12_FILL_MODE_SOLID,
-                    D3D12_CULL_MODE_NONE,
-                    FALSE,
-                    0,
-                    0.0f,
-                    0.0f,
-                    FALSE,
-                    FALSE,
-                    FALSE,
-                    0,
-                    D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF
-                };
-                psoDesc.BlendState = { FALSE, FALSE, {FALSE, FALSE, D3D12_BLEND_ONE, D3D12_BLEND_ONE, D3D12_BLEND_OP_ADD,D3D12_BLEND_ONE, D3D12_BLEND_ONE, D3D12_BLEND_OP_ADD, D3D12_LOGIC_OP_SET, (UINT8)0x000F } };
-                psoDesc.DepthStencilState.DepthEnable = FALSE;
-                psoDesc.DepthStencilState.StencilEnable = FALSE;
-                psoDesc.SampleMask = UINT_MAX;
-                psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-                psoDesc.NumRenderTargets = 1;
-                psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-                psoDesc.SampleDesc.Count = 1;
-                if (FAILED(dev->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pso)))) {
-                    Log("Failed to create a PSO.\n");
-                    return false;
-                }
+            pool = std::move(inPool);
+            if (!pool->Acquire(Pool::PAGE_SIZE, &block)) {
+                Log("Failed to lease an upload heap block.\n");
+                pool.reset();
+                return false;
             }
+            ring.Reset(block.size);
+            return true;
+        }
 
-            // Create GPU Upload heap for a vertex buffer.
-            {
-                constexpr size_t nbChunks{ 32 };
-                constexpr size_t chunkSize{ 65536 };
-                constexpr uint64_t bufferSize{ chunkSize * nbChunks }; // 32 x 64KB
-                D3D12_HEAP_PROPERTIES       heapProp{
-                    D3D12_HEAP_TYPE_UPLOAD,
-                    D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-                    D3D12_MEMORY_POOL_UNKNOWN,
-                    1, 1 };
-                D3D12_RESOURCE_DESC         resDesc{
-                    D3D12_RESOURCE_DIMENSION_BUFFER,
-                    D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT,
-                    bufferSize, 1, 1,
-                    1,
-                    DXGI_FORMAT_UNKNOWN,
-                    {1, 0},
-                    D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
-                    D3D12_RESOURCE_FLAG_NONE
-                };
+        // The GPU has to be idle.
+        void Terminate()
+        {
+            if (!pool)
+                return;
+            pool->Release(block);
+            for (auto& [b, fenceValue] : retiredBlocks) {
+                pool->Release(b);
+            }
+            retiredBlocks.clear();
+            ring.Reset(0);
+            pool.reset();
+        }
 
-                if (FAILED(dev->CreateCommittedResource(
-                    &heapProp, D3D12_HEAP_FLAG_NONE,
-                    &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ,
-                    nullptr, IID_PPV_ARGS(&uploadHeap)))) {
-                    Log("Failed to create a upload heap.\n");
-                    return false;
+        // Returns CPU and GPU addresses of size bytes which stay untouched until the frame they are recorded in has
+        // been consumed by the GPU, or a null CPU address on failure. Waits for the GPU only when the block is full
+        // with submitted frames, and leases a larger block when even that doesn't make room.
+        std::tuple<uintptr_t, uintptr_t, size_t> Allocate(size_t size, size_t alignment, PresentBackend& backend, uint64_t frameFenceValue)
+        {
+            if (!pool)
+                return { 0, 0, 0 };
+            uint64_t offset{ ring.Allocate(size, alignment) };
+            if (offset == FenceRingAllocator::InvalidOffset) {
+                ring.Reclaim(backend.CompletedValue());
+                offset = ring.Allocate(size, alignment);
+            }
+            while (offset == FenceRingAllocator::InvalidOffset && ring.OldestPendingFence() != 0) {
+                if (backend.WaitForValue(ring.OldestPendingFence(), UPLOAD_WAIT_TIMEOUT_MS) != PresentBackend::Status::ok) {
+                    Log("Timed out waiting for the upload heap to be released.\n");
+                    break;
                 }
-
-                // permanently mapped until it gets destructed.
-                D3D12_GPU_VIRTUAL_ADDRESS gpuPtr{ uploadHeap->GetGPUVirtualAddress() };
-                uintptr_t mapped{};
-                D3D12_RANGE readRange{};
-                if (FAILED(uploadHeap->Map(0, &readRange, (void**)&mapped))) {
-                    Log("Failed to map buffer.\n");
-                    uploadHeap.Reset();
-                    return false;
+                ring.Reclaim(backend.CompletedValue());
+                offset = ring.Allocate(size, alignment);
+            }
+            if (offset == FenceRingAllocator::InvalidOffset) {
+                // The allocations of the frame being recorded fill the block. It stays leased until the frame is done.
+                uint64_t newSize{ ring.Capacity() * 2 };
+                while (newSize < size + alignment)
+                    newSize *= 2;
+                Pool::Block newBlock;
+                if (!pool->Acquire(newSize, &newBlock)) {
+                    return { 0, 0, 0 };
                 }
-                for (size_t i = 0; i < nbChunks; ++i) {
-                    mappedHeapChunks.push_back({ mapped + chunkSize * i, gpuPtr + chunkSize * i, chunkSize });
+                retiredBlocks.push_back({ block, frameFenceValue });
+                block = newBlock;
+                ring.Reset(block.size);
+                Log("Upload heap block grown to %llu bytes.\n", block.size);
+                offset = ring.Allocate(size, alignment);
+                if (offset == FenceRingAllocator::InvalidOffset) {
+                    return { 0, 0, 0 };
                 }
             }
-            return true;
-        };
-
-        bool Terminate()
-        {
-            if (uploadHeap) {
-                uploadHeap->Unmap(0, nullptr);
-                uploadHeap.Reset();
-            }
-            rootSig.Reset();
-            pso.Reset();
-
-            return true;
+            return { block.cpuPtr + offset, block.gpuPtr + offset, size };
         }
 
-        std::tuple<uintptr_t, uintptr_t, size_t> GetUploadChunk()
+        // After the frame has been recorded. Its fence value may not have been signaled yet.
+        void Submit(uint64_t fenceValue, uint64_t completedValue)
         {
-            auto f = mappedHeapChunks.front();
-            mappedHeapChunks.pop_front();
-            mappedHeapChunks.push_back(f);
-
-            return f;
+            ring.Submit(fenceValue);
+            ring.Reclaim(completedValue);
+            while (!retiredBlocks.empty() && std::get<1>(retiredBlocks.front()) <= completedValue) {
+                pool->Release(std::get<0>(retiredBlocks.front()));
+                retiredBlocks.pop_front();
+            }
         }
     };
-    std::unique_ptr<ShaderAssets>       shaderAssets;
+    VertexUploadRing    vertexUploads;
 
 #ifdef NVAPI_ENABLED
     bool    nvapi_PresentBarrierIsSupported{ false };
     bool    nvapi_PresentBarrierHasJoined{ false };
+    PresentBarrierMode  nvapi_PresentBarrierMode{ PresentBarrierMode::leave };     // Requested by the UI.
+    std::vector<App::Context::Display::Command>     presentBarrierAcks;     // Once joined or left.
     bool    nvapi_PresentBarrierClientHandleCreated{ false };
     NvPresentBarrierClientHandle nvapi_PresentBarrierClientHandle{};
+    PresentBarrierEmulator::ClientHandle pbEmu_ClientHandle{ PresentBarrierEmulator::InvalidHandle };
     ComPtr<ID3D12Fence> presentBarrierFence;
 #endif
 
 public:
+    // Written by the present thread, can be read from any thread.
+    const FrameTimeline& GetFrameTimeline() const
+    {
+        return timeline;
+    }
+
+    // Any thread.
+    uint64_t PredictedNextVblankNs() const
+    {
+        return predictedVblankNs.load(std::memory_order_relaxed);
+    }
+
+    // Window thread, while the present thread is idle: when to start the next frame, see FrameLoop::NextFrameStartNs.
+    uint64_t NextFrameStartNs(uint64_t lastPresentNs, float threadWaitMs)
+    {
+        return frameLoop.NextFrameStartNs(lastPresentNs, threadWaitMs);
+    }
+
     void SetApp(std::shared_ptr<App> inApp, uint32_t listIdx)
     {
         std::swap(app, inApp);
@@ -643,16 +1376,41 @@ public:
             std::scoped_lock<std::mutex> l{ app->mtx };
 
             factory = app->dxgiFactory;
+            tracer = app->traceExporter.get();
+            frameLoop.tracer = tracer;
 
             auto& display = app->ctx.displays.at(appListIdx);
+            shard = display.shard.get();
             auto& a{ app->adapters.at(display.adapterIdx) };
             auto& o{ a->outputs.at(display.outputIdx) };
 
             dev = a->device;
             queue = a->queue;
+            shaderAssets = a->shaderAssets;
+            uploadHeapPool = a->uploadHeapPool;
+            if (a->submitBatcher->Enabled()) {
+                submitBatcher = a->submitBatcher;
+                submitBatcher->Join();
+            }
             output = o.dxgiOut;
             outputDesc = o.desc;
-        }
+            outputRefreshRate = o.currentModeDesc.RefreshRate;
+            frameLoop.pipelined = display.settings.pipelined;
+            backBufferCount = std::clamp(display.settings.backBufferCount, MIN_BACK_BUFFERS, MAX_BACK_BUFFERS);
+            maxFrameLatency = std::clamp(display.settings.maxFrameLatency, 1u, PresentBackend::MAX_FRAME_LATENCY);
+            frameLoop.frameStartMode = display.settings.frameStartMode;
+            FrameStartScheduler::Config frameStartCfg;
+            frameStartCfg.targetMissRate = display.settings.targetMissRatePct / 100.0;
+            frameLoop.frameStartScheduler.Reset(frameStartCfg);
+        }
+        if (outputRefreshRate.Numerator > 0) {
+            refreshPeriodNs = (uint64_t)(1'000'000'000.0 * outputRefreshRate.Denominator / outputRefreshRate.Numerator);
+            intervalStats.SetRefreshPeriod(refreshPeriodNs);
+            swapChainStats.SetRefreshPeriod(refreshPeriodNs);
+        }
+        VblankEstimator::Config vblankCfg;
+        vblankCfg.nominalPeriodNs = (double)refreshPeriodNs;
+        frameLoop.vblankEstimator.Reset(vblankCfg);
     }
 
     bool ShowWindowOnTheAssociatedOutput(HWND hWnd)
@@ -681,7 +1439,7 @@ public:
             desc.NumDescriptors = 1;
             desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
             desc.NodeMask = 1;
-            for (size_t i = 0; i < NUM_BACK_BUFFERS; ++i) {
+            for (size_t i = 0; i < MAX_BACK_BUFFERS; ++i) {
                 if (FAILED(dev->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&rtvDescHeap[i]))))
                     return false;
             }
@@ -692,37 +1450,37 @@ public:
             desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
             desc.NumDescriptors = DESC_HEAP_SIZE;
             desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-            for (size_t i = 0; i < NUM_BACK_BUFFERS; ++i) {
+            for (size_t i = 0; i < MAX_BACK_BUFFERS; ++i) {
                 if (FAILED(dev->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&descHeap[i]))))
                     return false;
             }
         }
 
-        for (size_t i = 0; i < NUM_BACK_BUFFERS; ++i) {
+        for (size_t i = 0; i < MAX_BACK_BUFFERS; ++i) {
             if (FAILED(dev->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&cAllocator[i]))))
                 return false;
         }
 
-        if (FAILED(dev->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, cAllocator[0].Get(), nullptr, IID_PPV_ARGS(&cList))))
-            return false;
-
-        if (FAILED(cList->Close()))
-            return false;
+        for (size_t i = 0; i < MAX_BACK_BUFFERS; ++i) {
+            if (FAILED(dev->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, cAllocator[i].Get(), nullptr, IID_PPV_ARGS(&cLists[i]))))
+                return false;
+            if (FAILED(cLists[i]->Close()))
+                return false;
+        }
 
-        if (FAILED(dev->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence))))
+        if (!presentBackend.Init(dev, queue, backBufferCount))
             return false;
 
-        fenceEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
-        if (fenceEvent == nullptr)
+        if (!vertexUploads.Init(uploadHeapPool))
             return false;
 
 #ifdef NVAPI_ENABLED
         {
-            std::scoped_lock<std::mutex> l{ app->mtx };
+            std::scoped_lock<std::mutex> l{ app->nvapiMtx };
 
-            if (app->nvapi_Initialized) {
+            if (app->nvapi_Initialized || app->pbEmulator) {
                 bool sts{ false };
-                if (NvAPI_D3D12_QueryPresentBarrierSupport(dev.Get(), &sts) != NVAPI_OK) {
+                if (!PresentBarrier_QuerySupport(&sts)) {
                     Log("Failed to call QueryPresentBarrierSupport\n");
                     nvapi_PresentBarrierIsSupported = false;
                 }
@@ -742,42 +1500,137 @@ public:
         return true;
     }
 
-    DWORD WaitForFence(bool leavePresentBarrier = true, uint64_t behind = 0, DWORD waitMs = INFINITE)
+#ifdef NVAPI_ENABLED
+    // PresentBarrier entry points. They are routed to the software emulator when the app has one.
+    bool PresentBarrier_QuerySupport(bool* sts)
+    {
+        if (app->pbEmulator) {
+            *sts = true;
+            return true;
+        }
+        return NvAPI_D3D12_QueryPresentBarrierSupport(dev.Get(), sts) == NVAPI_OK;
+    }
+
+    bool PresentBarrier_CreateClient()
+    {
+        if (app->pbEmulator) {
+            pbEmu_ClientHandle = app->pbEmulator->CreateClient(SimulatedDisplayClock::FromRefreshRate(outputRefreshRate.Numerator, outputRefreshRate.Denominator).periodNs);
+            return pbEmu_ClientHandle != PresentBarrierEmulator::InvalidHandle;
+        }
+        return NvAPI_D3D12_CreatePresentBarrierClient(dev.Get(), presentBackend.swapChain.Get(), &nvapi_PresentBarrierClientHandle) == NVAPI_OK;
+    }
+
+    bool PresentBarrier_RegisterResources()
+    {
+        if (app->pbEmulator)
+            return app->pbEmulator->RegisterResources(pbEmu_ClientHandle, presentBackend.BackBufferCount()) == PresentBarrierEmulator::Result::ok;
+
+        std::array<ID3D12Resource*, MAX_BACK_BUFFERS> rawBackBuffers;
+        std::transform(backbuffers.begin(), backbuffers.end(), rawBackBuffers.begin(), [](auto& a) { return a.Get(); });
+
+        return NvAPI_D3D12_RegisterPresentBarrierResources(nvapi_PresentBarrierClientHandle,
+            presentBarrierFence.Get(),
+            rawBackBuffers.data(), presentBackend.BackBufferCount()) == NVAPI_OK;
+    }
+
+    bool PresentBarrier_DestroyClient()
+    {
+        if (app->pbEmulator) {
+            auto sts = app->pbEmulator->DestroyClient(pbEmu_ClientHandle);
+            pbEmu_ClientHandle = PresentBarrierEmulator::InvalidHandle;
+            return sts == PresentBarrierEmulator::Result::ok;
+        }
+        return NvAPI_DestroyPresentBarrierClient(nvapi_PresentBarrierClientHandle) == NVAPI_OK;
+    }
+
+    bool PresentBarrier_Join()
+    {
+        bool sts{};
+        if (app->pbEmulator) {
+            sts = app->pbEmulator->Join(pbEmu_ClientHandle) == PresentBarrierEmulator::Result::ok;
+        }
+        else {
+            NV_JOIN_PRESENT_BARRIER_PARAMS params{ NV_JOIN_PRESENT_BARRIER_PARAMS_VER1 , };
+            sts = NvAPI_JoinPresentBarrier(nvapi_PresentBarrierClientHandle, &params) == NVAPI_OK;
+        }
+        if (sts) {
+            nvapi_PresentBarrierHasJoined = true;
+            tracer->Instant("PresentBarrier Join", "presentbarrier", "display", appListIdx);
+        }
+        return sts;
+    }
+
+    bool PresentBarrier_Leave()
+    {
+        bool sts{};
+        if (app->pbEmulator)
+            sts = app->pbEmulator->Leave(pbEmu_ClientHandle) == PresentBarrierEmulator::Result::ok;
+        else
+            sts = NvAPI_LeavePresentBarrier(nvapi_PresentBarrierClientHandle) == NVAPI_OK;
+        if (sts) {
+            nvapi_PresentBarrierHasJoined = false;
+            tracer->Instant("PresentBarrier Leave", "presentbarrier", "display", appListIdx);
+        }
+        return sts;
+    }
+
+    bool PresentBarrier_QueryFrameStatistics(NV_PRESENT_BARRIER_FRAME_STATISTICS* sts)
+    {
+        if (app->pbEmulator) {
+            static_assert(sizeof(PresentBarrierFrameStatistics) == sizeof(NV_PRESENT_BARRIER_FRAME_STATISTICS));
+            PresentBarrierFrameStatistics emuSts{ sts->dwVersion };
+            if (app->pbEmulator->QueryFrameStatistics(pbEmu_ClientHandle, &emuSts) != PresentBarrierEmulator::Result::ok)
+                return false;
+            sts->SyncMode = (NV_PRESENT_BARRIER_SYNC_MODE)emuSts.SyncMode;
+            sts->PresentCount = emuSts.PresentCount;
+            sts->PresentInSyncCount = emuSts.PresentInSyncCount;
+            sts->FlipInSyncCount = emuSts.FlipInSyncCount;
+            sts->RefreshCount = emuSts.RefreshCount;
+            return true;
+        }
+        return NvAPI_QueryPresentBarrierFrameStatistics(nvapi_PresentBarrierClientHandle, sts) == NVAPI_OK;
+    }
+#endif
+
+    bool LeavePresentBarrier()
     {
-        if (leavePresentBarrier) {
 #ifdef NVAPI_ENABLED
-            // Leave from the present barrier before taking a GPU CPU sync.
-            if (nvapi_PresentBarrierHasJoined) {
-                std::scoped_lock<std::mutex> l{ app->mtx };
-                if (NvAPI_LeavePresentBarrier(nvapi_PresentBarrierClientHandle) != NVAPI_OK) {
-                    Log("Failed to leave from the Present Barrier.\n");
-                    return WAIT_FAILED;
-                }
-                nvapi_PresentBarrierHasJoined = false;
+        if (nvapi_PresentBarrierHasJoined) {
+            std::scoped_lock<std::mutex> l{ app->nvapiMtx };
+            if (!PresentBarrier_Leave()) {
+                Log("Failed to leave from the Present Barrier.\n");
+                return false;
             }
-#endif
         }
+#endif
+        return true;
+    }
 
-        if (fenceLastSignaledValue == 0 || fenceLastSignaledValue <= behind)
-            return WAIT_OBJECT_0;
-        uint64_t targetValue = fenceLastSignaledValue - behind;
-        if (fence->GetCompletedValue() >= targetValue)
-            return WAIT_OBJECT_0;
-
-        if (!ResetEvent(fenceEvent)) {
-            Log("Failed to reset event.\n");
-            return WAIT_FAILED;
-        };
-        if (FAILED(fence->SetEventOnCompletion(targetValue, fenceEvent))) {
-            Log("Failed to SetEventOnCompletion.\n");
+    DWORD WaitForFence(bool leavePresentBarrier = true, uint64_t behind = 0, DWORD waitMs = INFINITE)
+    {
+        // Leave from the present barrier before taking a GPU CPU sync.
+        if (leavePresentBarrier && !LeavePresentBarrier())
             return WAIT_FAILED;
-        };
 
-        return WaitForSingleObject(fenceEvent, waitMs);
+        TraceExporter::Scope trace{ tracer, "WaitForFence", "fence" };
+        trace.argName = "behind";
+        trace.arg = behind;
+        switch (frameLoop.frameSync.WaitForFence(presentBackend, behind, waitMs)) {
+        case PresentBackend::Status::ok:
+            return WAIT_OBJECT_0;
+        case PresentBackend::Status::timeout:
+            return WAIT_TIMEOUT;
+        }
+        return WAIT_FAILED;
     }
 
     bool CreateSwapChain(HWND hWnd, uint32_t width, uint32_t height)
     {
+        TraceExporter::Scope trace{ tracer, "CreateSwapChain", "swapchain" };
+
+        // The back buffers of the frames recorded ahead are going away.
+        DiscardRecordedFrames();
+
         // take GPU-CPU sync
         if (WaitForFence() != WAIT_OBJECT_0)
             return false;
@@ -789,23 +1642,23 @@ public:
 
         DXGI_SWAP_CHAIN_DESC desc{};
         bool resize = false;
-        if (swapChain) {
-            swapChain->GetDesc(&desc);
+        if (presentBackend.swapChain) {
+            presentBackend.swapChain->GetDesc(&desc);
             if (hWnd == desc.OutputWindow) {
                 resize = true;
             }
         }
 
         if (resize) {
-            Log(L"Resizing swapchain: %d x %d -> %d x %d\n", desc.BufferDesc.Width, desc.BufferDesc.Height, width, height);
+            Log(L"Resizing swapchain: %d x %d -> %d x %d, %u -> %u buffers\n", desc.BufferDesc.Width, desc.BufferDesc.Height, width, height, desc.BufferCount, backBufferCount);
         }
         else {
-            Log(L"Create swapchain: %d x %d -> %d x %d\n", desc.BufferDesc.Width, desc.BufferDesc.Height, width, height);
+            Log(L"Create swapchain: %d x %d -> %d x %d, %u buffers\n", desc.BufferDesc.Width, desc.BufferDesc.Height, width, height, backBufferCount);
         }
 
         if (resize) {
-            if (FAILED(swapChain->ResizeBuffers(
-                NUM_BACK_BUFFERS,
+            if (FAILED(presentBackend.swapChain->ResizeBuffers(
+                backBufferCount,
                 width, height,
                 DXGI_FORMAT_R8G8B8A8_UNORM,
                 DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT))) {
@@ -818,18 +1671,18 @@ public:
 #ifdef NVAPI_ENABLED
             // Destroy PB client if exists.
             if (nvapi_PresentBarrierClientHandleCreated) {
-                std::scoped_lock<std::mutex> l{ app->mtx };
-                if (NvAPI_DestroyPresentBarrierClient(nvapi_PresentBarrierClientHandle) != NVAPI_OK) {
+                std::scoped_lock<std::mutex> l{ app->nvapiMtx };
+                if (!PresentBarrier_DestroyClient()) {
                     Log("Failed to destroy Present Barrier Client.\n");
                 }
                 nvapi_PresentBarrierClientHandle = {};
                 nvapi_PresentBarrierClientHandleCreated = false;;
             }
 #endif
-            swapChain.Reset();
+            presentBackend.swapChain.Reset();
 
             DXGI_SWAP_CHAIN_DESC1 sd{};
-            sd.BufferCount = NUM_BACK_BUFFERS;
+            sd.BufferCount = backBufferCount;
             sd.Width = width;
             sd.Height = height;
             sd.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
@@ -846,16 +1699,16 @@ public:
             if (FAILED(factory->CreateSwapChainForHwnd(queue.Get(), hWnd, &sd, nullptr, nullptr, &sc1)))
                 return false;
 
-            if (FAILED(sc1->QueryInterface(IID_PPV_ARGS(&swapChain)))) {
+            if (FAILED(sc1->QueryInterface(IID_PPV_ARGS(&presentBackend.swapChain)))) {
                 return false;
             }
 
 #ifdef NVAPI_ENABLED
             // Create Present Barrier client.
             if (nvapi_PresentBarrierIsSupported) {
-                std::scoped_lock<std::mutex> l{ app->mtx };
+                std::scoped_lock<std::mutex> l{ app->nvapiMtx };
 
-                if (NvAPI_D3D12_CreatePresentBarrierClient(dev.Get(), swapChain.Get(), &nvapi_PresentBarrierClientHandle)) {
+                if (!PresentBarrier_CreateClient()) {
                     Log("Failed to create Present Barrier Client.\n");
                     nvapi_PresentBarrierClientHandle = {};
                     nvapi_PresentBarrierClientHandleCreated = false;
@@ -870,37 +1723,30 @@ public:
             return false;
         }
 
-        if (FAILED(swapChain->SetMaximumFrameLatency(NUM_BACK_BUFFERS))) {
+        if (!presentBackend.SetMaximumFrameLatency(maxFrameLatency)) {
             return false;
         }
 
-        if (swapChainWaitableObject != nullptr) {
-            CloseHandle(swapChainWaitableObject);
-            swapChainWaitableObject = nullptr;
-        }
-        swapChainWaitableObject = swapChain->GetFrameLatencyWaitableObject();
-        if (swapChainWaitableObject == nullptr) {
+        if (!presentBackend.OpenFrameLatencyWaitable()) {
             return false;
         }
 
+        presentBackend.numBackBuffers = backBufferCount;
+        swapChainStats.Select(backBufferCount, maxFrameLatency);
+
         swapChainOccluded = false;
-        for (size_t i = 0; i < NUM_BACK_BUFFERS; ++i) {
-            swapChain->GetBuffer((UINT)i, IID_PPV_ARGS(&backbuffers[i]));
+        for (size_t i = 0; i < backBufferCount; ++i) {
+            presentBackend.swapChain->GetBuffer((UINT)i, IID_PPV_ARGS(&backbuffers[i]));
             dev->CreateRenderTargetView(backbuffers[i].Get(), nullptr, rtvDescHeap[i]->GetCPUDescriptorHandleForHeapStart());
         }
 
 #ifdef NVAPI_ENABLED
         // Register backbuffers to NVAPI.
         if (nvapi_PresentBarrierClientHandleCreated) {
-            std::scoped_lock<std::mutex> l{ app->mtx };
-
-            std::array<ID3D12Resource*, NUM_BACK_BUFFERS> rawBackBuffers;
-            std::transform(backbuffers.begin(), backbuffers.end(), rawBackBuffers.begin(), [](auto& a) { return a.Get(); });
+            std::scoped_lock<std::mutex> l{ app->nvapiMtx };
 
             // Register the new back buffer resources
-            if (NvAPI_D3D12_RegisterPresentBarrierResources(nvapi_PresentBarrierClientHandle,
-                presentBarrierFence.Get(),
-                rawBackBuffers.data(), (uint32_t)rawBackBuffers.size()) == NVAPI_OK) {
+            if (!PresentBarrier_RegisterResources()) {
                 Log("Failed to register present barrier resources.\n");
             }
         }
@@ -916,20 +1762,20 @@ public:
         for (;;) {
             BOOL currentFs{};
 
-            if (FAILED(swapChain->GetFullscreenState(&currentFs, nullptr))) {
+            if (FAILED(presentBackend.swapChain->GetFullscreenState(&currentFs, nullptr))) {
                 Log("Calling GetFullScreenState - Failed.\n");
                 return false;
             }
             if (currentFs == fsState)
                 return true;
-            auto hr = swapChain->SetFullscreenState(fsState, output);
+            auto hr = presentBackend.swapChain->SetFullscreenState(fsState, output);
             if (FAILED(hr)) {
                 Log("Calling SetFullScreenState - Failed.\n");
                 break;
             }
             if (hr == DXGI_STATUS_MODE_CHANGE_IN_PROGRESS) {
                 Log("Calling SetFullScreenState - DXGI_STATUS_MODE_CHANGE_IN_PROGRESS returned. Retrying..\n");
-                Sleep(10);
+                Clock::Get().SleepForNs(10'000'000);
                 continue;
             }
             break;
@@ -937,11 +1783,38 @@ public:
         return true;
     }
 
+    // Window thread, while the present thread is idle. Acks the window mode and back buffer count commands once the
+    // transition or the swap chain rebuild they started is over, or failed.
     WindowModeTransitionStatus WindowModeTransition(HWND hWnd, const std::tuple<LONG_PTR, LONG_PTR>& defaultWindowStyle)
+    {
+        // The record thread of the pipelined mode reads the window mode and the swap chain size. It finishes the frame
+        // it records and waits, keeping the frames requested ahead unless the step discards them.
+        frameLoop.pipeline.Pause();
+        const auto sts{ WindowModeTransitionStep(hWnd, defaultWindowStyle) };
+        frameLoop.pipeline.Resume();
+        const bool failed{ sts == WindowModeTransitionStatus::error };
+        const bool settled{ sts == WindowModeTransitionStatus::completed && currentWindowMode == requestedWindowMode && requestedWindowMode == commandedWindowMode };
+        if (failed || settled) {
+            // A command superseded by a later one didn't take effect.
+            for (auto& c : windowModeAcks) {
+                Ack(c, !failed && c.windowMode == currentWindowMode);
+            }
+            windowModeAcks.clear();
+        }
+        if (failed || (sts == WindowModeTransitionStatus::completed && backBufferCount == presentBackend.BackBufferCount())) {
+            for (auto& [c, ok] : swapChainAcks) {
+                Ack(c, !failed && ok && c.backBufferCount == presentBackend.BackBufferCount());
+            }
+            swapChainAcks.clear();
+        }
+        return sts;
+    }
+
+    WindowModeTransitionStatus WindowModeTransitionStep(HWND hWnd, const std::tuple<LONG_PTR, LONG_PTR>& defaultWindowStyle)
     {
         // Window mode change and swap chain modifications only happens here.
         // This thread is called from the Windows message pump thread, not the render thread.
-        // Before entering this function, render thread need to be joined.
+        // Before entering this function, render thread need to be joined, and the record thread paused.
 
         RECT rc{};
         if (!GetClientRect(hWnd, &rc)) {
@@ -952,10 +1825,10 @@ public:
         // No window mode trasition.
         if (currentWindowMode == requestedWindowMode) {
             // Check the fullscreen status while in fullscreen mode.
-            if (swapChain) {
+            if (presentBackend.swapChain) {
                 if (currentWindowMode == WindowMode::fullSceen) {
                     BOOL sts{ FALSE };
-                    if (FAILED(swapChain->GetFullscreenState(&sts, nullptr))) {
+                    if (FAILED(presentBackend.swapChain->GetFullscreenState(&sts, nullptr))) {
                         Log("Failed to get fullscreen state.\n");
                         return WindowModeTransitionStatus::error;
                     }
@@ -967,8 +1840,8 @@ public:
                 }
             }
 
-            // Check the client rect update.
-            if (currentSwapchainSize[0] != rc.right || currentSwapchainSize[1] != rc.bottom) {
+            // Check the client rect update, and the back buffer count set from the UI.
+            if (currentSwapchainSize[0] != rc.right || currentSwapchainSize[1] != rc.bottom || backBufferCount != presentBackend.BackBufferCount()) {
                 if (! CreateSwapChain(hWnd, rc.right, rc.bottom)) {
                     Log("Failed to create swap chain.\n");
                     return WindowModeTransitionStatus::error;
@@ -979,6 +1852,11 @@ public:
             return WindowModeTransitionStatus::completed;
 
         // Transition is happening.
+        TraceExporter::Scope trace{ tracer, "WindowModeTransition", "window" };
+        trace.argName = "requestedMode";
+        trace.arg = (uint64_t)requestedWindowMode;
+        DiscardRecordedFrames();
+
         // Take GPU <-> CPU sync.
         if (WaitForFence() != WAIT_OBJECT_0) {
             return WindowModeTransitionStatus::error;
@@ -1035,13 +1913,9 @@ public:
 
             Log("Changing Window Mode - Calling an empty Present.\n");
             {
-                HRESULT hr = swapChain->Present(1, 0);
-                swapChainOccluded = (hr == DXGI_STATUS_OCCLUDED);
-                if (FAILED(hr))
-                    return WindowModeTransitionStatus::error;
-            }
-            {
-                if (FAILED(queue->Signal(fence.Get(), ++fenceLastSignaledValue)))
+                auto sts = frameLoop.frameSync.PresentAndSignal(presentBackend, 1);
+                swapChainOccluded = (sts == PresentBackend::Status::occluded);
+                if (sts == PresentBackend::Status::error)
                     return WindowModeTransitionStatus::error;
 
                 if (WaitForFence() != WAIT_OBJECT_0)
@@ -1057,42 +1931,181 @@ public:
 
     virtual void Render(HWND, ComPtr<ID3D12GraphicsCommandList>&) = 0;
 
-    // This will be launched in present worker thread.
-    void Present(HWND hWnd, std::atomic<bool>& returnStatus)
+    // The acks ring has a single producer at a time: the present thread, or the window thread while the present thread
+    // is idle.
+    void Ack(const Command& c, bool ok)
     {
-        returnStatus.store(false);
-
-        if (!dev)
-            return;
+        // The ack is dropped if the UI stopped draining them.
+        shard->acks.TryPush({ c.seq, c.type, ok, FrameTimeline::NowNs() - c.issuedNs });
+    }
 
-        // Wait for the rendering completion for the current backbuffer index.
-        {
-            uint64_t cmpValue = fence->GetCompletedValue();
-            if (fenceLastSignaledValue - cmpValue >= NUM_BACK_BUFFERS) {
-                bool leavingPresentBarrier = false;
-                for (;;) {
-                    // Wait up to 2sec to detect present timeout.
-                    auto sts = WaitForFence(leavingPresentBarrier, NUM_BACK_BUFFERS - 1, 2000);
-                    if (sts == WAIT_OBJECT_0) {
-                        break;
+    // Drains the command queue of the display once per frame, in the present thread. The commands which take effect
+    // later are acked then. The window mode is only requested here, the window thread transitions to it.
+    void ApplyCommands()
+    {
+        if (internalWindowModeChange) {
+            // The window left full screen by itself, a later command from the UI still overrides it.
+            commandedWindowMode = requestedWindowMode;
+            internalWindowModeChange = false;
+        }
+
+        for (Command c; shard->commands.TryPop(c);) {
+            bool ok{ true };
+            bool deferred{ false };
+            switch (c.type) {
+            case Command::Type::setWindowMode:
+                commandedWindowMode = c.windowMode;
+                windowModeAcks.push_back(c);
+                deferred = true;
+                break;
+            case Command::Type::joinPresentBarrier:
+            case Command::Type::leavePresentBarrier:
+#ifdef NVAPI_ENABLED
+                nvapi_PresentBarrierMode = c.type == Command::Type::joinPresentBarrier ? PresentBarrierMode::join : PresentBarrierMode::leave;
+                ok = nvapi_PresentBarrierIsSupported;
+                if (ok) {
+                    presentBarrierAcks.push_back(c);
+                    deferred = true;
+                }
+#else
+                ok = false;
+#endif
+                break;
+            case Command::Type::setThreadWait:
+                shard->threadWaitMs.store(c.threadWaitMs);
+                break;
+            case Command::Type::setPacing:
+                frameLoop.pacingMode = c.pacingMode;
+                if (c.pipelined != frameLoop.pipelined) {
+                    frameLoop.pipelined = c.pipelined;
+                    // Back to recording on the present thread.
+                    if (!frameLoop.pipelined)
+                        frameLoop.pipeline.Stop();
+                    Log("Pipelined record and present: %s\n", frameLoop.pipelined ? "on" : "off");
+                }
+                if (c.backBufferCount != backBufferCount) {
+                    // The window thread rebuilds the swap chain before the next frame.
+                    ok = c.backBufferCount >= MIN_BACK_BUFFERS && c.backBufferCount <= MAX_BACK_BUFFERS;
+                    if (ok) {
+                        backBufferCount = c.backBufferCount;
+                        Log("Rebuilding the swap chain with %u back buffers.\n", backBufferCount);
                     }
-                    if (sts != WAIT_TIMEOUT) {
-                        Log(L"An error detected while waiting for a fence.\n");
-                        return;
+                }
+                if (c.maxFrameLatency != maxFrameLatency) {
+                    if (!presentBackend.SetMaximumFrameLatency(c.maxFrameLatency)) {
+                        ok = false;
                     }
-                    Log(L"Present lock detected. Waited for more than 2 seconds.");
-                    leavingPresentBarrier = true;
+                    else {
+                        maxFrameLatency = c.maxFrameLatency;
+                        // Otherwise the rebuild starts the row.
+                        if (backBufferCount == presentBackend.BackBufferCount())
+                            swapChainStats.Select(backBufferCount, maxFrameLatency);
+                    }
+                }
+                if (backBufferCount != presentBackend.BackBufferCount()) {
+                    swapChainAcks.push_back({ c, ok });
+                    deferred = true;
                 }
+                break;
+            case Command::Type::setFrameStart: {
+                FrameStartScheduler::Config cfg;
+                cfg.targetMissRate = c.targetMissRate;
+                frameLoop.frameStartScheduler.Reset(cfg);
+                frameLoop.frameStartMode = c.frameStartMode;
+                break;
+            }
+            case Command::Type::resetIntervalStats:
+                intervalStats.Reset();
+                intervalStatsFrames = 0;
+                shard->intervalStats.Store({});
+                swapChainStats.Reset();
+                shard->swapChain.Store(swapChainStats.GetTable());
+                break;
+            case Command::Type::quit:
+                quitRequested = true;
+                break;
+            }
+            if (!deferred) {
+                Ack(c, ok);
             }
         }
 
-        // Updating occlusion status.
-        if (swapChainOccluded && swapChain->Present(0, DXGI_PRESENT_TEST) != DXGI_STATUS_OCCLUDED)
-        {
-            swapChainOccluded = false;
+        if (requestedWindowMode == currentWindowMode) {
+            // The previous transition has been completed, the next one can be requested.
+            requestedWindowMode = commandedWindowMode;
+        }
+    }
+
+#ifdef NVAPI_ENABLED
+    // Check the PresentBarrier status and join or leave as requested, before every present. Present thread.
+    void UpdatePresentBarrier()
+    {
+        bool pbOk{ false };
+        if (nvapi_PresentBarrierClientHandleCreated) {
+            pbOk = true;
+            const auto pbMode{ nvapi_PresentBarrierMode };
+            std::scoped_lock<std::mutex> l{ shard->pbMtx };
+            auto& sts = shard->nvapi_PBStats;
+            sts = { NV_PRESENT_BARRIER_FRAME_STATICS_VER1 , };
+            if (!PresentBarrier_QueryFrameStatistics(&sts)) {
+                Log("Failed to query Present Barrier frame statistics.\n");
+                sts = { NV_PRESENT_BARRIER_FRAME_STATICS_VER1 , };
+            }
+            else {
+                auto& tracker = shard->nvapi_PBTracker;
+                const auto prevMode{ tracker.CurrentMode() };
+                const bool wasOutOfSync{ tracker.IsOutOfSync() };
+                tracker.Update({ sts.dwVersion, (PresentBarrierSyncMode)sts.SyncMode, sts.PresentCount, sts.PresentInSyncCount, sts.FlipInSyncCount, sts.RefreshCount },
+                    FrameTimeline::NowNs());
+                if (app->ctx.timebase.Source() == TimebaseSource::presentBarrier && appListIdx == app->ctx.timebaseDisplayIdx) {
+                    app->ctx.timebase.OnCount(FrameTimeline::NowNs(), sts.PresentCount);
+                }
+                if (!wasOutOfSync && tracker.IsOutOfSync()) {
+                    Log("PresentBarrier fell out of sync, %s -> %s at %.3fs.\n", PresentBarrierStatsTracker::SyncModeName(prevMode),
+                        PresentBarrierStatsTracker::SyncModeName(tracker.CurrentMode()), tracker.ElapsedNs() / 1'000'000'000.0);
+                }
+                else if (wasOutOfSync && !tracker.IsOutOfSync()) {
+                    Log("PresentBarrier back in %s at %.3fs after %.3fs out of sync.\n", PresentBarrierStatsTracker::SyncModeName(tracker.CurrentMode()),
+                        tracker.ElapsedNs() / 1'000'000'000.0, tracker.LastOutOfSyncNs() / 1'000'000'000.0);
+                }
+            }
+
+            if (pbMode == PresentBarrierMode::join && sts.SyncMode == PRESENT_BARRIER_NOT_JOINED) {
+                Log("Calling JoinPresentBarrier.\n");
+                std::scoped_lock<std::mutex> nl{ app->nvapiMtx };
+                if (!PresentBarrier_Join()) {
+                    Log("Failed to call JoinPresentBarrier.\n");
+                    pbOk = false;
+                }
+            }
+            if (pbMode == PresentBarrierMode::leave && sts.SyncMode != PRESENT_BARRIER_NOT_JOINED) {
+                Log("Calling LeavePresentBarrier.\n");
+                std::scoped_lock<std::mutex> nl{ app->nvapiMtx };
+                if (!PresentBarrier_Leave()) {
+                    Log("Failed to call LeavePresentBarrier.\n");
+                    pbOk = false;
+                }
+            }
         }
 
-        UINT backbufferIdx = swapChain->GetCurrentBackBufferIndex();
+        // The join and leave commands took effect above, those superseded by a later one didn't.
+        for (auto& c : presentBarrierAcks) {
+            Ack(c, pbOk && (c.type == Command::Type::joinPresentBarrier) == (nvapi_PresentBarrierMode == PresentBarrierMode::join));
+        }
+        presentBarrierAcks.clear();
+    }
+#endif
+
+    // Records the commands of a frame into its back buffer and command list. Runs on the present thread, or on the
+    // record thread in the pipelined mode.
+    void RecordFrame(HWND hWnd, RecordedFrame& frame)
+    {
+        TraceExporter::Scope trace{ tracer, "RecordFrame", "present" };
+        recording = frame;
+        recording.recordStartNs = FrameTimeline::NowNs();
+
+        const UINT backbufferIdx{ frame.backbufferIdx };
+        auto& cList{ cLists[backbufferIdx] };
         cAllocator[backbufferIdx]->Reset();
         cList->Reset(cAllocator[backbufferIdx].Get(), nullptr);
 
@@ -1129,55 +2142,191 @@ public:
         cList->ResourceBarrier(1, &barrier);
         cList->Close();
 
+        vertexUploads.Submit(recording.fenceValue, presentBackend.CompletedValue());
+        frame = recording;
+    }
+
+    // The steps of the frame loop.
+    virtual uint64_t NowNs() override
+    {
+        return FrameTimeline::NowNs();
+    }
+
+    // Leaves the present barrier before waiting again.
+    virtual bool OnPresentLock() override
+    {
+        Log(L"Present lock detected. Waited for more than 2 seconds.");
+        return LeavePresentBarrier();
+    }
+
+    virtual void OnRecordThreadStart() override
+    {
+        const std::string threadName{ "Record: " + ToUTF8(outputDesc.DeviceName) };
+        SetThreadDescription(GetCurrentThread(), L"Record Thread");
+        tracer->SetThreadName(threadName);
+        binaryLog.SetThreadName(threadName);
+    }
+
+    // Record thread of the pipelined mode: wait on the frame latency waitable in its pacing mode, then for the GPU to
+    // release the back buffer of the frame. Present locks are detected by the present thread waiting for the frame.
+    virtual bool WaitForRecordStart(const RecordedFrame& frame, const std::atomic<bool>& cancel) override
+    {
+        constexpr uint32_t waitSliceMs{ 100 };
+        TraceExporter::Scope trace{ tracer, "WaitForRecordStart", "present" };
+        if (frame.pacingMode == FramePacingMode::latencyWaitable) {
+            for (;;) {
+                auto sts = presentBackend.WaitForFrameLatency(waitSliceMs);
+                if (sts == PresentBackend::Status::ok)
+                    break;
+                if (sts != PresentBackend::Status::timeout || cancel.load())
+                    return false;
+            }
+        }
+        const uint64_t numBuffers{ presentBackend.BackBufferCount() };
+        if (frame.fenceValue <= numBuffers)
+            return true;
+        for (;;) {
+            auto sts = presentBackend.WaitForValue(frame.fenceValue - numBuffers, waitSliceMs);
+            if (sts == PresentBackend::Status::ok)
+                return true;
+            if (sts != PresentBackend::Status::timeout || cancel.load())
+                return false;
+        }
+    }
+
+    virtual bool RecordFrame(RecordedFrame& frame) override
+    {
+        RecordFrame(presentHWnd, frame);
+        return true;
+    }
+
+    virtual void OnFrameWaited(const RecordedFrame&) override
+    {
+        timeline.CompleteFence(presentBackend.CompletedValue(), FrameTimeline::NowNs());
+
+        // Updating occlusion status.
+        if (swapChainOccluded && presentBackend.TestOcclusion() != PresentBackend::Status::occluded)
         {
-            ID3D12CommandList* cListList[]{ cList.Get() };
-            queue->ExecuteCommandLists(1, cListList);
+            swapChainOccluded = false;
         }
+    }
 
+    virtual bool SubmitFrame(const RecordedFrame& frame) override
+    {
+#ifdef NVAPI_ENABLED
+        UpdatePresentBarrier();
+#endif
+        timeline.BeginFrame(frame.recordStartNs, frame.globalCounter);
         {
-            HRESULT hr = swapChain->Present(1, 0);
-#if 0
-            {
-                // emurate present lock.
-                static uint32_t i;
-                if (++i % 512 == 511) {
-                    Sleep(5000);
-                }
+            ID3D12CommandList* cListList[]{ cLists[frame.backbufferIdx].Get() };
+            if (submitBatcher) {
+                // Waits for the other windows on the adapter, up to the collect window.
+                TraceExporter::Scope trace{ tracer, "BatchedSubmit", "present" };
+                submitBatcher->Submit(cListList[0]);
+            }
+            else {
+                queue->ExecuteCommandLists(1, cListList);
+            }
+        }
+        timeline.MarkSubmit(FrameTimeline::NowNs());
+        return true;
+    }
 
+    virtual void BeforePresent() override
+    {
+#ifdef NVAPI_ENABLED
+        // The emulated barrier holds the present thread until every joined client arrives.
+        if (nvapi_PresentBarrierClientHandleCreated && app->pbEmulator) {
+            TraceExporter::Scope trace{ tracer, "PresentBarrier Wait", "presentbarrier" };
+            if (app->pbEmulator->Present(pbEmu_ClientHandle, 2000) == PresentBarrierEmulator::Result::timeout) {
+                Log("Emulated Present Barrier timed out.\n");
             }
+        }
 #endif
-            swapChainOccluded = (hr == DXGI_STATUS_OCCLUDED);
-            if (FAILED(hr)) {
-                Log("Present call failed with: %d.\n", hr);
-                return;
-            }
+    }
+
+    virtual void OnPresented(const RecordedFrame& frame, const FrameLoop::Presented& presented) override
+    {
+        swapChainOccluded = (presented.status == PresentBackend::Status::occluded);
+        const uint64_t now{ presented.presentNs };
+        timeline.MarkPresent(now, frameLoop.frameSync.LastSignaledValue());
+        intervalStats.OnPresent(now);
+
+        // Where the swap chain doesn't report its flips, the latency runs to the present return instead.
+        const uint32_t lastPresentCount{ presentBackend.LastPresentCount() };
+        swapChainStats.OnPresent(now, lastPresentCount, frame.recordStartNs);
+        swapChainStats.OnFlip(presented.flipped ? presented.flipPresentCount : lastPresentCount, presented.flipped ? presented.flipNs : now);
+        const auto& vblankEstimator{ frameLoop.vblankEstimator };
+        predictedVblankNs.store(vblankEstimator.Converged() ? vblankEstimator.Predict(now).vblankNs : now + refreshPeriodNs, std::memory_order_relaxed);
+    }
+
+    // Drops the frames recorded ahead, before the swap chain changes. Window thread, while the present thread is idle.
+    void DiscardRecordedFrames()
+    {
+        if (const size_t n{ frameLoop.pipeline.Discard() }; n > 0) {
+            Log("Discarded %u frames recorded ahead.\n", (uint32_t)n);
         }
+    }
+
+    // This will be launched in present worker thread.
+    void Present(HWND hWnd, std::atomic<bool>& returnStatus)
+    {
+        returnStatus.store(false);
 
-        if (FAILED(queue->Signal(fence.Get(), ++fenceLastSignaledValue))) {
-            Log("Setting a signal after Present call failed.\n");
+        if (!dev)
             return;
+        const uint64_t frameStartNs{ FrameTimeline::NowNs() };
+
+        // Apply the commands from the UI, and publish the interval statistics every few frames.
+        ApplyCommands();
+        if (++intervalStatsFrames % INTERVAL_STATS_PUBLISH_FRAMES == 0) {
+            shard->intervalStats.Store(intervalStats.Summarize());
+            shard->vblank.Store(frameLoop.vblankEstimator.Summarize());
+            shard->frameStart.Store(frameLoop.frameStartScheduler.GetStats());
+            shard->swapChain.Store(swapChainStats.GetTable());
+        }
+
+        // Wait for the frame latency waitable if selected, then for the rendering completion for the current backbuffer
+        // index, or for the frame recorded ahead in the pipelined mode. Waits over 2sec are present locks.
+        presentHWnd = hWnd;
+        switch (frameLoop.Present(frameStartNs)) {
+        case FrameLoop::Status::ok:
+            returnStatus.store(true);
+            break;
+        case FrameLoop::Status::waitFailed:
+            Log(L"An error detected while waiting for a fence.\n");
+            break;
+        case FrameLoop::Status::recordFailed:
+            Log("Failed to record a frame.\n");
+            break;
+        case FrameLoop::Status::submitFailed:
+            Log("Failed to submit a frame.\n");
+            break;
+        case FrameLoop::Status::presentFailed:
+            Log("Present call or setting a signal after it failed.\n");
+            break;
         }
-
-        returnStatus.store(true);
-        return;
     }
 
     bool Terminate()
     {
+        frameLoop.pipeline.Stop();
+        if (submitBatcher) {
+            submitBatcher->Leave();
+            submitBatcher.reset();
+        }
         if (WaitForFence() != WAIT_OBJECT_0)
             return false;
 
         // Revert to windowed before releasing the swapchain.
-        if (swapChain) {
+        if (presentBackend.swapChain) {
             if (!FullScreenStateTransition(FALSE))
                 return false;
         }
 
-        if (shaderAssets) {
-            bool sts = shaderAssets->Terminate();
-            assert(sts);
-            shaderAssets.reset();
-        }
+        vertexUploads.Terminate();
+        uploadHeapPool.reset();
+        shaderAssets.reset();
 
         // Descheaps
         for (auto& r : rtvDescHeap) {
@@ -1188,7 +2337,9 @@ public:
         }
 
         // commands
-        cList.Reset();
+        for (auto& l : cLists) {
+            l.Reset();
+        }
         for (auto& a : cAllocator) {
             a.Reset();
         }
@@ -1198,16 +2349,13 @@ public:
         for (auto& b : backbuffers) {
             b.Reset();
         }
-        if (swapChainWaitableObject != nullptr) {
-            CloseHandle(swapChainWaitableObject);
-            swapChainWaitableObject = nullptr;
-        }
+        presentBackend.CloseFrameLatencyWaitable();
         swapChainOccluded = false;
 
 #ifdef NVAPI_ENABLED
         if (nvapi_PresentBarrierClientHandleCreated) {
-            std::scoped_lock<std::mutex> l{ app->mtx };
-            if (NvAPI_DestroyPresentBarrierClient(nvapi_PresentBarrierClientHandle) != NVAPI_OK) {
+            std::scoped_lock<std::mutex> l{ app->nvapiMtx };
+            if (!PresentBarrier_DestroyClient()) {
                 Log("Failed to destroy Present Barrier Client.\n");
             }
             nvapi_PresentBarrierClientHandle = {};
@@ -1216,15 +2364,9 @@ public:
         presentBarrierFence.Reset();
 #endif
 
-        swapChain.Reset();
-
-        // fence.
-        fence.Reset();
-        if (fenceEvent != nullptr) {
-            CloseHandle(fenceEvent);
-            fenceEvent = nullptr;
-        }
-        fenceLastSignaledValue = {};
+        // swapchain and fence.
+        presentBackend.Terminate();
+        frameLoop.frameSync.Reset();
 
         output.Reset();
 
@@ -1282,7 +2424,7 @@ public:
         ImGui_ImplDX12_InitInfo info{};
         info.Device = dev.Get();
         info.CommandQueue = queue.Get();
-        info.NumFramesInFlight = NUM_BACK_BUFFERS;
+        info.NumFramesInFlight = MAX_BACK_BUFFERS;
         info.RTVFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
         info.DSVFormat = DXGI_FORMAT_UNKNOWN;
 
@@ -1370,7 +2512,82 @@ public:
             return true;
         }
 
-        return false;
+        return false;
+    }
+};
+
+// Wakes up the window loop on window messages, on present thread completion and on a high resolution pacing timer.
+class Win32EventWaiter final : public EventWaiter
+{
+    HANDLE                  notifyEvent{};
+    HANDLE                  timer{};
+    std::atomic<uint32_t>   pending{};
+
+public:
+    bool Init()
+    {
+        notifyEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+        if (notifyEvent == nullptr)
+            return false;
+
+        timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (timer == nullptr) {
+            // High resolution timers are not available before Windows 10 1803.
+            timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+        }
+        return timer != nullptr;
+    }
+
+    void Terminate()
+    {
+        if (timer != nullptr) {
+            CloseHandle(timer);
+            timer = nullptr;
+        }
+        if (notifyEvent != nullptr) {
+            CloseHandle(notifyEvent);
+            notifyEvent = nullptr;
+        }
+    }
+
+    virtual void Notify(uint32_t events) override
+    {
+        pending.fetch_or(events);
+        SetEvent(notifyEvent);
+    }
+
+    virtual uint32_t WaitUntil(uint64_t deadlineNs) override
+    {
+        std::array<HANDLE, 2> handles{ notifyEvent, timer };
+        DWORD numHandles{ 1 };
+
+        if (deadlineNs != NoDeadline) {
+            // Relative due time in 100ns units.
+            const uint64_t nowNs{ Clock::Get().NowNs() };
+            const int64_t dueTime{ deadlineNs > nowNs ? (int64_t)((deadlineNs - nowNs) / 100) : 0 };
+            if (dueTime <= 0)
+                return pending.exchange(0) | wakeupDeadline;
+
+            LARGE_INTEGER li{};
+            li.QuadPart = -dueTime;
+            if (!SetWaitableTimer(timer, &li, 0, nullptr, nullptr, FALSE)) {
+                Log("Failed to set the waitable timer.\n");
+                return pending.exchange(0) | wakeupDeadline;
+            }
+            numHandles = 2;
+        }
+
+        uint32_t events{ wakeupNone };
+        DWORD sts = MsgWaitForMultipleObjectsEx(numHandles, handles.data(), INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        if (sts == WAIT_OBJECT_0 + 1)
+            events |= wakeupDeadline;
+        else if (sts == WAIT_OBJECT_0 + numHandles)
+            events |= wakeupMessage;
+
+        if (numHandles == 2 && !(events & wakeupDeadline))
+            CancelWaitableTimer(timer);
+
+        return events | pending.exchange(0);
     }
 };
 
@@ -1500,13 +2717,15 @@ public:
         // Window thread.
         thd = std::thread([this, hInst, inApp, listIdx, withImGui]() -> void {
             // Make sure to change the thread state to Terminate whenever exitting from this scope.
-            ScopeGuard threadGuard([this] { thdState.store(ThreadState::Terminated); });
+            ScopeGuard threadGuard([this] { thdState.store(ThreadState::Terminated); thdState.notify_all(); });
             std::wstring wname;
             {
                 std::scoped_lock<std::mutex> l{ inApp->mtx };
                 wname = ToUTF16(inApp->ctx.displays.at(listIdx).description);
             }
             Log(L"Thread:%s - Start\n", wname.c_str());
+            inApp->traceExporter->SetThreadName(ToUTF8(std::wstring(WindowClassName())) + ": " + ToUTF8(wname));
+            binaryLog.SetThreadName(ToUTF8(std::wstring(WindowClassName())) + ": " + ToUTF8(wname));
 
             // naming the thread.
             if (FAILED(SetThreadDescription(GetCurrentThread(), wname.c_str())))
@@ -1576,8 +2795,10 @@ public:
 
                 // Change the thread state. Unblocking the caller thread.
                 thdState.store(ThreadState::Running);
+                thdState.notify_all();
 
                 // Present thread.
+                // Or a client of the shared render threads with -renderThreads.
                 struct PresentThreadContext final {
                     std::binary_semaphore       startSemaphore{ 0 };
                     std::binary_semaphore       finishSemaphore{ 0 };
@@ -1585,17 +2806,40 @@ public:
                     std::atomic<bool>           sts{ true };
                     bool                        busy{ false };
                     std::thread                 thd;
-                    std::chrono::high_resolution_clock::time_point lastPresent{};
+                    RenderScheduler*            scheduler{};
+                    RenderScheduler::ClientId   client{ RenderScheduler::InvalidClient };
+                    Win32EventWaiter            waiter;
+                    uint64_t                    lastPresentNs{};
+
+                    bool Running()
+                    {
+                        return thd.joinable() || client != RenderScheduler::InvalidClient;
+                    }
+
+                    void Kick()
+                    {
+                        if (client != RenderScheduler::InvalidClient)
+                            scheduler->Request(client);
+                        else
+                            startSemaphore.release();
+                    }
 
                     void WMClose()
                     {
+                        if (client != RenderScheduler::InvalidClient) {
+                            // Waits for the frame on the render thread.
+                            exitReq.store(true);
+                            scheduler->Unregister(client);
+                            client = RenderScheduler::InvalidClient;
+                            return;
+                        }
                         if (!thd.joinable())
                             return;
 
                         // Try to join the render thread before closing the window.
                         exitReq.store(true);
                         startSemaphore.release();
-                        if (finishSemaphore.try_acquire_for(std::chrono::seconds(3))) {
+                        if (Clock::Get().TryAcquireForNs(finishSemaphore, 3'000'000'000)) {
                             thd.join();
                             if (!sts) {
                                 Log(L"Present thread returned false after receiving WM_CLOSE\n");
@@ -1612,33 +2856,60 @@ public:
                     {
                         if (!busy)
                             return;
-                        if (!thd.joinable())
+                        if (!Running())
                             return;
 
                         if (!finishSemaphore.try_acquire())
                             return;
 
                         // update the last present time.
-                        lastPresent = std::chrono::high_resolution_clock::now();
+                        lastPresentNs = Clock::Get().NowNs();
                         busy = false;
                     }
                 } presentCtx;
-                presentCtx.thd = std::thread([&]() {
-                    SetThreadDescription(GetCurrentThread(), L"Present Thread");
-                    for (;;) {
-                        presentCtx.startSemaphore.acquire();
-                        if (presentCtx.exitReq.load()) {
-                            presentCtx.finishSemaphore.release();
-                            break;
-                        }
+                if (!presentCtx.waiter.Init()) {
+                    Log(L"Failed to create the window loop waiter.");
+                    return;
+                }
+                ScopeGuard waiterGuard([&presentCtx] { presentCtx.waiter.Terminate(); });
+
+                // The frame function of a render thread client refers to this scope.
+                ScopeGuard clientGuard([&presentCtx] {
+                    if (presentCtx.client != RenderScheduler::InvalidClient) {
+                        presentCtx.scheduler->Unregister(presentCtx.client);
+                        presentCtx.client = RenderScheduler::InvalidClient;
+                    }
+                    });
+                if (inApp->renderScheduler) {
+                    presentCtx.scheduler = inApp->renderScheduler.get();
+                    presentCtx.client = presentCtx.scheduler->Register([&presentCtx, d3dctx, &hWnd]() {
                         d3dctx->Present(hWnd, presentCtx.sts);
                         presentCtx.finishSemaphore.release();
-                        if (presentCtx.exitReq.load()) {
-                            break;
+                        presentCtx.waiter.Notify(wakeupPresentFinished);
+                        }, [d3dctx]() { return d3dctx->PredictedNextVblankNs(); });
+                }
+                else {
+                    presentCtx.thd = std::thread([&]() {
+                        SetThreadDescription(GetCurrentThread(), L"Present Thread");
+                        inApp->traceExporter->SetThreadName("Present: " + ToUTF8(wname));
+                        binaryLog.SetThreadName("Present: " + ToUTF8(wname));
+                        for (;;) {
+                            presentCtx.startSemaphore.acquire();
+                            if (presentCtx.exitReq.load()) {
+                                presentCtx.finishSemaphore.release();
+                                break;
+                            }
+                            d3dctx->Present(hWnd, presentCtx.sts);
+                            presentCtx.finishSemaphore.release();
+                            presentCtx.waiter.Notify(wakeupPresentFinished);
+                            if (presentCtx.exitReq.load()) {
+                                break;
+                            }
                         }
-                    }
-                    });
-                // Register peek message callback to join the Present thread when receiving WM_CLOSE message.
+                        });
+                }
+                // Register peek message callback to join the Present thread, or unregister from the render thread, when
+                // receiving WM_CLOSE message.
                 peekMsgContainer.Register([&presentCtx](HWND h, UINT m, WPARAM w, LPARAM l) {
                     if (m == WM_CLOSE) {
                         presentCtx.WMClose();
@@ -1663,9 +2934,9 @@ public:
                     // Try to join the present thread here to catch up the latest status.
                     presentCtx.CheckFinishStatus();
 
-                    // Wait for 1ms and keep processing the Windows message loop while the Present thread is busy.
+                    // Sleep until a window message arrives or the Present thread finishes.
                     if (presentCtx.busy) {
-                        Sleep(1);
+                        presentCtx.waiter.WaitUntil(EventWaiter::NoDeadline);
                         continue;
                     }
 
@@ -1688,27 +2959,25 @@ public:
                         }
                     }
 
-                    // Check the duration from the last present.
+                    // Check the start time of the next frame.
                     {
-                        float targetDurationMs{};
-                        {
-                            std::scoped_lock<std::mutex> l{ inApp->mtx };
-                            targetDurationMs = inApp->ctx.displays.at(listIdx).threadWaitMs;
-                        }
-                        std::chrono::duration<float, std::milli> elapsedMs = std::chrono::high_resolution_clock::now() - presentCtx.lastPresent;
+                        const auto& shard{ *inApp->ctx.displays.at(listIdx).shard };
+                        const uint64_t deadlineNs{ d3dctx->NextFrameStartNs(presentCtx.lastPresentNs, shard.threadWaitMs.load()) };
 
-                        // Elapsed time is not reached to the target duration.
-                        if (elapsedMs.count() < targetDurationMs)
+                        // The start time is not reached. Sleep until the deadline or a window message.
+                        if (Clock::Get().NowNs() < deadlineNs) {
+                            presentCtx.waiter.WaitUntil(deadlineNs);
                             continue;
+                        }
                     }
 
                     // Invoking Present here.
                     presentCtx.busy = true;
-                    presentCtx.startSemaphore.release();
+                    presentCtx.Kick();
                 }
                 // End of the main loop for the window.
 
-                if (presentCtx.thd.joinable()) {
+                if (presentCtx.Running()) {
                     Log(L"Failed to??>???.");
                     return;
                 }
@@ -1730,9 +2999,7 @@ public:
         });
 
         // Wait untile the worker thread's window has been established.
-        while (thdState.load() == ThreadState::Initializing) {
-            Sleep(1);
-        }
+        thdState.wait(ThreadState::Initializing);
 
         return true;
     }
@@ -1746,6 +3013,11 @@ public:
     {
         return thdState == ThreadState::Terminated;
     }
+
+    const FrameTimeline& GetFrameTimeline()
+    {
+        return GetD3DContext_ImGuiBase()->GetFrameTimeline();
+    }
 };
 
 class ControlWindow final : public Window_Base
@@ -1806,12 +3078,8 @@ protected:
                 ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), cl.Get());
             }
 
-            {
-                std::scoped_lock<std::mutex> l{ app->mtx };
-                
-                if (app->ctx.mode != App::Context::Mode::control) {
-                    PostMessageW(hWnd, WM_CLOSE, 0, 0);
-                }
+            if (app->ctx.mode != App::Context::Mode::control) {
+                PostMessageW(hWnd, WM_CLOSE, 0, 0);
             }
         }
     } d3dCtx;
@@ -1840,174 +3108,319 @@ protected:
     {
         uint32_t logIdx{};
 
-        virtual void Render(HWND hWnd, ComPtr<ID3D12GraphicsCommandList>& cl) override
-        {
-#ifdef NVAPI_ENABLED
-            // for all windows - check PB status and update.
-            if (nvapi_PresentBarrierClientHandleCreated) {
-                std::scoped_lock<std::mutex> l{ app->mtx };
-                auto& display = app->ctx.displays.at(appListIdx);
-                auto& sts = display.nvapi_PBStats;
-                sts = { NV_PRESENT_BARRIER_FRAME_STATICS_VER1 , };
-                if (NvAPI_QueryPresentBarrierFrameStatistics(nvapi_PresentBarrierClientHandle, &sts) != NVAPI_OK) {
-                    Log("Failed to destroy Present Barrier Client.\n");
-                    sts = { NV_PRESENT_BARRIER_FRAME_STATICS_VER1 , };
-                }
+        class Vertex final {
+        public:
+            std::array<float, 4> pos;
+            std::array<float, 4> col;
+        };
 
-                if (display.nvapi_PresentBarrierMode == PresentBarrierMode::join && sts.SyncMode == PRESENT_BARRIER_NOT_JOINED) {
-                    NV_JOIN_PRESENT_BARRIER_PARAMS params{ NV_JOIN_PRESENT_BARRIER_PARAMS_VER1 , };
-                    Log("Calling JoinPresentBarrier.\n");
-                    if (NvAPI_JoinPresentBarrier(nvapi_PresentBarrierClientHandle, &params) != NVAPI_OK) {
-                        Log("Failed to call JoinPresentBarrier.\n");
-                    }
-                }
-                if (display.nvapi_PresentBarrierMode == PresentBarrierMode::leave && sts.SyncMode != PRESENT_BARRIER_NOT_JOINED) {
-                    Log("Calling LeavePresentBarrier.\n");
-                    if (NvAPI_LeavePresentBarrier(nvapi_PresentBarrierClientHandle) != NVAPI_OK) {
-                        Log("Failed to call LeavePresentBarrier.\n");
-                    }
-                }
-            }
-#endif
+        // Primary window only. A job of the frame, so it may run on a job worker.
+        void BuildUI()
+        {
+            // Start the Dear ImGui frame
+            ImGui_ImplDX12_NewFrame();
+            ImGui_ImplWin32_NewFrame();
+            ImGui::NewFrame();
 
-            // display line.
             {
-                if (!shaderAssets) {
-                    shaderAssets = std::make_unique<ShaderAssets>();
-                    bool sts = shaderAssets->Init(dev);
-                    assert(sts);
-                }
-
-                auto [ptr, gpuPtr, size] = shaderAssets->GetUploadChunk();
-                struct Vertex
-                {
-                    std::array<float, 4> pos;
-                    std::array<float, 4> col;
-                };
-                std::span<Vertex, 6>  vb(reinterpret_cast<Vertex*>(ptr), 6);
-                assert(size > vb.size_bytes());
-
-                constexpr float lineWidth{ 0.05f };
-                float linePos{};
-                {
-                    std::scoped_lock<std::mutex> l{ app->mtx };
-                    linePos = 1.0f - float(app->ctx.globalCounter % 256) / 128.f;
-                }
-
-                std::array<float, 4> col{ 0.f, 1.f, 1.f, 1.f };
-                std::array<float, 4> pos1{ -1.0f, linePos - lineWidth, 0.5f, 1.0f };
-                std::array<float, 4> pos2{ 1.0f, linePos - lineWidth, 0.5f, 1.0f };
-                std::array<float, 4> pos3{ 1.0f, linePos + lineWidth, 0.5f, 1.0f };
-                std::array<float, 4> pos4{ -1.0f, linePos + lineWidth, 0.5f, 1.0f };
-                vb[0] = { pos1, col };
-                vb[1] = { pos2, col };
-                vb[2] = { pos3, col };
-
-                vb[3] = { pos3, col };
-                vb[4] = { pos4, col };
-                vb[5] = { pos1, col };
+                std::scoped_lock<std::mutex> l{ app->mtx };
 
-                D3D12_VERTEX_BUFFER_VIEW vView{ gpuPtr, (UINT)vb.size_bytes(), sizeof(Vertex) };
-                cl->SetGraphicsRootSignature(shaderAssets->rootSig.Get());
-                cl->SetPipelineState(shaderAssets->pso.Get());
-                cl->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-                cl->IASetVertexBuffers(0, 1, &vView);
-                cl->DrawInstanced((UINT)vb.size(), 1, 0, 0);
-            }
+                ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Once);
+                ImGui::SetNextWindowSize(ImVec2(720, 480), ImGuiCond_Once);
 
-            // Display UIs - primary window only.
-            if (imInitialized) {
-                // Start the Dear ImGui frame
-                ImGui_ImplDX12_NewFrame();
-                ImGui_ImplWin32_NewFrame();
-                ImGui::NewFrame();
+                ImGui::Begin("Window Mode");
 
+                ImGui::Text("Global Counter: %llu (%s)", app->ctx.timebase.Counter(), [](TimebaseSource s) {
+                    switch (s) {
+                    case TimebaseSource::timer:
+                        return "timer";
+                    case TimebaseSource::vblank:
+                        return "vblank";
+                    case TimebaseSource::presentBarrier:
+                        return "PresentBarrier";
+                    }
+                    return "";
+                    }(app->ctx.timebase.Source()));
                 {
-                    std::scoped_lock<std::mutex> l{ app->mtx };
-
-                    ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Once);
-                    ImGui::SetNextWindowSize(ImVec2(720, 480), ImGuiCond_Once);
-
-                    ImGui::Begin("Window Mode");
-
-                    ImGui::Text("Global Counter: %d", app->ctx.globalCounter);
+                    const auto sk{ app->ctx.skew.Load() };
+                    ImGui::Text("Present Skew(ms) - p50: %6.3f, p99: %6.3f, max: %6.3f, matched: %llu, unmatched: %llu, alerts: %llu",
+                        sk.p50SkewMs, sk.p99SkewMs, sk.maxSkewMs, sk.matchedFrames, sk.unmatchedFrames, sk.alerts);
+                    const auto& idx{ app->ctx.skewDisplayIdx };
+                    if (sk.worstPairA < idx.size() && sk.worstPairB < idx.size() && sk.worstPairA != sk.worstPairB) {
+                        ImGui::Text("Worst Pair: %.3fms between [%s] and [%s]", sk.worstPairSkewMs,
+                            app->ctx.displays.at(idx[sk.worstPairA]).description.c_str(), app->ctx.displays.at(idx[sk.worstPairB]).description.c_str());
+                    }
+                }
 
-                    uint32_t idx{};
-                    for (auto& d : app->ctx.displays) {
-                        if (!d.selected)
-                            continue;
+                uint32_t idx{};
+                for (auto& d : app->ctx.displays) {
+                    if (!d.selected)
+                        continue;
 
-                        ImGui::PushID(idx++);
-                        ImGui::Text(d.description.c_str());
+                    using Command = App::Context::Display::Command;
+                    ImGui::PushID(idx++);
+                    ImGui::Text(d.description.c_str());
+                    auto& shard{ *d.shard };
+                    d.DrainAcks();
 
 #ifdef NVAPI_ENABLED
-                        {
-                            std::string pbDesc;
-                            auto& sts(d.nvapi_PBStats);
-                            pbDesc += ToStr("PBSupported: %s, ", nvapi_PresentBarrierIsSupported ? "Yes" : "No ");
-                            pbDesc += ToStr("PBHandle: %s, ", nvapi_PresentBarrierClientHandleCreated ? "Created" : "None   ");
-                            pbDesc += ToStr("SyncMode: %s, ", [](const NV_PRESENT_BARRIER_SYNC_MODE& m) -> const char* {
-                                switch (m) {
-                                case PRESENT_BARRIER_NOT_JOINED:
-                                    return "NOT_JOINED  ";
-                                case PRESENT_BARRIER_SYNC_CLIENT:
-                                    return "SYNC_CLIENT ";
-                                case PRESENT_BARRIER_SYNC_SYSTEM:
-                                    return "SYNC_SYSTEM ";
-                                case PRESENT_BARRIER_SYNC_CLUSTER:
-                                    return "SYNC_CLUSTER";
-                                }
-                                return "";
-                                }(sts.SyncMode));
-                            pbDesc += ToStr("PresentCount: %d, FlipSyncCount: %d, RefreshCount: %d",
-                                sts.PresentCount, sts.PresentInSyncCount, sts.FlipInSyncCount, sts.RefreshCount);
-                            ImGui::Text(pbDesc.c_str());
+                    {
+                        std::scoped_lock<std::mutex> pl{ shard.pbMtx };
+                        std::string pbDesc;
+                        auto& sts(shard.nvapi_PBStats);
+                        pbDesc += ToStr("PBSupported: %s, ", nvapi_PresentBarrierIsSupported ? "Yes" : "No ");
+                        pbDesc += ToStr("PBHandle: %s, ", nvapi_PresentBarrierClientHandleCreated ? "Created" : "None   ");
+                        pbDesc += ToStr("SyncMode: %s, ", [](const NV_PRESENT_BARRIER_SYNC_MODE& m) -> const char* {
+                            switch (m) {
+                            case PRESENT_BARRIER_NOT_JOINED:
+                                return "NOT_JOINED  ";
+                            case PRESENT_BARRIER_SYNC_CLIENT:
+                                return "SYNC_CLIENT ";
+                            case PRESENT_BARRIER_SYNC_SYSTEM:
+                                return "SYNC_SYSTEM ";
+                            case PRESENT_BARRIER_SYNC_CLUSTER:
+                                return "SYNC_CLUSTER";
+                            }
+                            return "";
+                            }(sts.SyncMode));
+                        pbDesc += ToStr("PresentCount: %d, PresentInSyncCount: %d, FlipInSyncCount: %d, RefreshCount: %d",
+                            sts.PresentCount, sts.PresentInSyncCount, sts.FlipInSyncCount, sts.RefreshCount);
+                        ImGui::Text(pbDesc.c_str());
+
+                        const auto& tracker{ shard.nvapi_PBTracker };
+                        const auto& rates{ tracker.GetRates() };
+                        const auto totals{ tracker.GetTotals() };
+                        ImGui::Text("PB Rates - Presents/s: %.1f, In Sync: %.1f%%, Flips Out of Sync/s: %.2f, Refreshes w/o Present/s: %.2f",
+                            rates.presentsPerSec, rates.inSyncRatio * 100.0, rates.flipsOutOfSyncPerSec, rates.refreshesWithoutPresentPerSec);
+                        ImGui::Text("PB Out of Sync - Episodes: %u, Total: %.3fs, Longest: %.3fs",
+                            totals.outOfSyncEpisodes, totals.outOfSyncNs / 1'000'000'000.0, totals.longestOutOfSyncNs / 1'000'000'000.0);
+                        if (ImGui::TreeNode("SyncMode History")) {
+                            for (auto& t : tracker.History()) {
+                                const uint64_t ms{ t.timeNs / 1'000'000 };
+                                ImGui::Text("[%02llu:%02llu:%02llu.%03llu] %s -> %s after %.3fs", ms / 3'600'000, ms / 60'000 % 60, ms / 1000 % 60, ms % 1000,
+                                    PresentBarrierStatsTracker::SyncModeName(t.from), PresentBarrierStatsTracker::SyncModeName(t.to), t.fromDurationNs / 1'000'000'000.0);
+                            }
+                            ImGui::TreePop();
                         }
+                    }
 #endif
 
-                        if (ImGui::Button("Fulscreen")) {
-                            d.windowMode = WindowMode::fullSceen;
+                    auto send = [&d](Command c) {
+                        if (!d.Send(c)) {
+                            Log("The command queue of %s is full.\n", d.description.c_str());
+                        }
+                    };
+                    auto sendWindowMode = [&send](WindowMode m) {
+                        Command c{ Command::Type::setWindowMode };
+                        c.windowMode = m;
+                        send(c);
+                    };
+                    if (ImGui::Button("Fulscreen")) {
+                        sendWindowMode(WindowMode::fullSceen);
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Borderless Windowed")) {
+                        sendWindowMode(WindowMode::borderlessWindowed);
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Windowed")) {
+                        sendWindowMode(WindowMode::windowed);
+                    }
+
+                    {
+                        const auto st{ shard.intervalStats.Load() };
+                        ImGui::Text("Present Interval(ms) - min: %6.3f, mean: %6.3f, p50: %6.3f, p99: %6.3f, p99.9: %6.3f, max: %6.3f",
+                            st.minMs, st.meanMs, st.p50Ms, st.p99Ms, st.p999Ms, st.maxMs);
+                        ImGui::Text("Jitter(ms): %6.3f, Missed Vblanks: %llu, Intervals: %llu", st.jitterMs, st.missedVblanks, st.intervals);
+                        ImGui::SameLine();
+                        if (ImGui::Button("Reset Stats")) {
+                            send({ Command::Type::resetIntervalStats });
+                        }
+                    }
+                    {
+                        const auto vb{ shard.vblank.Load() };
+                        ImGui::Text("Vblank Estimate - period: %.4fms +-%.2fns (%.4fHz), timestamp noise: %.1fus, missed: %llu, outliers: %llu, resets: %u%s",
+                            vb.periodNs / 1'000'000.0, vb.periodStdDevNs, vb.periodNs > 0.0 ? 1'000'000'000.0 / vb.periodNs : 0.0, vb.timestampNoiseNs / 1'000.0,
+                            vb.missedVblanks, vb.outliers, vb.resets, vb.converged ? "" : " (converging)");
+                        // Against the master display of the timebase.
+                        const auto& master{ app->ctx.displays.at(app->ctx.timebaseDisplayIdx) };
+                        if (&master != &d && master.selected) {
+                            const auto drift{ VblankEstimator::Compare(vb, master.shard->vblank.Load()) };
+                            ImGui::Text("Drift vs [%s] - %+.3fppm, phase offset: %.3fms%s", master.description.c_str(),
+                                drift.ppm, drift.phaseOffsetNs / 1'000'000.0, drift.significant ? ", drifting" : "");
                         }
+                    }
+
+                    auto& settings{ d.settings };
+                    {
+                        bool changed{ false };
+                        int mode{ (int)settings.frameStartMode };
+                        changed |= ImGui::RadioButton("Fixed Delay", &mode, (int)FrameStartMode::fixedDelay);
                         ImGui::SameLine();
-                        if (ImGui::Button("Borderless Windowed")) {
-                            d.windowMode = WindowMode::borderlessWindowed;
+                        changed |= ImGui::RadioButton("As Fast As Possible", &mode, (int)FrameStartMode::asFastAsPossible);
+                        ImGui::SameLine();
+                        changed |= ImGui::RadioButton("Just In Time", &mode, (int)FrameStartMode::justInTime);
+                        settings.frameStartMode = (FrameStartMode)mode;
+                        if (settings.frameStartMode == FrameStartMode::justInTime) {
+                            changed |= ImGui::SliderFloat("Target Miss Rate(%)", &settings.targetMissRatePct, 0.1f, 20.0f, "%.1f");
+                            const auto fs{ shard.frameStart.Load() };
+                            ImGui::Text("Just In Time - margin: %.3fms, frame cost: %.3fms +-%.3fms, missed: %llu / %llu (%.2f%%), age at scan out: %.3fms",
+                                fs.marginNs / 1'000'000.0, fs.costNs / 1'000'000.0, fs.costDevNs / 1'000'000.0, fs.misses, fs.frames,
+                                fs.recentMissRate * 100.0, fs.meanAgeNs / 1'000'000.0);
+                        }
+                        if (changed) {
+                            Command c{ Command::Type::setFrameStart };
+                            c.frameStartMode = settings.frameStartMode;
+                            c.targetMissRate = settings.targetMissRatePct / 100.0f;
+                            send(c);
                         }
+                    }
+                    if (settings.frameStartMode == FrameStartMode::fixedDelay && ImGui::SliderFloat("Thread Wait(ms)", &settings.threadWaitMs, 0.0f, 1000.0f)) {
+                        Command c{ Command::Type::setThreadWait };
+                        c.threadWaitMs = settings.threadWaitMs;
+                        send(c);
+                    }
+                    {
+                        bool changed{ false };
+                        int mode{ (int)settings.pacingMode };
+                        changed |= ImGui::RadioButton("Fence Pacing", &mode, (int)FramePacingMode::fence);
                         ImGui::SameLine();
-                        if (ImGui::Button("Windowed")) {
-                            d.windowMode = WindowMode::windowed;
+                        changed |= ImGui::RadioButton("Latency Waitable Pacing", &mode, (int)FramePacingMode::latencyWaitable);
+                        settings.pacingMode = (FramePacingMode)mode;
+
+                        int latency{ (int)settings.maxFrameLatency };
+                        changed |= ImGui::SliderInt("Max Frame Latency", &latency, 1, (int)PresentBackend::MAX_FRAME_LATENCY);
+                        settings.maxFrameLatency = (uint32_t)latency;
+                        int buffers{ (int)settings.backBufferCount };
+                        changed |= ImGui::SliderInt("Back Buffers", &buffers, (int)D3DContext_Base::MIN_BACK_BUFFERS, (int)D3DContext_Base::MAX_BACK_BUFFERS);
+                        settings.backBufferCount = (uint32_t)buffers;
+                        changed |= ImGui::Checkbox("Pipelined Record/Present", &settings.pipelined);
+
+                        if (changed) {
+                            Command c{ Command::Type::setPacing };
+                            c.pacingMode = settings.pacingMode;
+                            c.maxFrameLatency = settings.maxFrameLatency;
+                            c.backBufferCount = settings.backBufferCount;
+                            c.pipelined = settings.pipelined;
+                            send(c);
                         }
-
-                        ImGui::SliderFloat("Thread Wait(ms)", &d.threadWaitMs, 0.0f, 1000.0f);
+                    }
+                    {
+                        // Per configuration the display ran with, "Reset Stats" clears them.
+                        const auto t{ shard.swapChain.Load() };
+                        constexpr uint64_t minFrames{ 600 };
+                        const int best{ SwapChainConfigStats::Best(t, minFrames) };
+                        for (uint32_t i = 0; i < t.numRows; ++i) {
+                            const auto& r{ t.rows[i] };
+                            if (r.frames == 0)
+                                continue;
+                            ImGui::Text("%s %u buffers, latency %u - fps: %.3f, latency(ms) mean: %.3f, max: %.3f, missed: %llu (%.3f%%), frames: %llu%s",
+                                i == t.current ? ">" : " ", r.backBuffers, r.maxFrameLatency, r.Fps(), r.MeanLatencyMs(), r.maxLatencyNs / 1'000'000.0,
+                                r.missedVblanks, 100.0 * r.MissedRate(), r.frames, (int)i == best ? ", best" : "");
+                        }
+                    }
 
 #ifdef NVAPI_ENABLED
-                        if (ImGui::Button("Join PresentBarrier")) {
-                            d.nvapi_PresentBarrierMode = PresentBarrierMode::join;
-                            if (!nvapi_PresentBarrierIsSupported) {
-                                Log("PresentBarrier is not supported on this device.\n");
-                            }
+                    if (ImGui::Button("Join PresentBarrier")) {
+                        send({ Command::Type::joinPresentBarrier });
+                        if (!nvapi_PresentBarrierIsSupported) {
+                            Log("PresentBarrier is not supported on this device.\n");
                         }
-                        ImGui::SameLine();
-                        if (ImGui::Button("Leave PresentBarrier")) {
-                            d.nvapi_PresentBarrierMode = PresentBarrierMode::leave;
-                            if (!nvapi_PresentBarrierIsSupported) {
-                                Log("PresentBarrier is not supported on this device.\n");
-                            }
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Leave PresentBarrier")) {
+                        send({ Command::Type::leavePresentBarrier });
+                        if (!nvapi_PresentBarrierIsSupported) {
+                            Log("PresentBarrier is not supported on this device.\n");
                         }
+                    }
 #endif
-                        ImGui::PopID();
+                    {
+                        const auto& cs{ d.commandStats };
+                        ImGui::Text("Commands - sent: %u, acked: %u, failed: %u, latency(ms) last: %.3f, max: %.3f",
+                            cs.sent, cs.acked, cs.failed, cs.lastLatencyMs, cs.maxLatencyMs);
                     }
+                    if (auto& batcher{ app->adapters.at(d.adapterIdx)->submitBatcher }; batcher && batcher->Enabled()) {
+                        // Shared by the windows on the adapter.
+                        const auto bs{ batcher->GetStats() };
+                        ImGui::Text("Batched Submit - submissions: %llu, lists/submission: %.2f, max: %llu, expired: %llu",
+                            bs.batches, bs.batches > 0 ? (double)bs.items / bs.batches : 0.0, bs.maxItems, bs.expired);
+                    }
+                    ImGui::PopID();
+                }
 
-                    if (ImGui::Button("Exit")) {
-                        app->ctx.mode = App::Context::Mode::exit;
+                if (ImGui::Button("Exit")) {
+                    app->ctx.mode = App::Context::Mode::exit;
+                    for (auto& d : app->ctx.displays) {
+                        if (d.selected)
+                            d.Send({ App::Context::Display::Command::Type::quit });
                     }
+                }
 
-                    ImGui_AddLogText(logIdx);
+                ImGui_AddLogText(logIdx);
 
-                    ImGui::End();
-                }
+                ImGui::End();
+            }
 
-                // Rendering
-                ImGui::Render();
+            ImGui::Render();
+        }
+
+        // A job of the frame.
+        static void BuildLine(std::span<Vertex, 6> vb, float linePos)
+        {
+            constexpr float lineWidth{ 0.05f };
+            std::array<float, 4> col{ 0.f, 1.f, 1.f, 1.f };
+            std::array<float, 4> pos1{ -1.0f, linePos - lineWidth, 0.5f, 1.0f };
+            std::array<float, 4> pos2{ 1.0f, linePos - lineWidth, 0.5f, 1.0f };
+            std::array<float, 4> pos3{ 1.0f, linePos + lineWidth, 0.5f, 1.0f };
+            std::array<float, 4> pos4{ -1.0f, linePos + lineWidth, 0.5f, 1.0f };
+            vb[0] = { pos1, col };
+            vb[1] = { pos2, col };
+            vb[2] = { pos3, col };
+
+            vb[3] = { pos3, col };
+            vb[4] = { pos4, col };
+            vb[5] = { pos1, col };
+        }
+
+        virtual void Render(HWND hWnd, ComPtr<ID3D12GraphicsCommandList>& cl) override
+        {
+            // The UI and the vertices are built by jobs of this frame, the commands get recorded once they are done.
+            // Without job workers they run right here.
+            auto& jobs{ app->jobSystem };
+            if (imInitialized) {
+                jobs.Run(frameJobs, [this] { BuildUI(); });
+            }
+
+            // display line.
+            // The same for every display recording after the same tick of the master clock.
+            const uint64_t globalCounter{ app->ctx.timebase.CounterNear(recording.recordStartNs) };
+            const float linePos{ 1.0f - float(globalCounter % 256) / 128.f };
+            recording.globalCounter = globalCounter;
+
+            auto [ptr, gpuPtr, size] = vertexUploads.Allocate(sizeof(Vertex) * 6, 16, presentBackend, recording.fenceValue);
+            std::span<Vertex, 6> vb(reinterpret_cast<Vertex*>(ptr), 6);
+            if (ptr == 0) {
+                Log("Failed to allocate a vertex buffer from the upload heap.\n");
+            }
+            else {
+                assert(size >= vb.size_bytes());
+                jobs.Run(frameJobs, [vb, linePos] { BuildLine(vb, linePos); });
+            }
+
+            jobs.Wait(frameJobs);
+
+            if (ptr != 0) {
+                D3D12_VERTEX_BUFFER_VIEW vView{ gpuPtr, (UINT)vb.size_bytes(), sizeof(Vertex) };
+                cl->SetGraphicsRootSignature(shaderAssets->rootSig.Get());
+                cl->SetPipelineState(shaderAssets->pso.Get());
+                cl->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                cl->IASetVertexBuffers(0, 1, &vView);
+                cl->DrawInstanced((UINT)vb.size(), 1, 0, 0);
+            }
+
+            // Display UIs - primary window only.
+            if (imInitialized) {
                 auto descHeaps{ imDescHeap.Get() };
                 cl->SetDescriptorHeaps(1, &descHeaps);
 
@@ -2016,26 +3429,8 @@ protected:
 
             // read app's states - for all windows.
             {
-                App::Context::Mode  appMode{};
-                WindowMode          wMode{};
-                {
-                    std::scoped_lock<std::mutex> l{ app->mtx };
-
-                    if (internalWindowModeChange) {
-                        // Window mode change event happened.
-                        app->ctx.displays.at(appListIdx).windowMode = requestedWindowMode;
-                        internalWindowModeChange = false;
-                    }
-                    appMode = app->ctx.mode;
-                    wMode = app->ctx.displays.at(appListIdx).windowMode;
-                }
-
-                if (requestedWindowMode == currentWindowMode) {
-                    // Window mode state transition has been completed now so that it can accept the request.
-                    requestedWindowMode = wMode;
-                }
-
-                if (appMode != App::Context::Mode::test) {
+                // The app leaves the test mode without a quit command when another window failed to start.
+                if (quitRequested || app->ctx.mode != App::Context::Mode::test) {
                     PostMessageW(hWnd, WM_CLOSE, 0, 0);
                 }
             }
@@ -2054,26 +3449,161 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
     UNREFERENCED_PARAMETER(nCmdShow);
 
 #if defined(_DEBUG)
-    {
-        FILE* fp;
+    OpenConsole();
+#endif
 
-        AllocConsole();
-        freopen_s(&fp, "CONIN$", "r", stdin);
-        freopen_s(&fp, "CONOUT$", "w", stdout);
-        freopen_s(&fp, "CONOUT$", "w", stderr);
+    std::vector<std::wstring> args;
+    {
+        std::wistringstream ss{ lpCmdLine };
+        for (std::wstring a; ss >> a;)
+            args.push_back(a);
     }
+
+    // Run headless simulations instead of opening windows. "-simulate [scenario]"
+    if (!args.empty() && args[0] == L"-simulate") {
+#if !defined(_DEBUG)
+        OpenConsole();
 #endif
+        bool sts = Simulation::Run(args.size() > 1 ? ToUTF8(args[1]) : "", [](const std::string& s) { Log("%s", s.c_str()); });
+        return sts ? 0 : 1;
+    }
+
+    // Keep compiled pipelines across launches. "-pipelineCache <path>" to choose the files, "-pipelineCache none" to
+    // compile every time.
+    std::filesystem::path pipelineCachePath{ std::filesystem::temp_directory_path() / "PresentBarrierTest_pipelines" };
+    if (auto itr = std::find(args.begin(), args.end(), L"-pipelineCache"); itr != args.end() && std::next(itr) != args.end()) {
+        pipelineCachePath = *std::next(itr) == L"none" ? std::filesystem::path{} : std::filesystem::path{ *std::next(itr) };
+    }
 
     auto app = std::make_shared<App>();
-    if (!app->Init(hInstance)) {
+    if (!app->Init(hInstance, pipelineCachePath)) {
         Log(L"Failed to init the application.");
         return 1;
     }
 
+    // Stream a Chrome trace of the present path. "-trace <file>"
+    app->traceExporter->SetThreadName("Main");
+    binaryLog.SetThreadName("Main");
+    if (auto itr = std::find(args.begin(), args.end(), L"-trace"); itr != args.end()) {
+        if (std::next(itr) == args.end() || !app->traceExporter->Open(ToUTF8(*std::next(itr)))) {
+            Log("Failed to open the trace file.\n");
+        }
+    }
+
+    // Record the log in binary form for long runs. "-binlog <file>"
+    if (auto itr = std::find(args.begin(), args.end(), L"-binlog"); itr != args.end()) {
+        if (std::next(itr) == args.end() || !binaryLog.Open(ToUTF8(*std::next(itr)))) {
+            Log("Failed to open the binary log file.\n");
+        }
+        else {
+            LogText("Logging to %s. Decode it with tools/BinaryLogDecoder.\n", ToUTF8(*std::next(itr)).c_str());
+        }
+    }
+
+    // Master clock of the rendered globalCounter. "-timebase timer[:<hz>]", "-timebase vblank" (the default) or
+    // "-timebase pb", the vblank and PresentBarrier sources follow the first selected display.
+    if (auto itr = std::find(args.begin(), args.end(), L"-timebase"); itr != args.end() && std::next(itr) != args.end()) {
+        const std::wstring& src{ *std::next(itr) };
+        if (src.starts_with(L"timer")) {
+            app->ctx.timebaseSource = TimebaseSource::timer;
+            if (src.size() > 6 && src[5] == L':') {
+                app->ctx.timerHz = (uint32_t)std::clamp(wcstoul(src.c_str() + 6, nullptr, 10), 1ul, 1000ul);
+            }
+        }
+        else if (src == L"vblank") {
+            app->ctx.timebaseSource = TimebaseSource::vblank;
+        }
+        else if (src == L"pb") {
+            app->ctx.timebaseSource = TimebaseSource::presentBarrier;
+        }
+        else {
+            Log(L"Unknown timebase %s.\n", src.c_str());
+        }
+    }
+
+    // Batch the submissions of the windows on each adapter, waiting up to us microseconds for all of them. "-batchSubmit <us>"
+    if (auto itr = std::find(args.begin(), args.end(), L"-batchSubmit"); itr != args.end() && std::next(itr) != args.end()) {
+        const auto us{ std::chrono::microseconds(std::min(wcstoul(std::next(itr)->c_str(), nullptr, 10), 100'000ul)) };
+        if (us.count() > 0) {
+            Log("Batching the submissions of the windows on each adapter, collecting for up to %lldus.\n", (long long)us.count());
+            for (auto& a : app->adapters) {
+                a->EnableBatchedSubmit(us);
+            }
+        }
+    }
+
+    // Run the per-frame jobs of the windows on n workers. "-jobWorkers <n>"
+    if (auto itr = std::find(args.begin(), args.end(), L"-jobWorkers"); itr != args.end() && std::next(itr) != args.end()) {
+        const uint32_t n{ (uint32_t)std::min(wcstoul(std::next(itr)->c_str(), nullptr, 10), 64ul) };
+        if (n > 0) {
+            Log("Running the frame jobs on %u workers.\n", n);
+            app->jobSystem.Start(n, [app = app.get()](uint32_t idx) {
+                SetThreadDescription(GetCurrentThread(), L"Job Worker");
+                app->traceExporter->SetThreadName(ToStr("Job Worker %u", idx));
+                binaryLog.SetThreadName(ToStr("Job Worker %u", idx));
+                });
+        }
+    }
+
+    bool emulatedPresentBarrier{ false };
+#ifdef NVAPI_ENABLED
+    if (std::find(args.begin(), args.end(), L"-emulatePresentBarrier") != args.end()) {
+        Log("Using the software PresentBarrier emulator.\n");
+        app->pbEmulator = std::make_unique<PresentBarrierEmulator>();
+        emulatedPresentBarrier = true;
+    }
+#endif
+
+    // Drive every window from n shared render threads instead of a present thread per window. "-renderThreads <n>"
+    // Not with the emulated PresentBarrier, which blocks the present of a window until the others arrive: the windows
+    // sharing a render thread only get to present after it returns, so every frame would time out.
+    if (auto itr = std::find(args.begin(), args.end(), L"-renderThreads"); itr != args.end() && std::next(itr) != args.end()) {
+        const uint32_t n{ (uint32_t)std::min(wcstoul(std::next(itr)->c_str(), nullptr, 10), 64ul) };
+        if (n > 0 && emulatedPresentBarrier) {
+            Log("-renderThreads is ignored with -emulatePresentBarrier, the windows sharing a render thread would wait for each other in the barrier until it times out. Using a present thread per window.\n");
+        }
+        else if (n > 0) {
+            Log("Driving the windows from %u render threads.\n", n);
+            app->renderScheduler = std::make_unique<RenderScheduler>();
+            app->renderScheduler->Start(n, [app = app.get()](uint32_t idx) {
+                SetThreadDescription(GetCurrentThread(), L"Render Thread");
+                app->traceExporter->SetThreadName(ToStr("Render %u", idx));
+                binaryLog.SetThreadName(ToStr("Render %u", idx));
+                });
+        }
+    }
+
+    // Record each frame on a separate thread while the previous one is presented, on every display. "-pipelined"
+    const bool pipelined{ std::find(args.begin(), args.end(), L"-pipelined") != args.end() };
+
+    // Swap chain of every display. "-backBuffers <2-4>" and "-maxFrameLatency <1-16>", both 2 by default.
+    App::Context::Display::Settings swapChainSettings;
+    if (auto itr = std::find(args.begin(), args.end(), L"-backBuffers"); itr != args.end() && std::next(itr) != args.end()) {
+        swapChainSettings.backBufferCount = std::clamp((uint32_t)wcstoul(std::next(itr)->c_str(), nullptr, 10), D3DContext_Base::MIN_BACK_BUFFERS, D3DContext_Base::MAX_BACK_BUFFERS);
+    }
+    if (auto itr = std::find(args.begin(), args.end(), L"-maxFrameLatency"); itr != args.end() && std::next(itr) != args.end()) {
+        swapChainSettings.maxFrameLatency = std::clamp((uint32_t)wcstoul(std::next(itr)->c_str(), nullptr, 10), 1u, PresentBackend::MAX_FRAME_LATENCY);
+    }
+
+    // Start the frames of every display as late as their next vblank allows, missing up to the target rate of them.
+    // "-justInTime [<target miss %>]"
+    bool justInTime{ false };
+    float targetMissRatePct{ App::Context::Display::Settings{}.targetMissRatePct };
+    if (auto itr = std::find(args.begin(), args.end(), L"-justInTime"); itr != args.end()) {
+        justInTime = true;
+        if (std::next(itr) != args.end()) {
+            wchar_t* end{};
+            const float pct{ wcstof(std::next(itr)->c_str(), &end) };
+            if (end != std::next(itr)->c_str()) {
+                targetMissRatePct = std::clamp(pct, 0.1f, 20.0f);
+            }
+        }
+        Log("Starting the frames just in time, target miss rate %.1f%%.\n", targetMissRatePct);
+    }
+
     // Display list.
     for (size_t aIdx = 0; aIdx < app->adapters.size(); ++aIdx) {
         const auto& adapter{ app->adapters[aIdx] };
@@ -2085,7 +3615,14 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
             auto desc = ToStr("GPU:%s - Monitor:%s [%d x %d][%d / %d]", ToUTF8(adapterDesc.Description).c_str(), ToUTF8(output.desc.DeviceName).c_str(),
                 output.currentModeDesc.Width, output.currentModeDesc.Height, output.currentModeDesc.RefreshRate.Denominator, output.currentModeDesc.RefreshRate.Numerator);
 
-            app->ctx.displays.push_back({ false, WindowMode::windowed, (uint32_t)aIdx, (uint32_t)mIdx, desc });
+            app->ctx.displays.push_back({ false, (uint32_t)aIdx, (uint32_t)mIdx, desc });
+            app->ctx.displays.back().settings.pipelined = pipelined;
+            app->ctx.displays.back().settings.backBufferCount = swapChainSettings.backBufferCount;
+            app->ctx.displays.back().settings.maxFrameLatency = swapChainSettings.maxFrameLatency;
+            if (justInTime) {
+                app->ctx.displays.back().settings.frameStartMode = FrameStartMode::justInTime;
+                app->ctx.displays.back().settings.targetMissRatePct = targetMissRatePct;
+            }
         }
     }
 
@@ -2101,8 +3638,35 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
             w.WaitForFinished();
         }
         if (app->ctx.mode == App::Context::Mode::test) {
+            // The first selected display is the master of the timebase.
+            ComPtr<IDXGIOutput6> masterOutput;
+            {
+                auto& ctx{ app->ctx };
+                auto itr = std::find_if(ctx.displays.begin(), ctx.displays.end(), [](auto& d) { return d.selected; });
+                uint64_t periodNs{ 1'000'000'000 / std::max(ctx.timerHz, 1u) };
+                auto source{ ctx.timebaseSource };
+                if (itr != ctx.displays.end() && source != TimebaseSource::timer) {
+                    const auto& o{ app->adapters.at(itr->adapterIdx)->outputs.at(itr->outputIdx) };
+                    const auto& rate{ o.currentModeDesc.RefreshRate };
+                    if (rate.Numerator > 0) {
+                        periodNs = (uint64_t)(1'000'000'000.0 * rate.Denominator / rate.Numerator);
+                    }
+                    masterOutput = o.dxgiOut;
+                    ctx.timebaseDisplayIdx = (uint32_t)(itr - ctx.displays.begin());
+                }
+#ifndef NVAPI_ENABLED
+                if (source == TimebaseSource::presentBarrier) {
+                    Log("The PresentBarrier timebase needs NvAPI, using the vblanks instead.\n");
+                    source = TimebaseSource::vblank;
+                }
+#endif
+                ctx.timebase.Configure(source, periodNs);
+            }
+
             // open test windows
             std::vector<std::unique_ptr<TestWindow>> windows;
+            std::vector<uint64_t> refreshPeriodsNs;
+            std::vector<uint32_t> windowDisplayIdx;
             uint32_t windowIdx{0};
             uint32_t listIdx{(uint32_t) -1};
             bool withImGui{ true };
@@ -2120,7 +3684,32 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                 };
                 windows.push_back(std::move(w));
                 withImGui = false;
+
+                const auto& rate{ app->adapters.at(d.adapterIdx)->outputs.at(d.outputIdx).currentModeDesc.RefreshRate };
+                refreshPeriodsNs.push_back(rate.Numerator > 0 ? (uint64_t)(1'000'000'000.0 * rate.Denominator / rate.Numerator) : 0);
+                windowDisplayIdx.push_back(listIdx);
+            }
+
+            // Correlate the presents of the windows by the globalCounter value they rendered.
+            SkewAnalyzer skew;
+            skew.Configure(refreshPeriodsNs);
+            std::vector<uint64_t> timelineCursors(windows.size());
+            std::array<FrameTimeline::Record, 64> records;
+            uint64_t loggedSkewAlerts{};
+            uint64_t loggedUnmatchedAlerts{};
+            uint64_t lastSkewLogNs{ Clock::Get().NowNs() };
+            app->ctx.skew.Store({});
+            {
+                std::scoped_lock<std::mutex> l{ app->mtx };
+                app->ctx.skewDisplayIdx = windowDisplayIdx;
+            }
+            if (masterOutput && app->ctx.timebase.Source() == TimebaseSource::vblank) {
+                Log("Timebase: vblanks of %s.\n", app->ctx.displays.at(app->ctx.timebaseDisplayIdx).description.c_str());
+            }
+            else {
+                masterOutput.Reset();
             }
+
             for (;;) {
                 bool allJoinable{ true };
                 for (auto& w : windows) {
@@ -2128,22 +3717,61 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                 }
                 if (allJoinable)
                     break;
-                {
-                    std::scoped_lock<std::mutex> l{ app->mtx };
-                    app->ctx.globalCounter++;
+
+                for (uint32_t i = 0; i < windows.size(); ++i) {
+                    uint32_t n{};
+                    while ((n = windows[i]->GetFrameTimeline().Read(timelineCursors[i], records.data(), (uint32_t)records.size())) > 0) {
+                        for (uint32_t r = 0; r < n; ++r)
+                            skew.OnPresent(i, records[r].globalCounter, records[r].presentNs);
+                    }
+                }
+                auto skewSummary = skew.Summarize();
+                if (skewSummary.alerts > loggedSkewAlerts && Clock::Get().NowNs() - lastSkewLogNs > 1'000'000'000) {
+                    if (skewSummary.unmatchedAlerts > loggedUnmatchedAlerts) {
+                        Log("Window %u renders other counters than the other windows, at counter %llu. %llu alerts so far.\n",
+                            skewSummary.lastUnmatchedWindow, skewSummary.lastAlertKey, skewSummary.alerts);
+                    }
+                    else {
+                        Log("Present skew %.3fms exceeded the threshold at counter %llu. %llu alerts so far.\n",
+                            skewSummary.lastAlertSkewMs, skewSummary.lastAlertKey, skewSummary.alerts);
+                    }
+                    loggedSkewAlerts = skewSummary.alerts;
+                    loggedUnmatchedAlerts = skewSummary.unmatchedAlerts;
+                    lastSkewLogNs = Clock::Get().NowNs();
+                }
+
+                app->ctx.skew.Store(skewSummary);
+
+                // Tick the timebase on the vblanks of the master display. The other sources only need the skew to be
+                // analyzed every few milliseconds.
+                if (masterOutput) {
+                    if (FAILED(masterOutput->WaitForVBlank())) {
+                        Log("Failed to wait for a vblank of the timebase display.\n");
+                        masterOutput.Reset();
+                    }
+                    else {
+                        app->ctx.timebase.OnTick(FrameTimeline::NowNs());
+                    }
+                }
+                else {
+                    Clock::Get().SleepForNs(5'000'000);
                 }
-                Sleep(5);
             }
             for (auto& w : windows) {
                 w->WaitForFinished();
             }
         }
-        {
-            std::scoped_lock<std::mutex> l{ app->mtx };
-            app->ctx.mode = App::Context::Mode::exit;
-        }
+        app->ctx.mode = App::Context::Mode::exit;
     }
 
+    app->traceExporter->Close();
+    if (app->traceExporter->Dropped() > 0) {
+        Log("%llu trace events were dropped.\n", app->traceExporter->Dropped());
+    }
+    binaryLog.Close();
+    if (binaryLog.Dropped() > 0) {
+        Log("%llu binary log records were dropped.\n", binaryLog.Dropped());
+    }
     app->Terminate();
 
     return 0;
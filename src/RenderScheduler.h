@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+// Runs the frames of every window on a small fixed pool of render threads, instead of a present thread per window.
+// Each client is bound to one render thread when it registers. A window thread requests the next frame of its client,
+// and the render thread runs the requested frame whose display has the earliest predicted vblank first, so one thread
+// drives the swap chains round-robin in scan out order.
+class RenderScheduler final
+{
+public:
+    using ClientId = uint32_t;
+    static constexpr ClientId InvalidClient{ UINT32_MAX };
+
+    using FrameFunc = std::function<void()>;
+    // Predicted next vblank of the client's display, on a clock shared by the clients. Called under the thread's lock.
+    using VblankFunc = std::function<uint64_t()>;
+
+private:
+    class Client final {
+    public:
+        ClientId    id{};
+        FrameFunc   frame;
+        VblankFunc  nextVblank;
+        bool        requested{ false };
+    };
+
+    class Worker final {
+    public:
+        std::mutex              mtx;
+        std::condition_variable cv;
+        std::list<Client>       clients;
+        ClientId                running{ InvalidClient };
+        bool                    exitReq{ false };
+        std::thread             thd;
+    };
+
+    std::vector<std::unique_ptr<Worker>>    workers;
+    std::mutex                              registerMtx;
+    uint32_t                                nextSeq{};
+
+    // The id carries the index of its render thread.
+    Worker& WorkerOf(ClientId id)
+    {
+        return *workers[id % workers.size()];
+    }
+
+    static void WorkerLoop(Worker& w)
+    {
+        std::unique_lock<std::mutex> l{ w.mtx };
+        for (;;) {
+            w.cv.wait(l, [&w] {
+                return w.exitReq || std::any_of(w.clients.begin(), w.clients.end(), [](auto& c) { return c.requested; });
+                });
+            if (w.exitReq)
+                break;
+
+            Client* next{};
+            uint64_t nextVblankNs{};
+            for (auto& c : w.clients) {
+                if (!c.requested)
+                    continue;
+                const uint64_t v{ c.nextVblank ? c.nextVblank() : 0 };
+                if (next == nullptr || v < nextVblankNs) {
+                    next = &c;
+                    nextVblankNs = v;
+                }
+            }
+            next->requested = false;
+            w.running = next->id;
+
+            // The client stays in the list until its frame returns, see Unregister.
+            l.unlock();
+            next->frame();
+            l.lock();
+            w.running = InvalidClient;
+            w.cv.notify_all();
+        }
+    }
+
+public:
+    RenderScheduler() = default;
+    RenderScheduler(const RenderScheduler&) = delete;
+    RenderScheduler& operator=(const RenderScheduler&) = delete;
+
+    ~RenderScheduler()
+    {
+        Stop();
+    }
+
+    // onStart runs first on each render thread with its index, e.g. to name it.
+    bool Start(uint32_t numThreads, std::function<void(uint32_t)> onStart = {})
+    {
+        if (!workers.empty() || numThreads == 0)
+            return false;
+        for (uint32_t i = 0; i < numThreads; ++i)
+            workers.push_back(std::make_unique<Worker>());
+        for (uint32_t i = 0; i < numThreads; ++i) {
+            Worker& w{ *workers[i] };
+            w.thd = std::thread([&w, i, onStart]() {
+                if (onStart)
+                    onStart(i);
+                WorkerLoop(w);
+                });
+        }
+        return true;
+    }
+
+    // The clients should be unregistered first, their pending requests are dropped.
+    void Stop()
+    {
+        for (auto& w : workers) {
+            {
+                std::scoped_lock<std::mutex> l{ w->mtx };
+                w->exitReq = true;
+            }
+            w->cv.notify_all();
+        }
+        for (auto& w : workers) {
+            if (w->thd.joinable())
+                w->thd.join();
+        }
+        workers.clear();
+    }
+
+    uint32_t NumThreads() const
+    {
+        return (uint32_t)workers.size();
+    }
+
+    // Binds the client to the render thread with the fewest clients.
+    ClientId Register(FrameFunc frame, VblankFunc nextVblank)
+    {
+        if (workers.empty())
+            return InvalidClient;
+
+        std::scoped_lock<std::mutex> rl{ registerMtx };
+        uint32_t wIdx{};
+        size_t fewest{ SIZE_MAX };
+        for (uint32_t i = 0; i < workers.size(); ++i) {
+            std::scoped_lock<std::mutex> l{ workers[i]->mtx };
+            if (workers[i]->clients.size() < fewest) {
+                fewest = workers[i]->clients.size();
+                wIdx = i;
+            }
+        }
+        const ClientId id{ nextSeq++ * (uint32_t)workers.size() + wIdx };
+        Worker& w{ *workers[wIdx] };
+        std::scoped_lock<std::mutex> l{ w.mtx };
+        w.clients.push_back({ id, std::move(frame), std::move(nextVblank) });
+        return id;
+    }
+
+    // Drops a pending request, and waits for the frame of the client if one is running.
+    void Unregister(ClientId id)
+    {
+        if (id == InvalidClient || workers.empty())
+            return;
+        Worker& w{ WorkerOf(id) };
+        std::unique_lock<std::mutex> l{ w.mtx };
+        w.cv.wait(l, [&w, id] { return w.running != id; });
+        w.clients.remove_if([id](auto& c) { return c.id == id; });
+    }
+
+    // Window thread: run one frame of the client. Requests until the frame starts count once.
+    void Request(ClientId id)
+    {
+        Worker& w{ WorkerOf(id) };
+        {
+            std::scoped_lock<std::mutex> l{ w.mtx };
+            auto itr = std::find_if(w.clients.begin(), w.clients.end(), [id](auto& c) { return c.id == id; });
+            if (itr == w.clients.end())
+                return;
+            itr->requested = true;
+        }
+        w.cv.notify_all();
+    }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+// A value published by a single writer and read by any number of threads without a lock. The writer never waits, and
+// a reader retries when the value changed while it was copied, so reads of a value which rarely changes cost a couple
+// of loads. The value is kept in atomic words, so a torn copy is discarded instead of being a data race.
+template <typename T>
+class alignas(64) SeqLocked final
+{
+    static_assert(std::is_trivially_copyable_v<T>, "The value is copied word by word.");
+
+    static constexpr size_t NumWords{ (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t) };
+
+    std::atomic<uint32_t>                       seq{};      // Odd while the writer is copying.
+    std::array<std::atomic<uint64_t>, NumWords> words{};
+
+public:
+    SeqLocked()
+    {
+        Store(T{});
+    }
+
+    explicit SeqLocked(const T& v)
+    {
+        Store(v);
+    }
+
+    SeqLocked(const SeqLocked&) = delete;
+    SeqLocked& operator=(const SeqLocked&) = delete;
+
+    // A single writer, or writers serialized by the caller.
+    void Store(const T& v)
+    {
+        std::array<uint64_t, NumWords> tmp{};
+        memcpy(tmp.data(), &v, sizeof(T));
+
+        const uint32_t s{ seq.load(std::memory_order_relaxed) };
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < NumWords; ++i)
+            words[i].store(tmp[i], std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    // Any thread.
+    T Load() const
+    {
+        std::array<uint64_t, NumWords> tmp;
+        for (;;) {
+            const uint32_t s{ seq.load(std::memory_order_acquire) };
+            if (s & 1) {
+                // The writer may have been preempted in the middle of the copy.
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < NumWords; ++i)
+                tmp[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == s)
+                break;
+        }
+        T v;
+        memcpy((void*)&v, tmp.data(), sizeof(T));
+        return v;
+    }
+
+    // Changes with every Store.
+    uint32_t Version() const
+    {
+        return seq.load(std::memory_order_acquire) >> 1;
+    }
+};
@@ -0,0 +1,2414 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdarg>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <random>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <filesystem>
+#include <semaphore>
+#include <barrier>
+#include <condition_variable>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "Clock.h"
+#include "PresentBackend.h"
+#include "FrameLoop.h"
+#include "PresentBarrierEmulator.h"
+#include "PresentBarrierStatsTracker.h"
+#include "EventWaiter.h"
+#include "FrameTimeline.h"
+#include "IntervalStats.h"
+#include "SkewAnalyzer.h"
+#include "LogRing.h"
+#include "BinaryLog.h"
+#include "SeqLock.h"
+#include "SpscRing.h"
+#include "FenceRingAllocator.h"
+#include "PipelineCacheStore.h"
+#include "FramePipeline.h"
+#include "RenderScheduler.h"
+#include "JobSystem.h"
+#include "SubmissionBatcher.h"
+#include "Timebase.h"
+#include "VblankEstimator.h"
+#include "FrameStartScheduler.h"
+#include "SwapChainConfigStats.h"
+
+// Headless counterpart of a test window: the FrameLoop of Window_Base and D3DContext_Base::Present, driven on a
+// SimulatedPresentBackend. The window only supplies the cost of recording a frame and the virtual time.
+class SimulatedWindow final : public FrameLoop::Steps
+{
+public:
+    class Config final {
+    public:
+        SimulatedPresentBackend::Config backend;
+        FrameStartMode  frameStartMode{ FrameStartMode::fixedDelay };
+        float       threadWaitMs{};
+        FrameStartScheduler::Config justInTime;
+        uint64_t    recordNs{ 500'000 };    // CPU time to record a frame.
+        uint64_t    recordJitterNs{};       // Mean of an exponentially distributed extra recording time.
+        uint64_t    seed{ 1 };
+        uint32_t    syncInterval{ 1 };
+        FramePacingMode pacingMode{ FramePacingMode::fence };
+        uint64_t    counterPeriodNs{};      // Tick of the rendered globalCounter. 0 renders the frame count.
+        const Timebase* timebase{};         // Renders its counter instead, like the test windows.
+        bool        pipelined{};            // Record ahead of the present thread on the record thread of the loop.
+        uint32_t    pipelineDepth{ 1 };     // Frames recorded ahead of the presented one, up to backBufferCount - 1.
+    };
+
+    class Result final {
+    public:
+        uint64_t    frames{};
+        uint64_t    missedVblanks{};        // Refreshes which repeated the previous frame.
+        uint64_t    presentLocks{};
+        double      minIntervalMs{};
+        double      meanIntervalMs{};
+        double      maxIntervalMs{};
+        double      meanLatencyMs{};        // Record start, where input gets sampled, to scan out.
+        double      simulatedSec{};
+    };
+
+    SimulatedPresentBackend backend;
+    FrameLoop               loop;
+    FrameTimeline           timeline;
+    SwapChainConfigStats    swapChainStats;
+
+private:
+    Config      cfg;
+    uint64_t    lastPresentNs{};
+    uint64_t    frameStartNs{};         // Record start of the frame being presented.
+    uint64_t    lastFlipNs{};
+    Result      res;
+    double      sumIntervalMs{};
+    double      sumLatencyMs{};
+    std::mt19937_64 rng;                // Used by the thread which records.
+
+    // Pipelined: the present thread publishes the fence values it signals and when the GPU reaches them, the record
+    // thread waits for them like D3DContext_Base::WaitForRecordStart waits on the fence.
+    std::mutex                  signalMtx;
+    std::condition_variable     signalCv;
+    std::deque<std::tuple<uint64_t, uint64_t>>  signals;    // value, completion time
+    // Record thread: its virtual time, and when the GPU released the back buffer of the frame to record.
+    uint64_t                    recordThreadNs{};
+    uint64_t                    recordReadyNs{};
+
+public:
+    explicit SimulatedWindow(const Config& inCfg, uint64_t startNs = 0)
+        : backend(inCfg.backend, startNs), loop(backend, *this), cfg(inCfg), rng(inCfg.seed)
+    {
+        backend.onPresent = [this](const SimulatedPresentBackend::PresentRecord& r) { OnPresent(r); };
+        VblankEstimator::Config vblankCfg;
+        vblankCfg.nominalPeriodNs = (double)backend.GetConfig().display.periodNs;
+        loop.vblankEstimator.Reset(vblankCfg);
+        loop.frameStartScheduler.Reset(cfg.justInTime);
+        loop.frameStartMode = cfg.frameStartMode;
+        loop.pacingMode = cfg.pacingMode;
+        loop.pipelined = cfg.pipelined;
+        loop.pipelineDepth = cfg.pipelineDepth;
+        loop.syncInterval = cfg.syncInterval;
+        swapChainStats.SetRefreshPeriod(backend.GetConfig().display.periodNs);
+        swapChainStats.Select(backend.BackBufferCount(), backend.GetConfig().maxFrameLatency);
+    }
+
+    ~SimulatedWindow()
+    {
+        loop.pipeline.Stop();
+    }
+
+    const Result& GetResult() const
+    {
+        return res;
+    }
+
+    // One iteration of the window loop which invokes a present.
+    bool Frame()
+    {
+        // Window thread: wait for the start of the frame.
+        for (uint64_t startNs{ loop.NextFrameStartNs(lastPresentNs, cfg.threadWaitMs) }; backend.Now() < startNs; startNs = loop.NextFrameStartNs(lastPresentNs, cfg.threadWaitMs))
+            backend.AdvanceTo(startNs);
+
+        // Present thread.
+        return loop.Present(backend.Now()) == FrameLoop::Status::ok;
+    }
+
+    // Between frames, like D3DContext_Base::CreateSwapChain resizing the buffers: drop the frames recorded ahead, drain
+    // the GPU, then resize the swap chain and set its maximum frame latency.
+    bool Rebuild(uint32_t backBufferCount, uint32_t maxFrameLatency)
+    {
+        loop.pipeline.Discard();
+        if (loop.frameSync.WaitForFence(backend) != PresentBackend::Status::ok)
+            return false;
+        if (!backend.ResizeBuffers(backBufferCount) || !backend.SetMaximumFrameLatency(maxFrameLatency))
+            return false;
+        swapChainStats.Select(backBufferCount, maxFrameLatency);
+        return true;
+    }
+
+    bool Run(uint64_t numFrames)
+    {
+        for (uint64_t i = 0; i < numFrames; ++i) {
+            if (!Frame())
+                return false;
+        }
+        return true;
+    }
+
+    virtual uint64_t NowNs() override
+    {
+        return backend.Now();
+    }
+
+    virtual bool OnPresentLock() override
+    {
+        ++res.presentLocks;
+        return true;
+    }
+
+    // Record thread: wait until the GPU is done with the frame backBufferCount presents earlier, on the signals the
+    // present thread published.
+    virtual bool WaitForRecordStart(const FrameLoop::Frame& frame, const std::atomic<bool>& cancel) override
+    {
+        const uint64_t numBuffers{ backend.BackBufferCount() };
+        recordReadyNs = 0;
+        if (frame.fenceValue <= numBuffers)
+            return true;
+        const uint64_t value{ frame.fenceValue - numBuffers };
+        std::unique_lock<std::mutex> l{ signalMtx };
+        for (;;) {
+            // The frames after this one wait for later values.
+            while (!signals.empty() && std::get<0>(signals.front()) < value)
+                signals.pop_front();
+            if (!signals.empty()) {
+                recordReadyNs = std::get<1>(signals.front());
+                return true;
+            }
+            if (cancel.load())
+                return false;
+            signalCv.wait_for(l, std::chrono::milliseconds(100));
+        }
+    }
+
+    // The record thread starts once it's free, the back buffer is released and the frame requested, on its own
+    // timeline. The present thread records on the backend's.
+    virtual bool RecordFrame(FrameLoop::Frame& frame) override
+    {
+        if (loop.pipelined) {
+            frame.recordStartNs = std::max({ frame.recordStartNs, recordThreadNs, recordReadyNs });
+            recordThreadNs = frame.recordStartNs + RecordNs();
+            frame.recordEndNs = recordThreadNs;
+        }
+        else {
+            frame.recordStartNs = backend.Now();
+            backend.Advance(RecordNs());
+            frame.recordEndNs = backend.Now();
+        }
+        frame.globalCounter = Counter(frame);
+        return true;
+    }
+
+    // Taking a frame recorded ahead waits until the record thread is done with it.
+    virtual void OnFrameWaited(const FrameLoop::Frame& frame) override
+    {
+        backend.AdvanceTo(frame.recordEndNs);
+        timeline.CompleteFence(backend.CompletedValue(), backend.Now());
+    }
+
+    virtual bool SubmitFrame(const FrameLoop::Frame& frame) override
+    {
+        frameStartNs = frame.recordStartNs;
+        timeline.BeginFrame(frame.recordStartNs, frame.globalCounter);
+        timeline.MarkSubmit(backend.Now());
+        return true;
+    }
+
+    virtual void OnPresented(const FrameLoop::Frame&, const FrameLoop::Presented& presented) override
+    {
+        if (loop.pipelined) {
+            const uint64_t value{ loop.frameSync.LastSignaledValue() };
+            {
+                std::scoped_lock<std::mutex> l{ signalMtx };
+                signals.push_back({ value, backend.CompletionTimeNs(value) });
+            }
+            signalCv.notify_all();
+        }
+        lastPresentNs = presented.presentNs;
+        timeline.MarkPresent(lastPresentNs, loop.frameSync.LastSignaledValue());
+    }
+
+private:
+    uint64_t RecordNs()
+    {
+        if (cfg.recordJitterNs == 0)
+            return cfg.recordNs;
+        return cfg.recordNs + (uint64_t)std::exponential_distribution<double>(1.0 / cfg.recordJitterNs)(rng);
+    }
+
+    // The frame count is the number of presents before the frame.
+    uint64_t Counter(const FrameLoop::Frame& frame) const
+    {
+        if (cfg.timebase != nullptr)
+            return cfg.timebase->CounterNear(frame.recordStartNs);
+        return cfg.counterPeriodNs > 0 ? frame.recordStartNs / cfg.counterPeriodNs : frame.fenceValue - 1;
+    }
+
+    void OnPresent(const SimulatedPresentBackend::PresentRecord& r)
+    {
+        const auto& display{ backend.GetConfig().display };
+
+        if (res.frames > 0) {
+            double intervalMs{ (r.flipNs - lastFlipNs) / 1'000'000.0 };
+            res.minIntervalMs = res.frames == 1 ? intervalMs : std::min(res.minIntervalMs, intervalMs);
+            res.maxIntervalMs = std::max(res.maxIntervalMs, intervalMs);
+            sumIntervalMs += intervalMs;
+            res.meanIntervalMs = sumIntervalMs / res.frames;
+
+            uint64_t refreshes{ display.VblankIndex(r.flipNs) - display.VblankIndex(lastFlipNs) };
+            if (refreshes > cfg.syncInterval)
+                res.missedVblanks += refreshes - cfg.syncInterval;
+        }
+        sumLatencyMs += (r.flipNs - frameStartNs) / 1'000'000.0;
+        swapChainStats.OnPresent(r.returnNs, loop.frameSync.LastSignaledValue() + 1, frameStartNs);
+        swapChainStats.OnFlip(loop.frameSync.LastSignaledValue() + 1, r.flipNs);
+        ++res.frames;
+        res.meanLatencyMs = sumLatencyMs / res.frames;
+        res.simulatedSec = r.flipNs / 1'000'000'000.0;
+        lastFlipNs = r.flipNs;
+    }
+};
+
+// Headless scenarios, run with "-simulate [name]" on the command line.
+namespace Simulation {
+    using Output = std::function<void(const std::string&)>;
+
+    inline std::string Format(const char* format, ...)
+    {
+        char str[1024];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(str, sizeof(str), format, args);
+        va_end(args);
+        return str;
+    }
+
+    inline std::string FormatResult(const char* name, const SimulatedWindow::Result& r, double realSec)
+    {
+        return Format("%-28s frames:%8llu interval(ms) min:%7.3f mean:%7.3f max:%7.3f missed:%6llu locks:%3llu latency:%7.3fms sim-fps:%.0f\n",
+            name, (unsigned long long)r.frames, r.minIntervalMs, r.meanIntervalMs, r.maxIntervalMs,
+            (unsigned long long)r.missedVblanks, (unsigned long long)r.presentLocks, r.meanLatencyMs,
+            realSec > 0.0 ? r.frames / realSec : 0.0);
+    }
+
+    inline bool Pacing(const Output& out)
+    {
+        struct Case {
+            const char*             name;
+            SimulatedWindow::Config cfg;
+        };
+        auto make = [](uint32_t hz, uint32_t buffers, float threadWaitMs, uint64_t gpuNs) {
+            SimulatedWindow::Config c{};
+            c.backend.display = SimulatedDisplayClock::FromRefreshRate(hz, 1);
+            c.backend.backBufferCount = buffers;
+            c.backend.maxFrameLatency = buffers;
+            c.backend.gpuFrameNs = gpuNs;
+            c.threadWaitMs = threadWaitMs;
+            return c;
+        };
+        const std::vector<Case> cases{
+            { "60Hz 2buf",              make(60, 2, 0.f, 2'000'000) },
+            { "60Hz 3buf",              make(60, 3, 0.f, 2'000'000) },
+            { "144Hz 2buf",             make(144, 2, 0.f, 2'000'000) },
+            { "60Hz 2buf wait 10ms",    make(60, 2, 10.f, 2'000'000) },
+            { "60Hz 2buf gpu 20ms",     make(60, 2, 0.f, 20'000'000) },
+        };
+
+        constexpr uint64_t numFrames{ 100'000 };
+        for (auto& c : cases) {
+            SimulatedWindow w(c.cfg);
+            auto start = std::chrono::steady_clock::now();
+            if (!w.Run(numFrames)) {
+                out(Format("%s: simulation failed.\n", c.name));
+                return false;
+            }
+            std::chrono::duration<double> realSec = std::chrono::steady_clock::now() - start;
+            out(FormatResult(c.name, w.GetResult(), realSec.count()));
+        }
+        return true;
+    }
+
+    // Throughput vs. input-to-photon latency of the pacing modes over the maximum frame latency.
+    inline bool Latency(const Output& out)
+    {
+        constexpr uint64_t numFrames{ 100'000 };
+
+        for (auto mode : { FramePacingMode::fence, FramePacingMode::latencyWaitable }) {
+            for (uint32_t latency : { 1u, 2u, 3u }) {
+                SimulatedWindow::Config c{};
+                c.backend.display = SimulatedDisplayClock::FromRefreshRate(60, 1);
+                c.backend.backBufferCount = 3;
+                c.backend.maxFrameLatency = latency;
+                c.backend.gpuFrameNs = 4'000'000;
+                c.recordNs = 2'000'000;
+                c.pacingMode = mode;
+
+                auto name = Format("%s latency %u", mode == FramePacingMode::fence ? "fence" : "waitable", latency);
+                SimulatedWindow w(c);
+                auto start = std::chrono::steady_clock::now();
+                if (!w.Run(numFrames)) {
+                    out(Format("%s: simulation failed.\n", name.c_str()));
+                    return false;
+                }
+                std::chrono::duration<double> realSec = std::chrono::steady_clock::now() - start;
+                out(FormatResult(name.c_str(), w.GetResult(), realSec.count()));
+            }
+        }
+        return true;
+    }
+
+    // Cost of the frame timeline on the present thread while a reader drains it concurrently.
+    inline bool Timeline(const Output& out)
+    {
+        constexpr uint64_t numFrames{ 10'000'000 };
+        auto timeline = std::make_unique<FrameTimeline>();
+        std::atomic<bool> done{ false };
+        uint64_t numRead{};
+        uint64_t numLost{};
+        bool ordered{ true };
+
+        std::thread reader([&]() {
+            std::array<FrameTimeline::Record, 256> records;
+            uint64_t cursor{};
+            uint64_t expected{};
+            for (;;) {
+                const bool last{ done.load() };
+                uint64_t lost{};
+                uint32_t n{ timeline->Read(cursor, records.data(), (uint32_t)records.size(), &lost) };
+                numLost += lost;
+                for (uint32_t i = 0; i < n; ++i) {
+                    ordered &= records[i].frameIdx >= expected && records[i].presentNs == records[i].frameIdx * 3;
+                    expected = records[i].frameIdx + 1;
+                }
+                numRead += n;
+                if (last && cursor == timeline->Published())
+                    break;
+                if (n == 0)
+                    std::this_thread::yield();
+            }
+            });
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t f = 0; f < numFrames; ++f) {
+            timeline->CompleteFence(f, f * 3);
+            timeline->BeginFrame(f * 3, f);
+            timeline->MarkSubmit(f * 3 + 1);
+            timeline->MarkPresent(f * 3, f + 1);
+        }
+        timeline->CompleteFence(numFrames, numFrames * 3);
+        std::chrono::duration<double> realSec = std::chrono::steady_clock::now() - start;
+        done.store(true);
+        reader.join();
+
+        out(Format("frames:%llu producer:%6.1fns/frame read:%llu lost:%llu ordered:%s\n",
+            (unsigned long long)numFrames, realSec.count() * 1'000'000'000.0 / numFrames,
+            (unsigned long long)numRead, (unsigned long long)numLost, ordered ? "yes" : "NO"));
+        return ordered && numRead + numLost == numFrames;
+    }
+
+    // Accuracy of the interval histogram against exact percentiles, merging, and the update cost.
+    inline bool Histogram(const Output& out)
+    {
+        bool sts{ true };
+        auto check = [&](bool cond, const char* what) {
+            if (!cond) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+
+        // Intervals around 60Hz with a long tail.
+        std::mt19937_64 rng{ 1234 };
+        std::normal_distribution<double> wobble{ 16'666'667.0, 150'000.0 };
+        std::uniform_int_distribution<uint32_t> missed{ 0, 999 };
+        std::vector<uint64_t> values(1'000'000);
+        for (auto& v : values)
+            v = (uint64_t)std::max(0.0, wobble(rng)) * (missed(rng) == 0 ? 2 : 1);
+
+        auto hist = std::make_unique<LogLinearHistogram>();
+        auto first = std::make_unique<LogLinearHistogram>();
+        auto second = std::make_unique<LogLinearHistogram>();
+        for (size_t i = 0; i < values.size(); ++i) {
+            hist->Record(values[i]);
+            (i < values.size() / 2 ? first : second)->Record(values[i]);
+        }
+        first->Merge(*second);
+
+        std::vector<uint64_t> sorted{ values };
+        std::sort(sorted.begin(), sorted.end());
+        for (double q : { 0.5, 0.99, 0.999 }) {
+            const uint64_t exact{ sorted[std::max<size_t>(1, (size_t)std::ceil(q * sorted.size())) - 1] };
+            const uint64_t approx{ hist->Percentile(q) };
+            const double relErr{ std::abs((double)approx - (double)exact) / exact };
+            out(Format("p%-5g exact:%10.6fms histogram:%10.6fms error:%.4f%%\n", q * 100.0, exact / 1e6, approx / 1e6, relErr * 100.0));
+            check(relErr < 1.0 / (1 << LogLinearHistogram::SubBucketBits), "percentile error over the bucket resolution");
+            check(first->Percentile(q) == approx, "merged histogram differs");
+        }
+        check(hist->Min() == sorted.front() && hist->Max() == sorted.back(), "min/max");
+        check(first->Count() == hist->Count(), "merged count");
+
+        // Missed vblank counting.
+        {
+            PresentIntervalStats stats;
+            stats.SetRefreshPeriod(16'666'667);
+            uint64_t t{};
+            for (uint32_t i = 0; i < 1000; ++i) {
+                t += (i % 100 == 99 ? 3 : 1) * 16'666'667;
+                stats.OnPresent(i % 2 ? t + 300'000 : t - 300'000);
+            }
+            auto sum = stats.Summarize();
+            check(sum.missedVblanks == 20 && sum.intervals == 999, "missed vblanks");
+            out(Format("intervals:%llu missed vblanks:%llu jitter:%.3fms\n", (unsigned long long)sum.intervals, (unsigned long long)sum.missedVblanks, sum.jitterMs));
+        }
+
+        // Update cost.
+        {
+            constexpr uint32_t numLoops{ 20 };
+            PresentIntervalStats stats;
+            stats.SetRefreshPeriod(16'666'667);
+            uint64_t t{};
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t l = 0; l < numLoops; ++l) {
+                for (auto v : values)
+                    stats.OnPresent(t += v);
+            }
+            std::chrono::duration<double> realSec = std::chrono::steady_clock::now() - start;
+            auto summarizeStart = std::chrono::steady_clock::now();
+            auto sum = stats.Summarize();
+            std::chrono::duration<double, std::micro> summarizeUs = std::chrono::steady_clock::now() - summarizeStart;
+            out(Format("OnPresent:%6.2fns/update Summarize:%7.1fus (p50 %.3fms)\n",
+                realSec.count() * 1'000'000'000.0 / (numLoops * values.size()), summarizeUs.count(), sum.p50Ms));
+        }
+        return sts;
+    }
+
+    // Skew analysis of windows running on their own simulated displays, stepped in virtual time order. A display off
+    // by more than half a tick of the timer key renders other keys than the rest and has to alert. The present count
+    // pairs each refresh with the nearest one of the other displays, so a 12ms offset at 60Hz shows as 4.667ms.
+    inline bool Skew(const Output& out)
+    {
+        bool sts{ true };
+        auto check = [&](bool cond, const char* what) {
+            if (!cond) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+        struct Case {
+            std::string             name;
+            std::vector<uint32_t>   hz;
+            std::vector<uint64_t>   phaseNs;
+            uint64_t                counterPeriodNs{ 5'000'000 };   // Frames are keyed by the present count with 0.
+        };
+        auto uniform = [](uint32_t n, uint32_t hz, uint64_t lastPhaseNs) {
+            Case c{ Format("%ux%uHz", n, hz), std::vector<uint32_t>(n, hz), std::vector<uint64_t>(n, 0) };
+            c.phaseNs.back() = lastPhaseNs;
+            return c;
+        };
+        std::vector<Case> cases{
+            uniform(8, 60, 0),
+            uniform(8, 60, 1'000'000),
+            uniform(8, 60, 12'000'000),
+            uniform(8, 60, 12'000'000),
+            { "4x60Hz+4x120Hz", { 60, 60, 60, 60, 120, 120, 120, 120 }, std::vector<uint64_t>(8, 0) },
+            uniform(32, 60, 1'000'000),
+            uniform(64, 60, 1'000'000),
+        };
+        cases[1].name += " one 1ms late";
+        cases[2].name += " one 12ms late";
+        cases[3].name += " one 12ms late, count";
+        cases[3].counterPeriodNs = 0;
+        cases[5].name += " one 1ms late";
+        cases[6].name += " one 1ms late";
+
+        constexpr double simulatedSec{ 60.0 };
+        for (auto& c : cases) {
+            const uint32_t n{ (uint32_t)c.hz.size() };
+            std::vector<std::unique_ptr<SimulatedWindow>> windows;
+            std::vector<uint64_t> periods;
+            for (uint32_t i = 0; i < n; ++i) {
+                SimulatedWindow::Config cfg{};
+                cfg.backend.display = SimulatedDisplayClock::FromRefreshRate(c.hz[i], 1, c.phaseNs[i]);
+                cfg.counterPeriodNs = c.counterPeriodNs;
+                windows.push_back(std::make_unique<SimulatedWindow>(cfg));
+                periods.push_back(cfg.backend.display.periodNs);
+            }
+            SkewAnalyzer analyzer;
+            analyzer.Configure(periods);
+
+            std::vector<uint64_t> cursors(n);
+            std::array<FrameTimeline::Record, 64> records;
+            std::chrono::duration<double> analyzeSec{};
+            uint64_t presents{};
+            for (;;) {
+                // Step the window which is the furthest behind, so the presents arrive roughly in time order.
+                auto itr = std::min_element(windows.begin(), windows.end(), [](auto& a, auto& b) { return a->backend.Now() < b->backend.Now(); });
+                if ((*itr)->backend.Now() > (uint64_t)(simulatedSec * 1e9))
+                    break;
+                if (!(*itr)->Frame()) {
+                    out(Format("%s: simulation failed.\n", c.name.c_str()));
+                    return false;
+                }
+                const uint32_t w{ (uint32_t)(itr - windows.begin()) };
+                auto start = std::chrono::steady_clock::now();
+                uint32_t m{};
+                while ((m = windows[w]->timeline.Read(cursors[w], records.data(), (uint32_t)records.size())) > 0) {
+                    for (uint32_t r = 0; r < m; ++r)
+                        analyzer.OnPresent(w, records[r].globalCounter, records[r].presentNs);
+                    presents += m;
+                }
+                analyzeSec += std::chrono::steady_clock::now() - start;
+            }
+            analyzer.Flush();
+
+            auto s = analyzer.Summarize();
+            out(Format("%-34s skew(ms) p50:%6.3f p99:%6.3f max:%6.3f matched:%6llu unmatched:%6llu alerts:%5llu worst pair:%u-%u %.3fms analyze:%5.1fns/present\n",
+                c.name.c_str(), s.p50SkewMs, s.p99SkewMs, s.maxSkewMs, (unsigned long long)s.matchedFrames, (unsigned long long)s.unmatchedFrames,
+                (unsigned long long)s.alerts, s.worstPairA, s.worstPairB, s.worstPairSkewMs,
+                presents > 0 ? analyzeSec.count() * 1e9 / presents : 0.0));
+
+            const uint64_t lastPhaseNs{ c.phaseNs.back() };
+            if (lastPhaseNs == 0) {
+                check(s.alerts == 0, "no alerts without an offset");
+            }
+            else if (lastPhaseNs == 1'000'000) {
+                check(std::abs(s.p99SkewMs - 1.0) < 0.1 && s.alerts == 0, "1ms offset measured without alerts");
+            }
+            else if (c.counterPeriodNs > 0) {
+                check(std::abs(s.p99SkewMs - 12.0) < 1.0 || (s.unmatchedAlerts > 0 && s.lastUnmatchedWindow == n - 1), "12ms offset measured or alerted");
+            }
+            else {
+                check(std::abs(s.p99SkewMs - (16.667 - 12.0)) < 0.1, "12ms offset wraps to 4.667ms on the present count");
+            }
+        }
+        return sts;
+    }
+
+    // The stats tracker fed with a synthetic 12 hour counter stream at 60Hz, starting close to the 32 bit wrap.
+    // The display drops to SYNC_CLIENT for 2.5s at 3h and for 40s at 9h, and misses every 100th refresh during the second hour.
+    inline bool PBStats(const Output& out)
+    {
+        bool sts{ true };
+        auto check = [&](bool cond, const char* what) {
+            if (!cond) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+
+        constexpr uint64_t periodNs{ 16'666'667 };
+        constexpr uint64_t hourNs{ 3'600'000'000'000 };
+        struct Episode {
+            uint64_t    beginNs;
+            uint64_t    durationNs;
+        };
+        const std::vector<Episode> episodes{ { 3 * hourNs, 2'500'000'000 }, { 9 * hourNs, 40'000'000'000 } };
+
+        PresentBarrierStatsTracker tracker;
+        tracker.SetRateWindow(10'000'000'000);
+        PresentBarrierFrameStatistics st{ 1, PresentBarrierSyncMode::syncSystem, 0xFFFF0000u, 0xFFFF0000u, 0xFFFF0000u, 0xFFFF0000u };
+        uint64_t updates{};
+        uint64_t missed{};
+        double ratesDuringSecondHour{};
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t t = 0; t < 12 * hourNs; t += periodNs) {
+            bool inSync{ true };
+            for (auto& e : episodes)
+                inSync &= !(t >= e.beginNs && t < e.beginNs + e.durationNs);
+            st.SyncMode = inSync ? PresentBarrierSyncMode::syncSystem : PresentBarrierSyncMode::syncClient;
+
+            ++st.RefreshCount;
+            if (t >= hourNs && t < 2 * hourNs && (t / periodNs) % 100 == 0) {
+                ++missed;
+            }
+            else {
+                ++st.PresentCount;
+                if (inSync) {
+                    ++st.PresentInSyncCount;
+                    ++st.FlipInSyncCount;
+                }
+            }
+            tracker.Update(st, t);
+            ++updates;
+            if (t >= hourNs + hourNs / 2 && ratesDuringSecondHour == 0.0)
+                ratesDuringSecondHour = tracker.GetRates().refreshesWithoutPresentPerSec;
+        }
+        std::chrono::duration<double> realSec = std::chrono::steady_clock::now() - start;
+
+        const auto totals{ tracker.GetTotals() };
+        const auto rates{ tracker.GetRates() };
+        out(Format("updates:%llu presents:%llu inSync:%llu flipsOutOfSync:%llu refreshesWithoutPresent:%llu resets:%u\n",
+            (unsigned long long)updates, (unsigned long long)totals.presents, (unsigned long long)totals.presentsInSync,
+            (unsigned long long)totals.flipsOutOfSync, (unsigned long long)totals.refreshesWithoutPresent, totals.counterResets));
+        out(Format("rates presents/s:%.2f inSync:%.2f%% missed/s in 2nd hour:%.3f\n", rates.presentsPerSec, rates.inSyncRatio * 100.0, ratesDuringSecondHour));
+        out(Format("out of sync episodes:%u total:%.3fs longest:%.3fs\n", totals.outOfSyncEpisodes, totals.outOfSyncNs / 1e9, totals.longestOutOfSyncNs / 1e9));
+        for (auto& tr : tracker.History()) {
+            const uint64_t ms{ tr.timeNs / 1'000'000 };
+            out(Format("  [%02llu:%02llu:%02llu.%03llu] %s -> %s after %.3fs\n",
+                (unsigned long long)(ms / 3'600'000), (unsigned long long)(ms / 60'000 % 60), (unsigned long long)(ms / 1000 % 60), (unsigned long long)(ms % 1000),
+                PresentBarrierStatsTracker::SyncModeName(tr.from), PresentBarrierStatsTracker::SyncModeName(tr.to), tr.fromDurationNs / 1e9));
+        }
+        out(Format("update:%.1fns\n", realSec.count() * 1e9 / updates));
+
+        check(totals.counterResets == 0, "counter wrap taken as a reset");
+        check(totals.refreshesWithoutPresent == missed, "refreshes without present");
+        check(totals.presents + missed == updates - 1, "present count");
+        check(totals.outOfSyncEpisodes == 2 && tracker.NumTransitions() == 4, "episodes");
+        check(std::abs(totals.longestOutOfSyncNs / 1e9 - 40.0) < 0.05 && std::abs(totals.outOfSyncNs / 1e9 - 42.5) < 0.1, "out of sync durations");
+        check(std::abs(ratesDuringSecondHour - 0.6) < 0.1, "missed refresh rate");
+
+        // A client recreated with fresh counters.
+        st = { 1, PresentBarrierSyncMode::syncSystem, 10, 10, 10, 10 };
+        tracker.Update(st, 12 * hourNs);
+        check(tracker.GetTotals().counterResets == 1, "counter reset");
+        return sts;
+    }
+
+    // CPU time and context switches of this process so far. Windows doesn't report context switches per process, they
+    // stay at UINT64_MAX there.
+    inline std::tuple<uint64_t, uint64_t> ProcessUsage()
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+            return { 0, UINT64_MAX };
+        auto toNs = [](const FILETIME& t) { return ((uint64_t)t.dwHighDateTime << 32 | t.dwLowDateTime) * 100; };
+        return { toNs(kernel) + toNs(user), UINT64_MAX };
+#else
+        rusage ru{};
+        getrusage(RUSAGE_SELF, &ru);
+        auto toNs = [](const timeval& t) { return (uint64_t)t.tv_sec * 1'000'000'000 + (uint64_t)t.tv_usec * 1'000; };
+        return { toNs(ru.ru_utime) + toNs(ru.ru_stime), (uint64_t)(ru.ru_nvcsw + ru.ru_nivcsw) };
+#endif
+    }
+
+    // Scalability of the thread-per-window model on the PresentBarrier emulator.
+    // Every client runs on its own present thread and presents as fast as the barrier releases it. One of them records
+    // for 100us before each present, the CPU time per round is what the others spend waiting for it.
+    inline bool Barrier(const Output& out)
+    {
+        constexpr uint32_t numFrames{ 2'000 };
+        constexpr auto recordDuration{ std::chrono::microseconds(100) };
+
+        for (uint32_t numClients : { 2u, 8u, 16u, 32u, 64u }) {
+            PresentBarrierEmulator emu;
+            std::vector<PresentBarrierEmulator::ClientHandle> handles;
+            for (uint32_t i = 0; i < numClients; ++i) {
+                auto h = emu.CreateClient(16'666'667);
+                if (h == PresentBarrierEmulator::InvalidHandle || emu.RegisterResources(h, 2) != PresentBarrierEmulator::Result::ok) {
+                    out("Failed to create a PresentBarrier client.\n");
+                    return false;
+                }
+                emu.Join(h);
+                handles.push_back(h);
+            }
+
+            std::atomic<uint32_t> timeouts{};
+            const uint64_t cpuStartNs{ std::get<0>(ProcessUsage()) };
+            auto start = std::chrono::steady_clock::now();
+            {
+                std::vector<std::thread> threads;
+                for (auto h : handles) {
+                    const bool recording{ h == handles.back() };
+                    threads.emplace_back([&emu, &timeouts, h, recording, recordDuration]() {
+                        for (uint32_t f = 0; f < numFrames; ++f) {
+                            if (recording)
+                                std::this_thread::sleep_for(recordDuration);
+                            if (emu.Present(h, 2000) == PresentBarrierEmulator::Result::timeout)
+                                timeouts.fetch_add(1);
+                        }
+                        emu.Leave(h);
+                        });
+                }
+                for (auto& t : threads)
+                    t.join();
+            }
+            std::chrono::duration<double> realSec = std::chrono::steady_clock::now() - start;
+            const uint64_t cpuNs{ std::get<0>(ProcessUsage()) - cpuStartNs };
+
+            PresentBarrierFrameStatistics stats{};
+            emu.QueryFrameStatistics(handles.front(), &stats);
+            out(Format("clients:%3u frames:%6u barrier rounds/s:%10.0f mean round:%8.2fus cpu/round:%8.2fus presentInSync:%6u timeouts:%u\n",
+                numClients, numFrames, numFrames / realSec.count(), realSec.count() * 1'000'000.0 / numFrames,
+                cpuNs / 1'000.0 / numFrames, stats.PresentInSyncCount, timeouts.load()));
+
+            for (auto h : handles)
+                emu.DestroyClient(h);
+        }
+        return true;
+    }
+
+    // Wake-up cost and present start jitter of the window loop: event driven wait vs. polling with 1ms sleeps.
+    // A worker plays the present thread and finishes its work 1ms after being kicked, then the loop waits for a 2ms pacing deadline.
+    inline bool Wakeup(const Output& out)
+    {
+        Clock& clock{ Clock::Get() };
+        constexpr uint32_t numFrames{ 200 };
+        constexpr auto presentDuration{ std::chrono::milliseconds(1) };
+        constexpr uint64_t threadWaitNs{ 2'000'000 };
+
+        for (bool polling : { false, true }) {
+            PortableEventWaiter waiter;
+            PortableEventWaiter kick;
+            std::atomic<bool>   busy{ false };
+            std::atomic<bool>   exitReq{ false };
+
+            std::thread presentThread([&]() {
+                for (;;) {
+                    kick.WaitUntil(EventWaiter::NoDeadline);
+                    if (exitReq.load())
+                        break;
+                    std::this_thread::sleep_for(presentDuration);
+                    busy.store(false);
+                    waiter.Notify(wakeupPresentFinished);
+                }
+                });
+
+            uint64_t wakeups{};
+            std::vector<double> lateUs;
+            uint64_t lastPresentNs{ clock.NowNs() };
+            for (uint32_t f = 0; f < numFrames;) {
+                ++wakeups;
+                if (busy.load()) {
+                    if (polling)
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    else
+                        waiter.WaitUntil(EventWaiter::NoDeadline);
+                    if (!busy.load())
+                        lastPresentNs = clock.NowNs();
+                    continue;
+                }
+                const uint64_t deadlineNs{ lastPresentNs + threadWaitNs };
+                const uint64_t nowNs{ clock.NowNs() };
+                if (nowNs < deadlineNs) {
+                    if (polling)
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    else
+                        waiter.WaitUntil(deadlineNs);
+                    continue;
+                }
+                lateUs.push_back((nowNs - deadlineNs) / 1'000.0);
+                busy.store(true);
+                kick.Notify(wakeupPresentFinished);
+                ++f;
+            }
+            exitReq.store(true);
+            kick.Notify(wakeupPresentFinished);
+            presentThread.join();
+
+            std::sort(lateUs.begin(), lateUs.end());
+            out(Format("%-14s wakeups/frame:%6.2f present start late(us) p50:%8.1f p99:%8.1f max:%8.1f\n",
+                polling ? "Sleep(1) poll" : "event driven", (double)wakeups / numFrames,
+                lateUs[lateUs.size() / 2], lateUs[lateUs.size() * 99 / 100], lateUs.back()));
+        }
+        return true;
+    }
+
+    // Per call latency of Log() from P threads: the lock-free log ring vs. formatting and writing out under a mutex.
+    // The sink stands in for printf + OutputDebugString + the UI line list and takes about 5us per line. Each thread
+    // logs a burst of 16 lines per frame, and the frames get longer with the thread count so that the lines come in at
+    // a quarter of what the sink writes out. The ring then never fills up and both write every line, a run which
+    // drops lines fails since its latencies would be the ones of failed pushes.
+    inline bool LogRingBench(const Output& out)
+    {
+        using WallClock = std::chrono::steady_clock;
+        constexpr uint32_t linesPerThread{ 2000 };
+        constexpr uint32_t linesPerFrame{ 16 };
+        constexpr auto sinkDuration{ std::chrono::microseconds(5) };
+
+        bool sts{ true };
+        for (uint32_t numThreads : { 1u, 2u, 4u, 8u, 16u }) {
+            for (bool useRing : { false, true }) {
+                std::mutex                      sinkMtx;
+                std::list<std::string>          lines;
+                std::atomic<uint64_t>           written{};
+                auto sink = [&](const char* text) {
+                    const auto end{ WallClock::now() + sinkDuration };
+                    lines.push_back(text);
+                    if (lines.size() > 20)
+                        lines.pop_front();
+                    while (WallClock::now() < end)
+                        ;
+                    written.fetch_add(1, std::memory_order_relaxed);
+                };
+
+                auto ring = std::make_unique<LogRing>();
+                if (useRing)
+                    ring->Start([&](const char* text, size_t) { sink(text); });
+
+                const auto framePeriod{ sinkDuration * (linesPerFrame * numThreads * 4) };
+                std::vector<LogLinearHistogram> hists(numThreads);
+                std::vector<std::thread> threads;
+                for (uint32_t t = 0; t < numThreads; ++t) {
+                    threads.emplace_back([&, t]() {
+                        auto frameStart{ WallClock::now() };
+                        for (uint32_t i = 0; i < linesPerThread; ++i) {
+                            const auto start{ WallClock::now() };
+                            bool accepted{ true };
+                            if (useRing) {
+                                accepted = ring->Push("Thread %u frame %u: present took %.3fms\n", t, i, 16.667);
+                            }
+                            else {
+                                std::array<char, 1024> str;
+                                snprintf(str.data(), str.size(), "Thread %u frame %u: present took %.3fms\n", t, i, 16.667);
+                                std::scoped_lock<std::mutex> l{ sinkMtx };
+                                sink(str.data());
+                            }
+                            if (accepted)
+                                hists[t].Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(WallClock::now() - start).count());
+                            // The other work of the frame.
+                            if (i % linesPerFrame == linesPerFrame - 1) {
+                                frameStart += framePeriod;
+                                std::this_thread::sleep_until(frameStart);
+                            }
+                        }
+                        });
+                }
+                for (auto& th : threads)
+                    th.join();
+                ring->Stop();
+
+                LogLinearHistogram hist;
+                for (auto& h : hists)
+                    hist.Merge(h);
+                const uint64_t total{ (uint64_t)numThreads * linesPerThread };
+                if (written.load() != total || ring->Dropped() > 0) {
+                    out(Format("FAILED: %llu lines written and %llu dropped out of %llu\n",
+                        (unsigned long long)written.load(), (unsigned long long)ring->Dropped(), (unsigned long long)total));
+                    sts = false;
+                }
+                out(Format("%2u threads %-12s Log() latency(us) p50:%8.2f p99:%8.2f max:%9.1f dropped:%llu\n",
+                    numThreads, useRing ? "lock-free" : "mutex+list",
+                    hist.Percentile(0.5) / 1e3, hist.Percentile(0.99) / 1e3, hist.Max() / 1e3, (unsigned long long)ring->Dropped()));
+            }
+        }
+        return sts;
+    }
+
+    // Cost of a Log() call formatting text into the log ring vs. recording it in the binary log, and a round trip of
+    // the binary log through BinaryLogReader.
+    inline bool BinLog(const Output& out)
+    {
+        using WallClock = std::chrono::steady_clock;
+        constexpr uint32_t numBatches{ 200 };
+        constexpr uint32_t batchSize{ 1000 };       // Fits the ring of a thread, the writer drains between batches.
+
+        bool sts{ true };
+        auto check = [&](bool cond, const char* what) {
+            if (!cond) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+
+        // Typical lines of the present thread.
+        std::vector<std::string> expected;
+        auto logLine = [&](auto&& log, uint32_t i) {
+            switch (i % 4) {
+            case 0:
+                log("Present call failed with: %d.\n", -2005270490 + (int)i);
+                break;
+            case 1:
+                log("Resizing swapchain: %d x %d -> %d x %d\n", 1920, 1080, 3840 + (int)i, 2160);
+                break;
+            case 2:
+                log("PresentBarrier back in %s at %.3fs after %.3fs out of sync.\n", "SYNC_SYSTEM", i * 0.016667, 0.5);
+                break;
+            case 3:
+                log("Present skew %.3fms exceeded the threshold at counter %llu. %llu alerts so far.\n", 1.25, (unsigned long long)i, 7ull);
+                break;
+            }
+        };
+
+        const std::filesystem::path path{ std::filesystem::temp_directory_path() / "PresentBarrierTest_binlog_sim.blog" };
+        double textNs{}, binaryNs{};
+        uint64_t textBytes{};
+        {
+            auto ring = std::make_unique<LogRing>();
+            ring->Start([](const char*, size_t) {});
+            auto binaryLog = std::make_unique<BinaryLog>();
+            check(binaryLog->Open(path.string()), "open");
+
+            WallClock::duration textTime{}, binaryTime{};
+            for (uint32_t b = 0; b < numBatches; ++b) {
+                auto start = WallClock::now();
+                for (uint32_t i = 0; i < batchSize; ++i)
+                    logLine([&](const char* format, auto... args) { ring->Push(format, args...); }, b * batchSize + i);
+                textTime += WallClock::now() - start;
+
+                start = WallClock::now();
+                for (uint32_t i = 0; i < batchSize; ++i)
+                    logLine([&](const char* format, auto... args) { binaryLog->Record(format, args...); }, b * batchSize + i);
+                binaryTime += WallClock::now() - start;
+
+                for (uint32_t i = 0; i < batchSize; ++i) {
+                    logLine([&](const char* format, auto... args) {
+                        std::array<char, 256> str;
+                        snprintf(str.data(), str.size(), format, args...);
+                        expected.push_back(str.data());
+                        textBytes += expected.back().size();
+                        }, b * batchSize + i);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(15));
+            }
+            binaryLog->Close();
+            ring->Stop();
+            check(binaryLog->Dropped() == 0, "binary log dropped records");
+            check(ring->Dropped() == 0, "log ring dropped lines");
+            textNs = std::chrono::duration<double, std::nano>(textTime).count() / expected.size();
+            binaryNs = std::chrono::duration<double, std::nano>(binaryTime).count() / expected.size();
+        }
+
+        BinaryLogReader reader;
+        check(reader.Open(path.string()), "reader open");
+        uint64_t lines{}, mismatches{};
+        for (BinaryLogReader::Line l; reader.Next(l); ++lines) {
+            if (lines >= expected.size() || l.text != expected[lines]) {
+                if (mismatches++ == 0)
+                    out(Format("line %llu: \"%s\" expected \"%s\"\n", (unsigned long long)lines, l.text.c_str(),
+                        lines < expected.size() ? expected[lines].c_str() : ""));
+            }
+        }
+        check(lines == expected.size() && mismatches == 0 && reader.Malformed() == 0, "decoded lines differ");
+        const uint64_t fileBytes{ (uint64_t)std::filesystem::file_size(path) };
+        std::filesystem::remove(path);
+
+        out(Format("text into the log ring: %7.1fns/call %6.1f bytes/line\n", textNs, (double)textBytes / expected.size()));
+        out(Format("binary log record:      %7.1fns/call %6.1f bytes/line on disk\n", binaryNs, (double)fileBytes / expected.size()));
+        out(Format("decoded %llu lines, %llu mismatches\n", (unsigned long long)lines, (unsigned long long)mismatches));
+        return sts;
+    }
+
+    // Time the present threads spend waiting for shared state per frame, with every display behind one mutex vs. per
+    // display shards with seqlocked settings and a lock-free counter. Each present thread reads its settings, publishes
+    // its statistics, updates its PresentBarrier statistics and reads the global counter every frame, its window thread
+    // reads the thread wait, the UI holds the state it shows for 200us every 16ms, and the main thread bumps the counter
+    // every 5ms.
+    inline bool Contention(const Output& out)
+    {
+        using WallClock = std::chrono::steady_clock;
+        constexpr auto duration{ std::chrono::milliseconds(500) };
+        constexpr auto framePeriod{ std::chrono::milliseconds(1) };
+        constexpr auto queryDuration{ std::chrono::microseconds(5) };     // PresentBarrier statistics query.
+        constexpr auto uiDuration{ std::chrono::microseconds(200) };
+
+        auto spin = [](WallClock::duration d) {
+            const auto end{ WallClock::now() + d };
+            while (WallClock::now() < end)
+                ;
+        };
+
+        class Settings final {
+        public:
+            float           threadWaitMs{};
+            FramePacingMode pacingMode{ FramePacingMode::fence };
+            uint32_t        maxFrameLatency{ 2 };
+        };
+        class alignas(64) Shard final {
+        public:
+            SeqLocked<Settings>                         settings;
+            SeqLocked<PresentIntervalStats::Summary>    intervalStats;
+            std::atomic<bool>                           resetIntervalStats{ false };
+            std::mutex                                  pbMtx;
+            PresentBarrierFrameStatistics               pbStats{};
+        };
+        // The state as it was, all behind one mutex.
+        class Display final {
+        public:
+            Settings                        settings;
+            PresentIntervalStats::Summary   intervalStats{};
+            bool                            resetIntervalStats{ false };
+            PresentBarrierFrameStatistics   pbStats{};
+        };
+
+        for (uint32_t numThreads : { 1u, 2u, 4u, 8u, 16u, 32u }) {
+            for (bool sharded : { false, true }) {
+                std::mutex                  globalMtx;
+                std::vector<Display>        displays(numThreads);
+                uint64_t                    lockedCounter{};
+                std::vector<std::unique_ptr<Shard>> shards;
+                for (uint32_t i = 0; i < numThreads; ++i)
+                    shards.push_back(std::make_unique<Shard>());
+                std::atomic<uint64_t>       counter{};
+                std::atomic<bool>           exitReq{ false };
+
+                // Main and UI threads.
+                std::thread mainThread([&]() {
+                    while (!exitReq.load()) {
+                        if (sharded) {
+                            counter.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        else {
+                            std::scoped_lock<std::mutex> l{ globalMtx };
+                            ++lockedCounter;
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    }
+                    });
+                std::thread uiThread([&]() {
+                    while (!exitReq.load()) {
+                        {
+                            std::scoped_lock<std::mutex> l{ globalMtx };
+                            if (sharded) {
+                                for (auto& sh : shards) {
+                                    auto st{ sh->settings.Load() };
+                                    (void)sh->intervalStats.Load();
+                                    {
+                                        std::scoped_lock<std::mutex> pl{ sh->pbMtx };
+                                        (void)sh->pbStats;
+                                    }
+                                    st.threadWaitMs += 0.001f;
+                                    sh->settings.Store(st);
+                                }
+                            }
+                            else {
+                                for (auto& d : displays)
+                                    d.settings.threadWaitMs += 0.001f;
+                            }
+                            spin(uiDuration);
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+                    }
+                    });
+
+                std::vector<LogLinearHistogram> hists(numThreads);
+                std::vector<std::thread> threads;
+                for (uint32_t t = 0; t < numThreads; ++t) {
+                    threads.emplace_back([&, t]() {
+                        Shard& sh{ *shards[t] };
+                        Display& d{ displays[t] };
+                        uint64_t frame{};
+                        const auto end{ WallClock::now() + duration };
+                        while (WallClock::now() < end) {
+                            WallClock::duration wait{};
+                            auto timed = [&wait](auto&& f) {
+                                const auto start{ WallClock::now() };
+                                f();
+                                wait += WallClock::now() - start;
+                            };
+                            ++frame;
+                            if (sharded) {
+                                // Window thread, present thread at frame start, PresentBarrier statistics, counter.
+                                timed([&]() { (void)sh.settings.Load().threadWaitMs; });
+                                timed([&]() {
+                                    (void)sh.settings.Load();
+                                    if (!sh.resetIntervalStats.exchange(false))
+                                        sh.intervalStats.Store({ frame });
+                                    });
+                                timed([&]() { sh.pbMtx.lock(); });
+                                spin(queryDuration);
+                                sh.pbStats.PresentCount = (uint32_t)frame;
+                                sh.pbMtx.unlock();
+                                timed([&]() { (void)counter.load(std::memory_order_relaxed); });
+                            }
+                            else {
+                                timed([&]() { globalMtx.lock(); });
+                                (void)d.settings.threadWaitMs;
+                                globalMtx.unlock();
+                                timed([&]() { globalMtx.lock(); });
+                                (void)d.settings;
+                                d.intervalStats = { frame };
+                                globalMtx.unlock();
+                                timed([&]() { globalMtx.lock(); });
+                                spin(queryDuration);
+                                d.pbStats.PresentCount = (uint32_t)frame;
+                                globalMtx.unlock();
+                                timed([&]() { globalMtx.lock(); });
+                                (void)lockedCounter;
+                                globalMtx.unlock();
+                            }
+                            hists[t].Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count());
+                            std::this_thread::sleep_for(framePeriod);
+                        }
+                        });
+                }
+                for (auto& th : threads)
+                    th.join();
+                exitReq.store(true);
+                mainThread.join();
+                uiThread.join();
+
+                LogLinearHistogram hist;
+                for (auto& h : hists)
+                    hist.Merge(h);
+                out(Format("%2u threads %-8s frames:%7llu wait per frame(us) mean:%8.2f p50:%8.2f p99:%8.2f max:%9.1f\n",
+                    numThreads, sharded ? "sharded" : "mutex", (unsigned long long)hist.Count(),
+                    hist.Mean() / 1e3, hist.Percentile(0.5) / 1e3, hist.Percentile(0.99) / 1e3, hist.Max() / 1e3));
+            }
+        }
+        return true;
+    }
+
+    // UI to window command queue: ordering and cost of the ring, and the click-to-effect latency when the present
+    // thread drains it once per frame at 60Hz.
+    inline bool Commands(const Output& out)
+    {
+        using WallClock = std::chrono::steady_clock;
+        bool sts{ true };
+        auto check = [&](bool cond, const char* what) {
+            if (!cond) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+
+        {
+            constexpr uint64_t numItems{ 2'000'000 };
+            auto ring = std::make_unique<SpscRing<uint64_t, 64>>();
+            uint64_t outOfOrder{};
+            auto start = WallClock::now();
+            std::thread consumer([&]() {
+                uint64_t expected{};
+                while (expected < numItems) {
+                    uint64_t v;
+                    if (!ring->TryPop(v)) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    outOfOrder += v != expected;
+                    expected = v + 1;
+                }
+                });
+            for (uint64_t i = 0; i < numItems;) {
+                if (ring->TryPush(i))
+                    ++i;
+                else
+                    std::this_thread::yield();
+            }
+            consumer.join();
+            std::chrono::duration<double, std::nano> ns = WallClock::now() - start;
+            check(outOfOrder == 0, "items out of order or lost");
+            out(Format("ring: %llu items, %.1fns/item\n", (unsigned long long)numItems, ns.count() / numItems));
+        }
+
+        {
+            class Command final {
+            public:
+                uint32_t    seq;
+                uint64_t    issuedNs;
+            };
+            class Ack final {
+            public:
+                uint32_t    seq;
+                uint64_t    latencyNs;
+            };
+            constexpr uint32_t numCommands{ 60 };
+            constexpr auto framePeriod{ std::chrono::microseconds(16'667) };
+            auto commands = std::make_unique<SpscRing<Command, 64>>();
+            auto acks = std::make_unique<SpscRing<Ack, 64>>();
+            std::atomic<bool> exitReq{ false };
+
+            std::thread presentThread([&]() {
+                auto next{ WallClock::now() };
+                while (!exitReq.load()) {
+                    for (Command c; commands->TryPop(c);)
+                        acks->TryPush({ c.seq, FrameTimeline::NowNs() - c.issuedNs });
+                    next += framePeriod;
+                    std::this_thread::sleep_until(next);
+                }
+                });
+
+            std::mt19937 rng{ 42 };
+            std::uniform_int_distribution<int> clickUs{ 0, 40'000 };
+            LogLinearHistogram latency;
+            uint32_t lastSeq{};
+            for (uint32_t i = 1; i <= numCommands; ++i) {
+                std::this_thread::sleep_for(std::chrono::microseconds(clickUs(rng)));
+                commands->TryPush({ i, FrameTimeline::NowNs() });
+                for (Ack a; acks->TryPop(a); lastSeq = a.seq)
+                    latency.Record(a.latencyNs);
+            }
+            std::this_thread::sleep_for(3 * framePeriod);
+            exitReq.store(true);
+            presentThread.join();
+            for (Ack a; acks->TryPop(a); lastSeq = a.seq)
+                latency.Record(a.latencyNs);
+
+            check(latency.Count() == numCommands && lastSeq == numCommands, "acks lost");
+            check(latency.Max() < 3 * (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(framePeriod).count(), "a command waited for more than two frames");
+            out(Format("click to effect at 60Hz(ms) p50: %.3f p99: %.3f max: %.3f\n",
+                latency.Percentile(0.5) / 1e6, latency.Percentile(0.99) / 1e6, latency.Max() / 1e6));
+        }
+        return sts;
+    }
+
+    // Upload heap ring against a GPU which completes frames one to three frames late: live allocations never overlap,
+    // are aligned, wrap around once space is reclaimed, and Allocate only fails when the free space really can't hold
+    // the request.
+    inline bool Upload(const Output& out)
+    {
+        using WallClock = std::chrono::steady_clock;
+        bool sts{ true };
+        auto check = [&](bool cond, const char* what) {
+            if (!cond && sts)
+                out(Format("FAILED: %s\n", what));
+            sts &= cond;
+        };
+
+        constexpr uint64_t capacity{ 65536 };
+        constexpr uint32_t numFrames{ 200'000 };
+        FenceRingAllocator ring{ capacity };
+        std::mt19937 rng{ 42 };
+        std::uniform_int_distribution<uint32_t> numAllocs{ 1, 8 };
+        std::uniform_int_distribution<uint64_t> allocSize{ 1, 4096 };
+        std::uniform_int_distribution<uint32_t> alignShift{ 0, 8 };
+        std::uniform_int_distribution<uint32_t> gpuLag{ 1, 3 };
+
+        std::deque<std::tuple<uint64_t, uint64_t, uint64_t>> live;     // offset, size, fence value
+        uint64_t completed{};
+        uint64_t numAllocations{}, numWraps{}, numWaits{}, lastOffset{};
+        auto reclaim = [&](uint64_t value) {
+            completed = std::max(completed, value);
+            ring.Reclaim(completed);
+            while (!live.empty() && std::get<2>(live.front()) <= completed)
+                live.pop_front();
+        };
+
+        auto start = WallClock::now();
+        for (uint64_t fence = 1; fence <= numFrames && sts; ++fence) {
+            const uint32_t n{ numAllocs(rng) };
+            for (uint32_t i = 0; i < n && sts; ++i) {
+                const uint64_t size{ allocSize(rng) };
+                const uint64_t alignment{ 1ull << alignShift(rng) };
+                uint64_t offset{ ring.Allocate(size, alignment) };
+                while (offset == FenceRingAllocator::InvalidOffset && ring.OldestPendingFence() != 0) {
+                    check(capacity - ring.Used() < 2 * size + alignment - 1, "Allocate failed with enough free space");
+                    // Wait for the GPU, as ShaderAssets does.
+                    ++numWaits;
+                    reclaim(ring.OldestPendingFence());
+                    offset = ring.Allocate(size, alignment);
+                }
+                check(offset != FenceRingAllocator::InvalidOffset, "Allocate failed with nothing pending");
+                if (offset == FenceRingAllocator::InvalidOffset)
+                    break;
+                check((offset & (alignment - 1)) == 0, "misaligned allocation");
+                check(offset + size <= capacity, "allocation out of range");
+                for (auto& [o, sz, f] : live)
+                    check(offset + size <= o || o + sz <= offset, "overlapping live allocations");
+                numWraps += offset < lastOffset;
+                lastOffset = offset;
+                ++numAllocations;
+                live.push_back({ offset, size, fence });
+            }
+            ring.Submit(fence);
+            if (fence > 3)
+                reclaim(fence - gpuLag(rng));
+        }
+        std::chrono::duration<double, std::nano> ns = WallClock::now() - start;
+        reclaim(numFrames);
+        check(ring.Used() == 0 && ring.NumPendingSubmissions() == 0, "space not reclaimed after the GPU went idle");
+        check(numWraps > 0, "never wrapped around");
+        check(ring.Allocate(capacity) == 0, "an idle ring doesn't hold a full size allocation");
+        out(Format("%u frames, %llu allocations, %llu wraps, %llu GPU waits, %.1fns/allocation with checks\n",
+            numFrames, (unsigned long long)numAllocations, (unsigned long long)numWraps, (unsigned long long)numWaits,
+            ns.count() / numAllocations));
+
+        // Cost of the allocator alone, a few allocations per frame as the line drawing does.
+        {
+            constexpr uint32_t numBenchFrames{ 2'000'000 };
+            constexpr uint32_t allocsPerFrame{ 4 };
+            FenceRingAllocator bench{ capacity };
+            uint64_t sum{};
+            auto t0 = WallClock::now();
+            for (uint64_t fence = 1; fence <= numBenchFrames; ++fence) {
+                for (uint32_t i = 0; i < allocsPerFrame; ++i)
+                    sum += bench.Allocate(192, 16);
+                bench.Submit(fence);
+                if (fence > 2)
+                    bench.Reclaim(fence - 2);
+            }
+            std::chrono::duration<double, std::nano> benchNs = WallClock::now() - t0;
+            check(sum != 0, "benchmark optimized out");
+            out(Format("allocate+submit+reclaim: %.1fns/allocation\n", benchNs.count() / (numBenchFrames * allocsPerFrame)));
+        }
+        return sts;
+    }
+
+    // Pipeline cache store with synthetic blobs: a reopened store returns what was inserted, other devices miss, each
+    // kind of damage to the files only costs the entries it hits, and the cost of opening and of a lookup.
+    inline bool PsoCache(const Output& out)
+    {
+        using WallClock = std::chrono::steady_clock;
+        bool sts{ true };
+        auto check = [&](bool cond, const char* what) {
+            if (!cond) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+
+        constexpr uint32_t numDevices{ 3 };
+        constexpr uint32_t numPipelines{ 200 };
+        const std::filesystem::path base{ std::filesystem::temp_directory_path() / "PresentBarrierTest_psocache_sim" };
+        std::filesystem::path indexPath{ base }, blobPath{ base };
+        indexPath += ".idx";
+        blobPath += ".bin";
+        std::filesystem::remove(indexPath);
+        std::filesystem::remove(blobPath);
+
+        // Contents and size derived from the key, 4KB to 64KB like compiled pipelines.
+        auto makeBlob = [](const PipelineCacheStore::Key& k) {
+            std::mt19937_64 rng{ k.device * 31 + k.pipeline };
+            std::vector<uint8_t> blob(4096 + rng() % (60 * 1024));
+            for (auto& b : blob)
+                b = (uint8_t)rng();
+            return blob;
+        };
+        auto keyOf = [](uint32_t d, uint32_t p) {
+            return PipelineCacheStore::Key{ 0x1000 + d, PipelineCacheFormat::Fnv1a(&p, sizeof(p)) };
+        };
+        // Number of keys found with the right contents.
+        auto countHits = [&](PipelineCacheStore& store) {
+            uint32_t hits{};
+            for (uint32_t d = 0; d < numDevices; ++d) {
+                for (uint32_t p = 0; p < numPipelines; ++p) {
+                    auto blob{ store.Find(keyOf(d, p)) };
+                    const auto expected{ makeBlob(keyOf(d, p)) };
+                    hits += blob.size() == expected.size() && memcmp(blob.data(), expected.data(), blob.size()) == 0;
+                }
+            }
+            return hits;
+        };
+        auto patchFile = [](const std::filesystem::path& path, auto&& patch) {
+            std::vector<uint8_t> data(std::filesystem::file_size(path));
+            FILE* fp{ fopen(path.string().c_str(), "rb") };
+            if (fp != nullptr) {
+                data.resize(fread(data.data(), 1, data.size(), fp));
+                fclose(fp);
+            }
+            patch(data);
+            fp = fopen(path.string().c_str(), "wb");
+            if (fp != nullptr) {
+                fwrite(data.data(), 1, data.size(), fp);
+                fclose(fp);
+            }
+        };
+        constexpr uint32_t total{ numDevices * numPipelines };
+
+        uint64_t blobBytes{};
+        {
+            PipelineCacheStore store;
+            check(store.Open(base), "create");
+            check(countHits(store) == 0, "hits in a new store");
+            for (uint32_t d = 0; d < numDevices; ++d) {
+                for (uint32_t p = 0; p < numPipelines; ++p) {
+                    const auto blob{ makeBlob(keyOf(d, p)) };
+                    check(store.Insert(keyOf(d, p), blob.data(), blob.size()), "insert");
+                    blobBytes += blob.size();
+                }
+            }
+            check(countHits(store) == total, "inserted blobs not found in the same session");
+        }
+
+        double openMs{}, findNs{};
+        {
+            PipelineCacheStore store;
+            auto start = WallClock::now();
+            check(store.Open(base), "reopen");
+            openMs = std::chrono::duration<double, std::milli>(WallClock::now() - start).count();
+
+            start = WallClock::now();
+            uint64_t found{};
+            for (uint32_t d = 0; d < numDevices; ++d)
+                for (uint32_t p = 0; p < numPipelines; ++p)
+                    found += store.Find(keyOf(d, p)).size();
+            findNs = std::chrono::duration<double, std::nano>(WallClock::now() - start).count() / total;
+            check(found == blobBytes, "blob sizes differ after reopening");
+            check(countHits(store) == total, "blobs differ after reopening");
+            check(store.Find({ 0x2000, keyOf(0, 0).pipeline }).empty(), "hit for another device");
+        }
+
+        // An entry cut short by a crash.
+        patchFile(indexPath, [](std::vector<uint8_t>& d) { d.insert(d.end(), 13, 0xcd); });
+        {
+            PipelineCacheStore store;
+            check(store.Open(base), "open with a partial entry");
+            check(store.GetStats().dropped == 1 && countHits(store) == total, "partial entry not dropped alone");
+        }
+        // A damaged blob.
+        const auto damaged{ keyOf(1, 7) };
+        {
+            PipelineCacheStore store;
+            store.Open(base);
+            // The first blob follows the header.
+            const uint64_t offset{ sizeof(PipelineCacheFormat::Header) + (uint64_t)(store.Find(damaged).data() - store.Find(keyOf(0, 0)).data()) + 100 };
+            store.Close();
+            patchFile(blobPath, [&](std::vector<uint8_t>& d) { d.at(offset) ^= 0x5a; });
+        }
+        {
+            PipelineCacheStore store;
+            check(store.Open(base), "open with a damaged blob");
+            check(store.Find(damaged).empty(), "damaged blob returned");
+            check(countHits(store) == total - 1, "a damaged blob cost other entries");
+            // Replaced by compiling again.
+            const auto blob{ makeBlob(damaged) };
+            store.Insert(damaged, blob.data(), blob.size());
+        }
+        // A blob file cut short, the entries past its end are dropped.
+        patchFile(blobPath, [](std::vector<uint8_t>& d) { d.resize(d.size() - 1); });
+        {
+            PipelineCacheStore store;
+            check(store.Open(base), "open with a truncated blob file");
+            check(store.GetStats().dropped == 1 && countHits(store) == total - 1, "truncation cost more than the last blob");
+        }
+        // An index of another version starts over.
+        patchFile(indexPath, [](std::vector<uint8_t>& d) { d.at(8) = PipelineCacheFormat::Version + 1; });
+        {
+            PipelineCacheStore store;
+            check(store.Open(base), "open with another version");
+            check(store.GetStats().entries == 0 && countHits(store) == 0, "entries of another version kept");
+        }
+        std::filesystem::remove(indexPath);
+        std::filesystem::remove(blobPath);
+
+        out(Format("%u blobs, %.1fMB: open %.3fms, lookup with checksum %.1fus/blob (%.0fMB/s)\n",
+            total, blobBytes / 1e6, openMs, findNs / 1e3, blobBytes / (findNs * total) * 1e3));
+        return sts;
+    }
+
+    // Frame rate and latency of recording on the present thread vs. on a record thread one frame ahead, then the cost
+    // of handing a frame between two real threads.
+    inline bool Pipeline(const Output& out)
+    {
+        constexpr uint64_t numFrames{ 100'000 };
+        struct Case {
+            const char* name;
+            uint64_t    recordNs;
+            uint64_t    presentNs;
+            uint64_t    gpuNs;
+        };
+        const std::vector<Case> cases{
+            { "slow present",   10'000'000, 9'000'000, 4'000'000 },
+            { "balanced",       6'000'000,  6'000'000, 6'000'000 },
+            { "cheap",          500'000,    200'000,   2'000'000 },
+        };
+
+        for (auto& c : cases) {
+            for (uint32_t buffers : { 2u, 3u }) {
+                for (bool pipelined : { false, true }) {
+                    SimulatedWindow::Config cfg{};
+                    cfg.backend.display = SimulatedDisplayClock::FromRefreshRate(60, 1);
+                    cfg.backend.backBufferCount = buffers;
+                    cfg.backend.maxFrameLatency = buffers;
+                    cfg.backend.presentLatencyNs = c.presentNs;
+                    cfg.backend.gpuFrameNs = c.gpuNs;
+                    cfg.recordNs = c.recordNs;
+                    cfg.pipelined = pipelined;
+                    cfg.pipelineDepth = buffers - 1;
+
+                    auto name = Format("%s %ubuf %s", c.name, buffers, pipelined ? "pipelined" : "serial");
+                    SimulatedWindow w(cfg);
+                    auto start = std::chrono::steady_clock::now();
+                    if (!w.Run(numFrames)) {
+                        out(Format("%s: simulation failed.\n", name.c_str()));
+                        return false;
+                    }
+                    std::chrono::duration<double> realSec = std::chrono::steady_clock::now() - start;
+                    out(FormatResult(name.c_str(), w.GetResult(), realSec.count()));
+                }
+            }
+        }
+
+        // Handoff between the present thread and the record thread with empty frames, two frames in flight.
+        constexpr uint64_t numHandoffs{ 200'000 };
+        FramePipeline<uint64_t> pipeline;
+        std::atomic<uint64_t> numRecorded{};
+        pipeline.Start([&numRecorded](uint64_t& f, const std::atomic<bool>&) { f += 1; numRecorded.fetch_add(1); return true; });
+        // Frames come back recorded and in the order they were requested.
+        uint64_t requested{}, expected{};
+        bool inOrder{ true };
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < numHandoffs; ++i) {
+            while (pipeline.InFlight() < 2)
+                pipeline.Request(requested++);
+            uint64_t f{};
+            if (pipeline.Take(f, std::chrono::milliseconds(2000)) != FramePipeline<uint64_t>::Status::ok) {
+                out("Handoff failed.\n");
+                return false;
+            }
+            inOrder &= f == expected++ + 1;
+        }
+        std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+
+        // Paused, like during a window mode transition: the frames requested meanwhile wait, then come back in order.
+        pipeline.Pause();
+        const uint64_t pausedAt{ numRecorded.load() };
+        for (uint32_t i = 0; i < 2; ++i)
+            pipeline.Request(requested++);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const bool held{ numRecorded.load() == pausedAt };
+        pipeline.Resume();
+        while (expected < requested) {
+            uint64_t f{};
+            if (pipeline.Take(f, std::chrono::milliseconds(2000)) != FramePipeline<uint64_t>::Status::ok) {
+                out("Handoff after a pause failed.\n");
+                return false;
+            }
+            inOrder &= f == expected++ + 1;
+        }
+
+        const size_t discarded{ pipeline.Discard() };
+        pipeline.Stop();
+        out(Format("handoff: %.0fns/frame, %zu discarded at the end%s%s\n", ns.count() / numHandoffs, discarded, inOrder ? "" : ", frames out of order",
+            held ? "" : ", recorded while paused"));
+        return inOrder && held;
+    }
+
+    // A present thread per window vs. the windows' frames driven by a shared pool of render threads, with 2, 8 and 32
+    // displays at 60Hz in real time. Both keep a window thread per display which requests the frames. A frame waits for
+    // the vblank of its display, standing for the fence wait, records and presents. The displays are in phase, as under
+    // a PresentBarrier, so the skew is how far apart the threads get the presents of a frame out.
+    inline bool Threading(const Output& out)
+    {
+        using WallClock = std::chrono::steady_clock;
+        constexpr uint32_t numFrames{ 60 };
+        constexpr uint64_t periodNs{ 16'666'667 };
+        constexpr auto recordDuration{ std::chrono::microseconds(100) };
+
+        class Display final {
+        public:
+            PortableEventWaiter         waiter;
+            std::binary_semaphore       start{ 0 };
+            std::thread                 presentThread;
+            std::thread                 windowThread;
+            RenderScheduler::ClientId   client{ RenderScheduler::InvalidClient };
+            std::atomic<uint64_t>       nextVblankNs{ periodNs };
+            std::vector<uint64_t>       presentNs;
+        };
+
+        for (uint32_t numDisplays : { 2u, 8u, 32u }) {
+            for (uint32_t renderThreads : { 0u, 1u, 2u }) {
+                std::vector<std::unique_ptr<Display>> displays;
+                for (uint32_t d = 0; d < numDisplays; ++d)
+                    displays.push_back(std::make_unique<Display>());
+                const auto epoch{ WallClock::now() + std::chrono::milliseconds(20) };
+
+                auto frame = [&](Display& disp) {
+                    std::this_thread::sleep_until(epoch + std::chrono::nanoseconds(disp.nextVblankNs.load()));
+                    const auto end{ WallClock::now() + recordDuration };
+                    while (WallClock::now() < end)
+                        ;
+                    disp.presentNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(WallClock::now() - epoch).count());
+                    disp.nextVblankNs.fetch_add(periodNs);
+                    disp.waiter.Notify(wakeupPresentFinished);
+                };
+
+                RenderScheduler scheduler;
+                if (renderThreads > 0)
+                    scheduler.Start(renderThreads);
+                const auto [cpuStartNs, switchesStart] = ProcessUsage();
+
+                for (auto& dp : displays) {
+                    Display& disp{ *dp };
+                    if (renderThreads > 0) {
+                        disp.client = scheduler.Register([&frame, &disp] { frame(disp); }, [&disp] { return disp.nextVblankNs.load(); });
+                    }
+                    else {
+                        disp.presentThread = std::thread([&frame, &disp] {
+                            for (uint32_t f = 0; f < numFrames; ++f) {
+                                disp.start.acquire();
+                                frame(disp);
+                            }
+                            });
+                    }
+                    disp.windowThread = std::thread([&scheduler, &disp] {
+                        for (uint32_t f = 0; f < numFrames; ++f) {
+                            if (disp.client != RenderScheduler::InvalidClient)
+                                scheduler.Request(disp.client);
+                            else
+                                disp.start.release();
+                            disp.waiter.WaitUntil(EventWaiter::NoDeadline);
+                        }
+                        });
+                }
+                for (auto& d : displays) {
+                    d->windowThread.join();
+                    if (d->presentThread.joinable())
+                        d->presentThread.join();
+                    scheduler.Unregister(d->client);
+                }
+                scheduler.Stop();
+                const auto [cpuEndNs, switchesEnd] = ProcessUsage();
+
+                SkewAnalyzer skew;
+                skew.Configure(std::vector<uint64_t>(numDisplays, periodNs));
+                for (uint32_t f = 0; f < numFrames; ++f) {
+                    for (uint32_t d = 0; d < numDisplays; ++d)
+                        skew.OnPresent(d, f, displays[d]->presentNs.at(f));
+                }
+                skew.Flush();
+                const auto sk{ skew.Summarize() };
+
+                const double frames{ (double)numFrames * numDisplays };
+                const std::string model{ renderThreads > 0 ? Format("%u render thread%s", renderThreads, renderThreads > 1 ? "s" : "") : "thread per window" };
+                const std::string switches{ switchesEnd == UINT64_MAX ? "   n/a" : Format("%6.2f", (switchesEnd - switchesStart) / frames) };
+                out(Format("%2u displays %-18s threads:%3u cpu:%7.1fus/frame switches:%s/frame skew(ms) p50:%6.3f p99:%6.3f max:%6.3f\n",
+                    numDisplays, model.c_str(), numDisplays + (renderThreads > 0 ? renderThreads : numDisplays),
+                    (cpuEndNs - cpuStartNs) / frames / 1e3, switches.c_str(),
+                    sk.p50SkewMs, sk.p99SkewMs, sk.maxSkewMs));
+            }
+        }
+        return true;
+    }
+
+    // Scaling of the job system over 1 to 32 workers on a CPU-only frame workload of 8 windows. Each window's present
+    // thread splits its frame into geometry, command recording and stats jobs, and the primary window also builds the
+    // UI. "inline" runs the same work on the present threads. Skew is how much later the primary window gets its frame
+    // done than the others.
+    inline bool Jobs(const Output& out)
+    {
+        using WallClock = std::chrono::steady_clock;
+        constexpr uint32_t numWindows{ 8 };
+        constexpr uint32_t numFrames{ 200 };
+        constexpr uint32_t geometryJobs{ 4 }, recordJobs{ 4 };
+        constexpr uint32_t geometryWork{ 20'000 }, recordWork{ 10'000 }, statsWork{ 5'000 }, uiWork{ 120'000 };
+
+        // Stands for the work of a job, about a nanosecond per iteration.
+        auto work = [](uint32_t iterations) {
+            uint32_t x{ iterations };
+            for (uint32_t i = 0; i < iterations; ++i)
+                x = x * 1664525u + 1013904223u;
+            return x;
+        };
+
+        double inlineMs{};
+        for (uint32_t numWorkers : { 0u, 1u, 2u, 4u, 8u, 16u, 32u }) {
+            JobSystem jobs;
+            if (numWorkers > 0)
+                jobs.Start(numWorkers);
+
+            std::atomic<uint32_t> sink{};
+            std::atomic<uint64_t> executed{};
+            std::vector<std::vector<double>> frameMs(numWindows);
+            std::barrier frameStart(numWindows);
+
+            auto start = WallClock::now();
+            std::vector<std::thread> presentThreads;
+            for (uint32_t w = 0; w < numWindows; ++w) {
+                presentThreads.emplace_back([&, w]() {
+                    JobSystem::Group group;
+                    auto run = [&](uint32_t iterations) {
+                        auto job = [&, iterations]() {
+                            sink.fetch_add(work(iterations), std::memory_order_relaxed);
+                            executed.fetch_add(1, std::memory_order_relaxed);
+                        };
+                        if (numWorkers > 0)
+                            jobs.Run(group, job);
+                        else
+                            job();
+                    };
+                    for (uint32_t f = 0; f < numFrames; ++f) {
+                        // Windows start their frames together, as they do on a vblank.
+                        frameStart.arrive_and_wait();
+                        const auto frameStartTime{ WallClock::now() };
+                        if (w == 0)
+                            run(uiWork);
+                        for (uint32_t j = 0; j < geometryJobs; ++j)
+                            run(geometryWork);
+                        for (uint32_t j = 0; j < recordJobs; ++j)
+                            run(recordWork);
+                        run(statsWork);
+                        jobs.Wait(group);
+                        frameMs[w].push_back(std::chrono::duration<double, std::milli>(WallClock::now() - frameStartTime).count());
+                    }
+                    });
+            }
+            for (auto& t : presentThreads)
+                t.join();
+            const double totalMs{ std::chrono::duration<double, std::milli>(WallClock::now() - start).count() };
+            const auto st{ jobs.GetStats() };
+            jobs.Stop();
+
+            const uint64_t expected{ (uint64_t)numFrames * (numWindows * (geometryJobs + recordJobs + 1) + 1) };
+            if (executed.load() != expected) {
+                out(Format("%u workers: %llu jobs ran, %llu expected.\n", numWorkers, (unsigned long long)executed.load(), (unsigned long long)expected));
+                return false;
+            }
+
+            double primaryMs{}, othersMs{};
+            for (uint32_t f = 0; f < numFrames; ++f) {
+                primaryMs += frameMs[0][f];
+                double m{};
+                for (uint32_t w = 1; w < numWindows; ++w)
+                    m = std::max(m, frameMs[w][f]);
+                othersMs += m;
+            }
+            if (numWorkers == 0)
+                inlineMs = totalMs;
+            out(Format("%-10s %6.3fms/frame speedup:%5.2fx primary:%6.3fms others:%6.3fms skew:%6.3fms stolen:%5.1f%% helped:%5.1f%%\n",
+                numWorkers > 0 ? Format("%u workers", numWorkers).c_str() : "inline", totalMs / numFrames, inlineMs / totalMs,
+                primaryMs / numFrames, othersMs / numFrames, (primaryMs - othersMs) / numFrames,
+                st.executed > 0 ? 100.0 * st.stolen / st.executed : 0.0, st.executed > 0 ? 100.0 * st.helped / st.executed : 0.0));
+        }
+        return true;
+    }
+
+    // Queue submissions of 2 to 32 windows sharing an adapter queue, each window submitting on its own thread vs. through
+    // the submission batcher. The queue is simulated: a submission costs a fixed overhead plus a little per command
+    // list, a fence signal a fixed overhead, and the queue serializes them. The windows start their frames together.
+    inline bool Batching(const Output& out)
+    {
+        using WallClock = std::chrono::steady_clock;
+        constexpr uint32_t numFrames{ 200 };
+        constexpr auto submitCost{ std::chrono::microseconds(20) };
+        constexpr auto perListCost{ std::chrono::microseconds(1) };
+        constexpr auto signalCost{ std::chrono::microseconds(5) };
+        constexpr auto collectWindow{ std::chrono::microseconds(500) };
+
+        auto spin = [](WallClock::duration d) {
+            const auto end{ WallClock::now() + d };
+            while (WallClock::now() < end)
+                ;
+        };
+
+        for (uint32_t numWindows : { 2u, 8u, 32u }) {
+            for (bool batched : { false, true }) {
+                std::mutex queueMtx;
+                uint64_t fenceValue{}, submissions{}, signals{}, lists{};
+                WallClock::duration queueBusy{};
+                // ExecuteCommandLists and Signal on the shared queue.
+                auto execute = [&](uint32_t numLists) {
+                    std::scoped_lock<std::mutex> l{ queueMtx };
+                    const auto start{ WallClock::now() };
+                    spin(submitCost + perListCost * numLists + signalCost);
+                    queueBusy += WallClock::now() - start;
+                    ++submissions;
+                    ++signals;
+                    lists += numLists;
+                    return ++fenceValue;
+                };
+
+                SubmissionBatcher<uint32_t> batcher;
+                batcher.Configure([&](const std::vector<uint32_t>& items) { return execute((uint32_t)items.size()); }, collectWindow);
+
+                std::barrier frameStart(numWindows);
+                std::vector<double> releaseSpreadMs(numFrames);
+                std::vector<std::vector<WallClock::time_point>> released(numWindows, std::vector<WallClock::time_point>(numFrames));
+                std::vector<std::thread> threads;
+                const auto start{ WallClock::now() };
+                for (uint32_t w = 0; w < numWindows; ++w) {
+                    if (batched)
+                        batcher.Join();
+                    threads.emplace_back([&, w]() {
+                        for (uint32_t f = 0; f < numFrames; ++f) {
+                            frameStart.arrive_and_wait();
+                            if (batched)
+                                batcher.Submit(w);
+                            else
+                                execute(1);
+                            // Present.
+                            released[w][f] = WallClock::now();
+                        }
+                        });
+                }
+                for (auto& t : threads)
+                    t.join();
+                const double totalMs{ std::chrono::duration<double, std::milli>(WallClock::now() - start).count() };
+
+                double spreadMs{};
+                for (uint32_t f = 0; f < numFrames; ++f) {
+                    auto [first, last] = std::minmax_element(released.begin(), released.end(), [f](auto& a, auto& b) { return a[f] < b[f]; });
+                    spreadMs += std::chrono::duration<double, std::milli>((*last)[f] - (*first)[f]).count();
+                }
+                const auto st{ batcher.GetStats() };
+                out(Format("%2u windows %-8s submissions:%6.3f/window frame signals:%6.3f/window frame queue busy:%7.1fus/frame present spread:%6.3fms wall:%6.3fms/frame%s\n",
+                    numWindows, batched ? "batched" : "direct", (double)submissions / (numFrames * numWindows), (double)signals / (numFrames * numWindows),
+                    std::chrono::duration<double, std::micro>(queueBusy).count() / numFrames, spreadMs / numFrames, totalMs / numFrames,
+                    batched ? Format(" expired batches:%llu", (unsigned long long)st.expired).c_str() : ""));
+                if (lists != (uint64_t)numFrames * numWindows) {
+                    out("Command lists got lost.\n");
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // The globalCounter rendered by 4 displays at 60Hz in phase, as under a PresentBarrier, on a virtual clock. Each
+    // display starts recording 0.2 to 4ms after its vblank. The previous counter was incremented by a loop sleeping
+    // 5 to 6ms. The timebase sources get their ticks late and miss some of them. Deterministic means every frame
+    // advances the counter by one and all displays render the same value for the same refresh.
+    inline bool TimebaseCounter(const Output& out)
+    {
+        constexpr uint32_t numDisplays{ 4 };
+        constexpr uint64_t numRefreshes{ 20'000 };
+        const auto display{ SimulatedDisplayClock::FromRefreshRate(60, 1) };
+        const uint64_t periodNs{ display.periodNs };
+
+        enum class Model { sleepLoop, timer, vblank, presentBarrier };
+        const std::vector<std::tuple<const char*, Model>> models{
+            { "Sleep(5) loop", Model::sleepLoop },
+            { "timer", Model::timer },
+            { "vblank", Model::vblank },
+            { "PresentBarrier count", Model::presentBarrier },
+        };
+
+        bool sts{ true };
+        for (auto& [name, model] : models) {
+            uint64_t nowNs{ 3'000'000 };    // The timer starts out of phase with the displays.
+            Timebase timebase([&nowNs] { return nowNs; });
+            timebase.Configure(model == Model::timer ? TimebaseSource::timer : model == Model::vblank ? TimebaseSource::vblank : TimebaseSource::presentBarrier, periodNs);
+
+            std::mt19937 rng{ 1 };
+            std::uniform_int_distribution<uint64_t> recordDelay{ 200'000, 4'000'000 };
+            std::uniform_int_distribution<uint64_t> tickDelay{ 0, 300'000 };
+            std::uniform_int_distribution<uint64_t> sleepNs{ 5'000'000, 6'000'000 };
+            std::uniform_int_distribution<uint32_t> percent{ 0, 99 };
+
+            uint64_t sleepCounter{}, nextSleepWakeNs{ nowNs };
+            uint64_t disagreements{}, irregular{}, pbCount{ 1000 };
+            std::vector<uint64_t> last(numDisplays);
+            for (uint64_t k = 1; k <= numRefreshes; ++k) {
+                const uint64_t vblankNs{ display.phaseNs + k * periodNs };
+
+                // Master clock events and record starts of this refresh, in time order.
+                std::vector<std::tuple<uint64_t, int>> events;     // time, display or -1 for the master tick
+                ++pbCount;
+                if (percent(rng) != 0)
+                    events.push_back({ vblankNs + tickDelay(rng), -1 });
+                for (int d = 0; d < (int)numDisplays; ++d)
+                    events.push_back({ vblankNs + recordDelay(rng), d });
+                std::sort(events.begin(), events.end());
+
+                std::vector<uint64_t> rendered(numDisplays);
+                for (auto& [t, who] : events) {
+                    nowNs = t;
+                    while (nextSleepWakeNs <= nowNs) {
+                        ++sleepCounter;
+                        nextSleepWakeNs += sleepNs(rng);
+                    }
+                    if (who < 0) {
+                        if (model == Model::vblank)
+                            timebase.OnTick(t);
+                        else if (model == Model::presentBarrier)
+                            timebase.OnCount(t, pbCount);
+                        continue;
+                    }
+                    rendered[who] = model == Model::sleepLoop ? sleepCounter : timebase.CounterNear(t);
+                }
+                disagreements += std::any_of(rendered.begin(), rendered.end(), [&](uint64_t c) { return c != rendered[0]; }) ? 1 : 0;
+                if (k > 1)
+                    irregular += rendered[0] - last[0] != 1 ? 1 : 0;
+                last = rendered;
+            }
+            out(Format("%-22s frames with displays disagreeing:%6llu frames not advancing by one:%6llu missed ticks:%u\n",
+                name, (unsigned long long)disagreements, (unsigned long long)irregular, model == Model::vblank ? timebase.MissedTicks() : 0));
+            if (model == Model::vblank || model == Model::presentBarrier)
+                sts &= disagreements == 0 && irregular == 0;
+        }
+        return sts;
+    }
+
+    // Six hours of 4 displays at 60Hz, 60Hz 1ms later, 59.94Hz and 75Hz on the virtual clock. The windows are stepped in
+    // virtual time order as in the skew scenario, and render the counter of a timebase ticked on the vblanks of the
+    // first display. The GPU of the second display hangs for 5s at 2h. The interval statistics of the last hour have to
+    // match those of the second, and the counter is checked once the displays settled after the first second. Then the watchdogs of the window loop time out on the same clock: a present thread which
+    // doesn't finish within the close timeout, a record thread which doesn't deliver its frame, a submission batch which
+    // a client never adds to, and a pacing deadline.
+    inline bool LongRun(const Output& out)
+    {
+        bool sts{ true };
+        auto check = [&](bool cond, const char* what) {
+            if (!cond) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+
+        constexpr uint64_t hourNs{ 3'600'000'000'000 };
+        constexpr uint64_t durationNs{ 6 * hourNs };
+        constexpr uint64_t stallAtNs{ 2 * hourNs };
+        constexpr uint64_t stallNs{ 5'000'000'000 };
+
+        VirtualClock clock;
+        ScopedClock scopedClock{ clock };
+        const auto realStart{ std::chrono::steady_clock::now() };
+
+        class Display final {
+        public:
+            const char*                         name{};
+            std::unique_ptr<SimulatedWindow>    window;
+            uint64_t                            cursor{};
+            PresentIntervalStats                secondHour;
+            PresentIntervalStats                lastHour;
+            uint64_t                            lastCounter{};
+            uint64_t                            counterSkips{};     // Frames advancing the counter by more than one.
+            uint64_t                            counterRepeats{};   // Frames rendering the counter of the previous one.
+        };
+        const std::vector<std::tuple<const char*, SimulatedDisplayClock>> modes{
+            { "60Hz", SimulatedDisplayClock::FromRefreshRate(60, 1) },
+            { "60Hz 1ms late", SimulatedDisplayClock::FromRefreshRate(60, 1, 1'000'000) },
+            { "59.94Hz", SimulatedDisplayClock::FromRefreshRate(60000, 1001) },
+            { "75Hz", SimulatedDisplayClock::FromRefreshRate(75, 1) },
+        };
+
+        const SimulatedDisplayClock master{ std::get<1>(modes[0]) };
+        Timebase timebase{ [&clock] { return clock.NowNs(); } };
+        timebase.Configure(TimebaseSource::vblank, master.periodNs);
+        uint64_t nextTickNs{ master.NextVblank(0) };
+
+        std::vector<Display> displays(modes.size());
+        for (size_t i = 0; i < modes.size(); ++i) {
+            SimulatedWindow::Config cfg{};
+            cfg.backend.display = std::get<1>(modes[i]);
+            cfg.timebase = &timebase;
+            displays[i].name = std::get<0>(modes[i]);
+            displays[i].window = std::make_unique<SimulatedWindow>(cfg);
+            displays[i].secondHour.SetRefreshPeriod(cfg.backend.display.periodNs);
+            displays[i].lastHour.SetRefreshPeriod(cfg.backend.display.periodNs);
+        }
+
+        bool stalled{ false };
+        uint64_t frames{};
+        std::array<FrameTimeline::Record, 64> records;
+        for (;;) {
+            auto itr = std::min_element(displays.begin(), displays.end(), [](auto& a, auto& b) { return a.window->backend.Now() < b.window->backend.Now(); });
+            SimulatedWindow& w{ *itr->window };
+            const uint64_t t{ w.backend.Now() };
+            if (t >= durationNs)
+                break;
+
+            // The main loop ticks the timebase on the vblanks of the master display.
+            for (; nextTickNs <= t; nextTickNs += master.periodNs) {
+                clock.AdvanceTo(nextTickNs);
+                timebase.OnTick(nextTickNs);
+            }
+            clock.AdvanceTo(t);
+
+            if (!stalled && itr - displays.begin() == 1 && t >= stallAtNs) {
+                w.backend.StallGpu(stallNs);
+                stalled = true;
+            }
+            if (!w.Frame()) {
+                out(Format("%s: simulation failed.\n", itr->name));
+                return false;
+            }
+            ++frames;
+
+            uint32_t n{};
+            while ((n = w.timeline.Read(itr->cursor, records.data(), (uint32_t)records.size())) > 0) {
+                for (uint32_t r = 0; r < n; ++r) {
+                    const auto& rec{ records[r] };
+                    if (rec.presentNs >= hourNs && rec.presentNs < 2 * hourNs)
+                        itr->secondHour.OnPresent(rec.presentNs);
+                    else if (rec.presentNs >= durationNs - hourNs)
+                        itr->lastHour.OnPresent(rec.presentNs);
+                    if (rec.presentNs >= 1'000'000'000) {
+                        itr->counterSkips += rec.globalCounter > itr->lastCounter + 1 ? 1 : 0;
+                        itr->counterRepeats += rec.globalCounter == itr->lastCounter ? 1 : 0;
+                    }
+                    itr->lastCounter = rec.globalCounter;
+                }
+            }
+        }
+        std::chrono::duration<double> realSec{ std::chrono::steady_clock::now() - realStart };
+
+        for (size_t i = 0; i < displays.size(); ++i) {
+            const auto& d{ displays[i] };
+            const auto& res{ d.window->GetResult() };
+            const auto second{ d.secondHour.Summarize() };
+            const auto last{ d.lastHour.Summarize() };
+            out(Format("%-14s frames:%8llu missed:%4llu locks:%llu interval(ms) 2nd hour p50:%7.3f p99:%7.3f jitter:%6.3f last hour p50:%7.3f p99:%7.3f jitter:%6.3f counter skips:%5llu repeats:%6llu\n",
+                d.name, (unsigned long long)res.frames, (unsigned long long)res.missedVblanks, (unsigned long long)res.presentLocks,
+                second.p50Ms, second.p99Ms, second.jitterMs, last.p50Ms, last.p99Ms, last.jitterMs,
+                (unsigned long long)d.counterSkips, (unsigned long long)d.counterRepeats));
+            check(second.p50Ms == last.p50Ms && second.p99Ms == last.p99Ms && std::abs(second.jitterMs - last.jitterMs) < 0.001, "interval statistics drifted");
+            check(last.missedVblanks == 0, "missed vblanks in the last hour");
+        }
+        out(Format("%.0fh of %zu displays, %llu frames in %.2fs, %.0fx real time\n", durationNs / (double)hourNs, displays.size(),
+            (unsigned long long)frames, realSec.count(), durationNs / 1e9 / realSec.count()));
+        check(displays[1].window->GetResult().presentLocks == 2, "present lock watchdog");
+        check(displays[0].counterSkips == 0 && displays[0].counterRepeats == 0, "counter on the master display");
+        check(displays[1].counterSkips == 1 && displays[1].counterRepeats == 0, "counter on the display in phase");
+        // The 59.94Hz display falls a refresh behind the counter every 16.7s.
+        const double expectedSkips{ durationNs / (double)master.periodNs - durationNs / (double)std::get<1>(modes[2]).periodNs };
+        check(std::abs((double)displays[2].counterSkips - expectedSkips) < 2.0, "counter drift on the 59.94Hz display");
+
+        // The watchdogs. The threads they wait for hang, so each of them has to time out exactly at its deadline.
+        {
+            std::binary_semaphore finished{ 0 };
+            const uint64_t startNs{ clock.NowNs() };
+            const bool joined{ clock.TryAcquireForNs(finished, 3'000'000'000) };
+            out(Format("close:  present thread joined:%d after %.3fs\n", joined, (clock.NowNs() - startNs) / 1e9));
+            check(!joined && clock.NowNs() - startNs == 3'000'000'000, "close timeout");
+        }
+        {
+            FramePipeline<uint64_t> pipeline;
+            pipeline.Start([](uint64_t&, const std::atomic<bool>& cancel) {
+                while (!cancel.load())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                return false;
+                });
+            pipeline.Request(1);
+            uint64_t frame{};
+            const uint64_t startNs{ clock.NowNs() };
+            const auto result{ pipeline.Take(frame, std::chrono::milliseconds(2000)) };
+            out(Format("record: frame taken:%d after %.3fs\n", result != FramePipeline<uint64_t>::Status::timeout, (clock.NowNs() - startNs) / 1e9));
+            check(result == FramePipeline<uint64_t>::Status::timeout && clock.NowNs() - startNs == 2'000'000'000, "record timeout");
+            pipeline.Stop();
+        }
+        {
+            SubmissionBatcher<uint32_t> batcher;
+            uint64_t fence{};
+            batcher.Configure([&fence](const std::vector<uint32_t>&) { return ++fence; }, std::chrono::microseconds(500));
+            batcher.Join();
+            batcher.Join();
+            const uint64_t startNs{ clock.NowNs() };
+            batcher.Submit(1);
+            out(Format("batch:  submitted after %.3fms, expired:%llu\n", (clock.NowNs() - startNs) / 1e6, (unsigned long long)batcher.GetStats().expired));
+            check(batcher.GetStats().expired == 1 && clock.NowNs() - startNs == 500'000, "batch expiry");
+        }
+        {
+            PortableEventWaiter waiter;
+            const uint64_t deadlineNs{ clock.NowNs() + master.periodNs };
+            const uint32_t events{ waiter.WaitUntil(deadlineNs) };
+            check(events == wakeupDeadline && clock.NowNs() == deadlineNs, "pacing deadline");
+        }
+        return sts;
+    }
+
+    // The vblank estimator on synthetic 10 minute timestamp streams of displays configured as 60Hz: the flip times of a
+    // 59.94Hz display with 20us of noise, 5% of the frames missed and a 2ms outlier every 500 frames, its present return
+    // times with 300us of noise, and the flip times of a 60Hz display whose phase jumps by 7ms after 5 minutes, as after
+    // a mode change. A prediction made at a random time before each 7th vblank has to bound that vblank. Then the drift
+    // of identical 60Hz displays and of displays 20ppm apart after a minute, and the cost of an update.
+    inline bool Vblank(const Output& out)
+    {
+        bool sts{ true };
+        auto check = [&](bool cond, const char* what) {
+            if (!cond) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+
+        constexpr double nominalPeriodNs{ 1e9 / 60.0 };
+        constexpr double ntscPeriodNs{ 1e9 * 1001.0 / 60000.0 };
+        constexpr uint64_t startNs{ 1'000'000'000 };
+
+        class Stream final {
+        public:
+            const char* name;
+            double      periodNs;
+            double      noiseNs;
+            uint32_t    missPercent;
+            uint32_t    outlierEvery;   // Frames, 0 for none.
+            uint64_t    phaseJumpAtNs;  // 0 for none.
+        };
+        const std::vector<Stream> streams{
+            { "flips 59.94Hz", ntscPeriodNs, 20'000.0, 5, 500, 0 },
+            { "presents 59.94Hz", ntscPeriodNs, 300'000.0, 5, 0, 0 },
+            { "flips phase jump", nominalPeriodNs, 20'000.0, 0, 0, 300'000'000'000 },
+        };
+        // Feeds one stream to est up to endNs, from vblank index k on. Returns the predictions made and bounded.
+        auto run = [](VblankEstimator& est, const Stream& s, uint64_t endNs, std::mt19937& rng, uint64_t& missed, uint64_t& injected, std::vector<double>& errorsUs) {
+            std::normal_distribution<double> noise{ 0.0, s.noiseNs };
+            std::uniform_int_distribution<uint32_t> percent{ 0, 99 };
+            std::uniform_real_distribution<double> before{ 1.0, s.periodNs - 1.0 };
+            uint64_t predictions{}, bounded{};
+            for (uint64_t k = 1;; ++k) {
+                double vblankNs{ startNs + k * s.periodNs };
+                if (s.phaseJumpAtNs > 0 && vblankNs >= startNs + s.phaseJumpAtNs)
+                    vblankNs += 7'000'000.0;
+                if (vblankNs >= (double)endNs)
+                    break;
+                if (k % 7 == 0 && est.Converged()) {
+                    const auto p{ est.Predict((uint64_t)(vblankNs - before(rng))) };
+                    const double errorNs{ std::abs((double)p.vblankNs - vblankNs) };
+                    ++predictions;
+                    bounded += errorNs <= (double)p.boundNs ? 1 : 0;
+                    errorsUs.push_back(errorNs / 1'000.0);
+                }
+                if (percent(rng) < s.missPercent) {
+                    ++missed;
+                    continue;
+                }
+                double tNs{ vblankNs + noise(rng) };
+                if (s.outlierEvery > 0 && k % s.outlierEvery == 0) {
+                    tNs += 2'000'000.0;
+                    ++injected;
+                }
+                est.Update((uint64_t)tNs);
+            }
+            return std::tuple<uint64_t, uint64_t>{ predictions, bounded };
+        };
+
+        for (auto& s : streams) {
+            VblankEstimator::Config cfg;
+            cfg.nominalPeriodNs = nominalPeriodNs;
+            VblankEstimator est{ cfg };
+            std::mt19937 rng{ 1 };
+            uint64_t missed{}, injected{};
+            std::vector<double> errorsUs;
+            const auto [predictions, bounded] = run(est, s, startNs + 600'000'000'000, rng, missed, injected, errorsUs);
+            std::sort(errorsUs.begin(), errorsUs.end());
+
+            const auto sum{ est.Summarize() };
+            const double coverage{ predictions > 0 ? (double)bounded / predictions : 0.0 };
+            out(Format("%-18s period error:%8.3fns +-%6.3fns noise:%7.1fus missed:%5llu/%5llu outliers:%4llu resets:%u predictions:%5llu bounded:%6.2f%% error(us) p50:%7.2f p99:%7.2f\n",
+                s.name, sum.periodNs - s.periodNs, sum.periodStdDevNs, sum.timestampNoiseNs / 1'000.0,
+                (unsigned long long)sum.missedVblanks, (unsigned long long)missed, (unsigned long long)sum.outliers, sum.resets,
+                (unsigned long long)predictions, coverage * 100.0, errorsUs[errorsUs.size() / 2], errorsUs[errorsUs.size() * 99 / 100]));
+            check(std::abs(sum.periodNs - s.periodNs) < (s.noiseNs > 100'000.0 ? 50.0 : 5.0), "period");
+            check(coverage >= 0.99, "prediction bound");
+            check(sum.resets == (s.phaseJumpAtNs > 0 ? 1u : 0u), "resets");
+            if (s.phaseJumpAtNs == 0) {
+                // Rejected timestamps leave their vblank missed too. Misses before the first timestamp don't count.
+                check(sum.outliers == injected, "outliers");
+                check(sum.missedVblanks <= missed + sum.outliers && sum.missedVblanks + 2 >= missed + sum.outliers, "missed vblanks");
+            }
+        }
+
+        // Pairs of displays, both configured as 60Hz.
+        for (double ppm : { 0.0, 20.0 }) {
+            std::mt19937 rng{ 2 };
+            uint64_t missed{}, injected{};
+            std::vector<double> errorsUs;
+            VblankEstimator::Config cfg;
+            cfg.nominalPeriodNs = nominalPeriodNs;
+            VblankEstimator a{ cfg }, b{ cfg };
+            run(a, { "", nominalPeriodNs / (1.0 + ppm * 1e-6), 20'000.0, 5, 0, 0 }, startNs + 60'000'000'000, rng, missed, injected, errorsUs);
+            run(b, { "", nominalPeriodNs, 20'000.0, 5, 0, 0 }, startNs + 60'000'000'000, rng, missed, injected, errorsUs);
+            const auto d{ VblankEstimator::Compare(a.Summarize(), b.Summarize()) };
+            out(Format("drift %4.1fppm     estimated:%7.3fppm phase offset:%8.3fus significant:%d\n", ppm, d.ppm, d.phaseOffsetNs / 1'000.0, d.significant));
+            check(d.significant == (ppm > 0.0) && std::abs(d.ppm - ppm) < 1.0, "drift");
+        }
+
+        {
+            constexpr uint32_t numUpdates{ 1'000'000 };
+            std::vector<uint64_t> ts(numUpdates);
+            std::mt19937 rng{ 3 };
+            std::normal_distribution<double> noise{ 0.0, 20'000.0 };
+            for (uint32_t i = 0; i < numUpdates; ++i)
+                ts[i] = (uint64_t)(startNs + (i + 1) * ntscPeriodNs + noise(rng));
+            VblankEstimator est;
+            auto start = std::chrono::steady_clock::now();
+            for (auto t : ts)
+                est.Update(t);
+            std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+            out(Format("update:%.1fns\n", ns.count() / numUpdates));
+        }
+        return sts;
+    }
+
+    // A/B of the frame start modes on latency and missed vblanks: a fixed delay after the last present, as fast as
+    // possible with either pacing mode, and just in time at a few target miss rates. Recording costs a fixed time plus
+    // an exponentially distributed tail. The just in time scheduler only measures the CPU part of a frame, like the
+    // test windows do, so its margin has to learn the GPU time.
+    inline bool JustInTime(const Output& out)
+    {
+        constexpr uint64_t numFrames{ 100'000 };
+        bool sts{ true };
+        auto check = [&](bool ok, const char* what) {
+            if (!ok) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+
+        struct Display {
+            uint32_t    hz;
+            uint64_t    recordNs;
+            uint64_t    recordJitterNs;
+            uint64_t    gpuNs;
+            float       shortDelayMs;   // Frames come faster than the refresh and queue up.
+            float       longDelayMs;    // Slower, so some refreshes repeat a frame.
+        };
+        for (const Display& d : { Display{ 60, 3'000'000, 500'000, 2'000'000, 8.0f, 13.0f }, Display{ 144, 1'500'000, 300'000, 1'000'000, 2.0f, 5.0f } }) {
+            struct Case {
+                std::string             name;
+                SimulatedWindow::Config cfg;
+            };
+            auto make = [&d](FrameStartMode startMode, FramePacingMode pacingMode, uint32_t maxFrameLatency, float threadWaitMs, double targetMissRate) {
+                SimulatedWindow::Config c{};
+                c.backend.display = SimulatedDisplayClock::FromRefreshRate(d.hz, 1);
+                c.backend.maxFrameLatency = maxFrameLatency;
+                c.backend.gpuFrameNs = d.gpuNs;
+                c.recordNs = d.recordNs;
+                c.recordJitterNs = d.recordJitterNs;
+                c.pacingMode = pacingMode;
+                c.frameStartMode = startMode;
+                c.threadWaitMs = threadWaitMs;
+                c.justInTime.targetMissRate = targetMissRate;
+                return c;
+            };
+            std::vector<Case> cases{
+                { Format("%uHz fixed %.0fms", d.hz, d.shortDelayMs), make(FrameStartMode::fixedDelay, FramePacingMode::fence, 2, d.shortDelayMs, 0.0) },
+                { Format("%uHz fixed %.0fms", d.hz, d.longDelayMs), make(FrameStartMode::fixedDelay, FramePacingMode::fence, 2, d.longDelayMs, 0.0) },
+                { Format("%uHz fast fence", d.hz), make(FrameStartMode::asFastAsPossible, FramePacingMode::fence, 2, 0.f, 0.0) },
+                { Format("%uHz fast waitable 1", d.hz), make(FrameStartMode::asFastAsPossible, FramePacingMode::latencyWaitable, 1, 0.f, 0.0) },
+            };
+            for (double t : { 0.001, 0.01, 0.05 })
+                cases.push_back({ Format("%uHz jit %.1f%%", d.hz, t * 100.0), make(FrameStartMode::justInTime, FramePacingMode::fence, 2, 0.f, t) });
+
+            double fastLatencyMs{ std::numeric_limits<double>::max() };
+            double prevJitLatencyMs{ std::numeric_limits<double>::max() };
+            for (auto& c : cases) {
+                SimulatedWindow w(c.cfg);
+                if (!w.Run(numFrames)) {
+                    out(Format("%s: simulation failed.\n", c.name.c_str()));
+                    return false;
+                }
+                const auto& r{ w.GetResult() };
+                const double missRate{ (double)r.missedVblanks / (r.frames + r.missedVblanks) };
+                std::string jit;
+                const auto js{ w.loop.frameStartScheduler.GetStats() };
+                const double lateRate{ js.frames > 0 ? (double)js.misses / js.frames : 0.0 };
+                if (c.cfg.frameStartMode == FrameStartMode::justInTime)
+                    jit = Format(" late:%6.3f%% margin:%6.3fms cost:%6.3fms", 100.0 * lateRate, js.marginNs / 1'000'000.0, js.costNs / 1'000'000.0);
+                out(Format("%-22s latency:%7.3fms missed vblanks:%6.3f%% interval max:%7.3fms%s\n", c.name.c_str(), r.meanLatencyMs,
+                    100.0 * missRate, r.maxIntervalMs, jit.c_str()));
+
+                if (c.cfg.frameStartMode == FrameStartMode::asFastAsPossible) {
+                    fastLatencyMs = std::min(fastLatencyMs, r.meanLatencyMs);
+                }
+                else if (c.cfg.frameStartMode == FrameStartMode::justInTime) {
+                    const double target{ c.cfg.justInTime.targetMissRate };
+                    check(std::abs(lateRate - target) < 0.2 * target + 0.0005, "the late frames are off the target miss rate");
+                    check(missRate < 1.2 * target + 0.0005, "the missed vblanks are over the target miss rate");
+                    check(r.meanLatencyMs < fastLatencyMs, "just in time is not ahead of as fast as possible on latency");
+                    // A looser target buys latency.
+                    check(r.meanLatencyMs < prevJitLatencyMs, "the latency doesn't drop with the target miss rate");
+                    prevJitLatencyMs = r.meanLatencyMs;
+                }
+            }
+        }
+        return sts;
+    }
+
+    // Per configuration throughput, latency and missed vblanks of one window rebuilt through back buffer counts 2 to 4
+    // and maximum frame latencies 1 to 3, against a fresh window for each, on a light and a GPU bound workload.
+    inline bool SwapChain(const Output& out)
+    {
+        constexpr uint64_t numFrames{ 20'000 };
+        bool sts{ true };
+        auto check = [&](bool ok, const char* what) {
+            if (!ok) {
+                out(Format("FAILED: %s\n", what));
+                sts = false;
+            }
+        };
+
+        struct Workload {
+            const char* name;
+            uint64_t    recordNs;
+            uint64_t    recordJitterNs;
+            uint64_t    gpuNs;
+        };
+        for (const Workload& wl : { Workload{ "light", 2'000'000, 500'000, 4'000'000 }, Workload{ "heavy", 8'000'000, 2'000'000, 12'000'000 } }) {
+            auto make = [&wl](uint32_t buffers, uint32_t latency) {
+                SimulatedWindow::Config c{};
+                c.backend.display = SimulatedDisplayClock::FromRefreshRate(60, 1);
+                c.backend.backBufferCount = buffers;
+                c.backend.maxFrameLatency = latency;
+                c.backend.gpuFrameNs = wl.gpuNs;
+                c.recordNs = wl.recordNs;
+                c.recordJitterNs = wl.recordJitterNs;
+                return c;
+            };
+
+            SimulatedWindow rebuilt(make(2, 1));
+            bool first{ true };
+            for (uint32_t buffers : { 2u, 3u, 4u }) {
+                for (uint32_t latency : { 1u, 2u, 3u }) {
+                    if (!first && !rebuilt.Rebuild(buffers, latency)) {
+                        out(Format("%s: rebuilding to %u buffers, latency %u failed.\n", wl.name, buffers, latency));
+                        return false;
+                    }
+                    first = false;
+                    if (!rebuilt.Run(numFrames)) {
+                        out(Format("%s: simulation failed.\n", wl.name));
+                        return false;
+                    }
+                }
+            }
+
+            const auto& t{ rebuilt.swapChainStats.GetTable() };
+            const int best{ SwapChainConfigStats::Best(t, numFrames / 2) };
+            check(t.numRows == 9, "a configuration is missing from the table");
+            check(best >= 0, "no configuration picked");
+            for (uint32_t i = 0; i < t.numRows; ++i) {
+                const auto& r{ t.rows[i] };
+                SimulatedWindow fresh(make(r.backBuffers, r.maxFrameLatency));
+                if (!fresh.Run(numFrames)) {
+                    out(Format("%s: simulation failed.\n", wl.name));
+                    return false;
+                }
+                const auto& f{ fresh.swapChainStats.GetTable().rows[0] };
+                out(Format("%-6s %ubuf latency %u  fps:%7.3f latency:%7.3fms max:%7.3fms missed:%6.3f%%  fresh fps:%7.3f latency:%7.3fms%s\n",
+                    wl.name, r.backBuffers, r.maxFrameLatency, r.Fps(), r.MeanLatencyMs(), r.maxLatencyNs / 1'000'000.0, 100.0 * r.MissedRate(),
+                    f.Fps(), f.MeanLatencyMs(), (int)i == best ? "  <- best" : ""));
+                check(r.frames == numFrames && r.latencySamples == numFrames, "frames counted against another configuration");
+                check(std::abs(r.Fps() - f.Fps()) < 0.01 * f.Fps(), "the throughput after a rebuild differs from a fresh swap chain");
+                check(std::abs(r.MeanLatencyMs() - f.MeanLatencyMs()) < 0.02 * f.MeanLatencyMs() + 0.1, "the latency after a rebuild differs from a fresh swap chain");
+                if (best >= 0)
+                    check(r.MissedRate() + 0.0005 >= t.rows[best].MissedRate() || r.frames < numFrames / 2, "the best configuration misses more vblanks than another one");
+            }
+        }
+        return sts;
+    }
+
+    // Run all scenarios whose name contains filter.
+    inline bool Run(const std::string& filter, const Output& out)
+    {
+        const std::vector<std::tuple<const char*, std::function<bool(const Output&)>>> scenarios{
+            { "pacing", Pacing },
+            { "latency", Latency },
+            { "timeline", Timeline },
+            { "histogram", Histogram },
+            { "skew", Skew },
+            { "pbstats", PBStats },
+            { "barrier", Barrier },
+            { "wakeup", Wakeup },
+            { "logring", LogRingBench },
+            { "binlog", BinLog },
+            { "contention", Contention },
+            { "commands", Commands },
+            { "upload", Upload },
+            { "psocache", PsoCache },
+            { "pipeline", Pipeline },
+            { "threading", Threading },
+            { "jobs", Jobs },
+            { "batching", Batching },
+            { "timebase", TimebaseCounter },
+            { "longrun", LongRun },
+            { "vblank", Vblank },
+            { "jit", JustInTime },
+            { "swapchain", SwapChain },
+        };
+
+        bool sts{ true };
+        for (auto& [name, func] : scenarios) {
+            if (!filter.empty() && std::string(name).find(filter) == std::string::npos)
+                continue;
+            out(Format("--- %s ---\n", name));
+            sts &= func(out);
+        }
+        return sts;
+    }
+};
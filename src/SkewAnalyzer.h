@@ -0,0 +1,302 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <bit>
+
+#include "IntervalStats.h"
+
+// Present skew across windows. Presents are correlated by a frame key, the globalCounter value a frame rendered or its
+// present count, and the skew of a frame is the spread of its present times over the windows which presented it.
+// Windows at a lower refresh rate skip keys, and windows at a higher rate present a key more than once, in which case
+// the first present counts since that is when the content changed. A window whose frames no other window presents
+// is off by more than a key, its skew can't be measured and it raises alerts instead.
+//
+// Each present is O(1) and closing a frame is O(number of windows), so the cost per frame is linear in the window
+// count. Pair skews come from the mean offset of each window and are only computed on request.
+class SkewAnalyzer final
+{
+public:
+    static constexpr uint32_t MaxWindows{ 64 };
+    static constexpr uint32_t NumSlots{ 256 };      // Frames in flight, keys further apart than this close the older frame.
+
+    class WindowStats final {
+    public:
+        uint64_t    frames{};           // Frames matched with at least one other window.
+        double      meanOffsetMs{};     // Behind the earliest window of the frame.
+        double      maxOffsetMs{};
+    };
+
+    class Summary final {
+    public:
+        uint64_t    matchedFrames{};
+        uint64_t    unmatchedFrames{};  // Presented by a single window.
+        uint64_t    lateReports{};      // Arrived after the frame got closed, repeated keys included.
+        double      p50SkewMs{};
+        double      p99SkewMs{};
+        double      maxSkewMs{};
+        uint64_t    alerts{};
+        uint64_t    lastAlertKey{};
+        double      lastAlertSkewMs{};  // Of the latest skew alert.
+        uint64_t    unmatchedAlerts{};  // Of the alerts, presents of a window which stopped matching the others.
+        uint32_t    lastUnmatchedWindow{};
+        uint32_t    worstPairA{};       // Pair with the largest difference in mean offsets.
+        uint32_t    worstPairB{};
+        double      worstPairSkewMs{};
+    };
+
+private:
+    class Slot final {
+    public:
+        uint64_t    key{};
+        uint64_t    reported{};         // Window bit mask.
+        uint64_t    minNs{ UINT64_MAX };
+        uint64_t    maxNs{};
+        uint64_t    minPeriodNs{ UINT64_MAX };
+        uint64_t    maxPeriodNs{};
+        std::array<uint64_t, MaxWindows>    presentNs{};
+    };
+    std::vector<Slot>   slots{ NumSlots };
+
+    class WindowState final {
+    public:
+        uint64_t    refreshPeriodNs{};
+        uint64_t    frames{};
+        double      sumOffsetNs{};
+        uint64_t    maxOffsetNs{};
+        bool        presented{ false };
+        uint64_t    lastMatchedNs{};    // Latest present of a frame another window presented too.
+    };
+    std::vector<WindowState>    windows;
+
+    // The latest present of any window, and the latest one of the other windows than that one.
+    uint64_t    latestNs{};
+    uint32_t    latestWindow{};
+    uint64_t    secondLatestNs{};
+
+    double      alertThresholdPeriods{ 0.5 };
+    uint64_t    unmatchedLimitNs{};     // Two refresh periods of the slowest window.
+    LogLinearHistogram  skewHistogram;
+    uint64_t    unmatchedFrames{};
+    uint64_t    lateReports{};
+    uint64_t    alerts{};
+    uint64_t    lastAlertKey{};
+    uint64_t    lastAlertSkewNs{};
+    uint64_t    unmatchedAlerts{};
+    uint32_t    lastUnmatchedWindow{};
+    uint64_t    closedBelow{};          // Every key below this has been closed.
+
+    void Close(Slot& s)
+    {
+        if (s.reported == 0)
+            return;
+
+        if (std::popcount(s.reported) < 2) {
+            ++unmatchedFrames;
+        }
+        else {
+            const uint64_t skew{ s.maxNs - s.minNs };
+            skewHistogram.Record(skew);
+            for (uint64_t m = s.reported; m != 0; m &= m - 1) {
+                auto& w{ windows[std::countr_zero(m)] };
+                const uint64_t offset{ s.presentNs[std::countr_zero(m)] - s.minNs };
+                ++w.frames;
+                w.sumOffsetNs += (double)offset;
+                w.maxOffsetNs = std::max(w.maxOffsetNs, offset);
+            }
+            // A display shows a frame up to one of its refresh periods after it became ready, so a slower display
+            // trails a faster one by up to the difference of their periods.
+            if (s.maxPeriodNs > 0 && skew > alertThresholdPeriods * s.maxPeriodNs + (s.maxPeriodNs - s.minPeriodNs)) {
+                ++alerts;
+                lastAlertKey = s.key;
+                lastAlertSkewNs = skew;
+            }
+        }
+        closedBelow = std::max(closedBelow, s.key + 1);
+        s.reported = 0;
+        s.minNs = UINT64_MAX;
+        s.maxNs = 0;
+        s.minPeriodNs = UINT64_MAX;
+        s.maxPeriodNs = 0;
+    }
+
+    void OnMatched(uint32_t window, uint64_t presentNs)
+    {
+        windows[window].lastMatchedNs = std::max(windows[window].lastMatchedNs, presentNs);
+    }
+
+public:
+    // refreshPeriodsNs has an entry per window. A frame alerts when its skew exceeds alertThreshold refresh periods
+    // of the slowest window which presented it, on top of the difference to the period of the fastest one. A present
+    // alerts when the window's frames matched none of the other windows for two refresh periods of the slowest
+    // window, while the others kept presenting.
+    void Configure(const std::vector<uint64_t>& refreshPeriodsNs, double alertThreshold = 0.5)
+    {
+        windows.assign(std::min<size_t>(refreshPeriodsNs.size(), MaxWindows), {});
+        uint64_t maxPeriodNs{};
+        for (size_t i = 0; i < windows.size(); ++i) {
+            windows[i].refreshPeriodNs = refreshPeriodsNs[i];
+            maxPeriodNs = std::max(maxPeriodNs, refreshPeriodsNs[i]);
+        }
+        alertThresholdPeriods = alertThreshold;
+        unmatchedLimitNs = 2 * (maxPeriodNs > 0 ? maxPeriodNs : 16'666'667);
+        Reset();
+    }
+
+    void Reset()
+    {
+        for (auto& s : slots)
+            s = {};
+        for (auto& w : windows)
+            w = { w.refreshPeriodNs };
+        skewHistogram.Reset();
+        unmatchedFrames = 0;
+        lateReports = 0;
+        alerts = 0;
+        lastAlertKey = 0;
+        lastAlertSkewNs = 0;
+        unmatchedAlerts = 0;
+        lastUnmatchedWindow = 0;
+        latestNs = 0;
+        latestWindow = 0;
+        secondLatestNs = 0;
+        closedBelow = 0;
+    }
+
+    void OnPresent(uint32_t window, uint64_t key, uint64_t presentNs)
+    {
+        if (window >= windows.size())
+            return;
+        if (window == latestWindow) {
+            latestNs = std::max(latestNs, presentNs);
+        }
+        else if (presentNs >= latestNs) {
+            secondLatestNs = latestNs;
+            latestNs = presentNs;
+            latestWindow = window;
+        }
+        else {
+            secondLatestNs = std::max(secondLatestNs, presentNs);
+        }
+
+        Slot& s{ slots[key % NumSlots] };
+        if (s.reported != 0 && s.key != key) {
+            if (key < s.key) {
+                ++lateReports;
+                return;
+            }
+            // The slot is needed for a newer frame.
+            Close(s);
+        }
+        if (s.reported == 0 && key < closedBelow) {
+            // Typically a repeated present of a window at a higher refresh rate after every window reported.
+            ++lateReports;
+            return;
+        }
+        s.key = key;
+
+        const uint64_t bit{ 1ull << window };
+        if (s.reported & bit)
+            return;
+        auto& w{ windows[window] };
+        if (!w.presented) {
+            w.presented = true;
+            w.lastMatchedNs = presentNs;
+        }
+        if (s.reported != 0) {
+            OnMatched(window, presentNs);
+            if (std::popcount(s.reported) == 1)
+                OnMatched(std::countr_zero(s.reported), s.presentNs[std::countr_zero(s.reported)]);
+        }
+        else {
+            // Nothing matched the frames of the window for a while, although the others kept presenting.
+            const uint64_t othersNs{ window == latestWindow ? secondLatestNs : latestNs };
+            if (presentNs > w.lastMatchedNs + unmatchedLimitNs && othersNs > w.lastMatchedNs + unmatchedLimitNs) {
+                ++alerts;
+                ++unmatchedAlerts;
+                lastAlertKey = key;
+                lastUnmatchedWindow = window;
+            }
+        }
+        s.reported |= bit;
+        s.presentNs[window] = presentNs;
+        s.minNs = std::min(s.minNs, presentNs);
+        s.maxNs = std::max(s.maxNs, presentNs);
+        if (w.refreshPeriodNs > 0) {
+            s.minPeriodNs = std::min(s.minPeriodNs, w.refreshPeriodNs);
+            s.maxPeriodNs = std::max(s.maxPeriodNs, w.refreshPeriodNs);
+        }
+
+        // Every window reported, no need to wait for more.
+        if (std::popcount(s.reported) == (int)windows.size())
+            Close(s);
+    }
+
+    // Close every frame still waiting for reports.
+    void Flush()
+    {
+        for (auto& s : slots)
+            Close(s);
+    }
+
+    std::vector<WindowStats> PerWindow() const
+    {
+        std::vector<WindowStats> ret(windows.size());
+        for (size_t i = 0; i < windows.size(); ++i) {
+            ret[i].frames = windows[i].frames;
+            ret[i].meanOffsetMs = windows[i].frames > 0 ? windows[i].sumOffsetNs / windows[i].frames / 1'000'000.0 : 0.0;
+            ret[i].maxOffsetMs = windows[i].maxOffsetNs / 1'000'000.0;
+        }
+        return ret;
+    }
+
+    // Difference of the mean offsets, O(1).
+    double PairSkewMs(uint32_t a, uint32_t b) const
+    {
+        if (a >= windows.size() || b >= windows.size() || windows[a].frames == 0 || windows[b].frames == 0)
+            return 0.0;
+        const double ma{ windows[a].sumOffsetNs / windows[a].frames };
+        const double mb{ windows[b].sumOffsetNs / windows[b].frames };
+        return std::abs(ma - mb) / 1'000'000.0;
+    }
+
+    Summary Summarize() const
+    {
+        constexpr double nsToMs{ 1.0 / 1'000'000.0 };
+        Summary s;
+        s.matchedFrames = skewHistogram.Count();
+        s.unmatchedFrames = unmatchedFrames;
+        s.lateReports = lateReports;
+        s.p50SkewMs = skewHistogram.Percentile(0.5) * nsToMs;
+        s.p99SkewMs = skewHistogram.Percentile(0.99) * nsToMs;
+        s.maxSkewMs = skewHistogram.Max() * nsToMs;
+        s.alerts = alerts;
+        s.lastAlertKey = lastAlertKey;
+        s.lastAlertSkewMs = lastAlertSkewNs * nsToMs;
+        s.unmatchedAlerts = unmatchedAlerts;
+        s.lastUnmatchedWindow = lastUnmatchedWindow;
+
+        // The largest pairwise difference of means is between the smallest and the largest mean, O(N).
+        double minMean{}, maxMean{};
+        bool found{ false };
+        for (uint32_t i = 0; i < windows.size(); ++i) {
+            if (windows[i].frames == 0)
+                continue;
+            const double mean{ windows[i].sumOffsetNs / windows[i].frames };
+            if (!found || mean < minMean) {
+                minMean = mean;
+                s.worstPairA = i;
+            }
+            if (!found || mean > maxMean) {
+                maxMean = mean;
+                s.worstPairB = i;
+            }
+            found = true;
+        }
+        s.worstPairSkewMs = found ? (maxMean - minMean) * nsToMs : 0.0;
+        return s;
+    }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <type_traits>
+
+// Bounded lock-free queue with a single producer and a single consumer. Each side keeps a cached copy of the other
+// side's index and only reloads it when the ring looks full or empty, so a push or a pop usually touches a single
+// shared cache line.
+template <typename T, size_t Capacity>
+class SpscRing final
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+    static_assert(std::is_trivially_copyable_v<T>, "Elements are copied in and out of the cells.");
+
+    std::array<T, Capacity>     cells{};
+
+    alignas(64) std::atomic<size_t> tail{};     // Producer.
+    size_t                          cachedHead{};
+    alignas(64) std::atomic<size_t> head{};     // Consumer.
+    size_t                          cachedTail{};
+
+public:
+    SpscRing() = default;
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer.
+    bool TryPush(const T& v)
+    {
+        const size_t t{ tail.load(std::memory_order_relaxed) };
+        if (t - cachedHead == Capacity) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead == Capacity)
+                return false;
+        }
+        cells[t & (Capacity - 1)] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer.
+    bool TryPop(T& v)
+    {
+        const size_t h{ head.load(std::memory_order_relaxed) };
+        if (h == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail)
+                return false;
+        }
+        v = cells[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate, for statistics.
+    size_t Size() const
+    {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_relaxed);
+    }
+};
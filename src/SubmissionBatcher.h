@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <tuple>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include "Clock.h"
+
+// Collects the submissions of the windows sharing a queue and hands them to the queue in one call. A batch is
+// submitted once every joined client has added to it, or when the collect window since its first item expires. The
+// thread which completes a batch submits it, and Submit returns to every client of the batch with the fence value
+// signaled after it.
+template <typename Item>
+class SubmissionBatcher final
+{
+public:
+    // Submits the items in order and signals a fence once after them, returns the signaled value.
+    using FlushFunc = std::function<uint64_t(const std::vector<Item>& items)>;
+
+    class Stats final {
+    public:
+        uint64_t    batches{};
+        uint64_t    items{};
+        uint64_t    expired{};      // Submitted when the collect window expired, before every client added to it.
+        uint64_t    maxItems{};
+    };
+
+private:
+    static constexpr size_t NumFlushedRecords{ 64 };
+
+    std::mutex                  mtx;
+    std::condition_variable     cv;
+    FlushFunc                   flush;
+    uint64_t                    collectWindowNs{};
+    uint32_t                    clients{};
+    std::vector<Item>           pending;
+    uint64_t                    openedNs{};
+    uint64_t                    openSeq{ 1 };       // Batch collecting the pending items.
+    std::deque<std::tuple<uint64_t, uint64_t>>  flushed;    // batch seq, fence value. The latest ones.
+    Stats                       stats;
+
+    void FlushLocked(bool expired)
+    {
+        const uint64_t fence{ flush(pending) };
+        stats.batches++;
+        stats.items += pending.size();
+        stats.expired += expired ? 1 : 0;
+        stats.maxItems = std::max<uint64_t>(stats.maxItems, pending.size());
+        flushed.push_back({ openSeq, fence });
+        if (flushed.size() > NumFlushedRecords)
+            flushed.pop_front();
+        pending.clear();
+        ++openSeq;
+        cv.notify_all();
+    }
+
+    bool FlushedFence(uint64_t seq, uint64_t& fence) const
+    {
+        for (auto& [s, f] : flushed) {
+            if (s == seq) {
+                fence = f;
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    SubmissionBatcher() = default;
+    SubmissionBatcher(const SubmissionBatcher&) = delete;
+    SubmissionBatcher& operator=(const SubmissionBatcher&) = delete;
+
+    // A zero collect window disables batching, see Enabled. The window is on Clock::Get().
+    void Configure(FlushFunc inFlush, std::chrono::nanoseconds collectWindow)
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        flush = std::move(inFlush);
+        collectWindowNs = (uint64_t)std::max<int64_t>(collectWindow.count(), 0);
+    }
+
+    bool Enabled()
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        return flush && collectWindowNs > 0;
+    }
+
+    // A client submits once per frame between Join and Leave.
+    void Join()
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        ++clients;
+    }
+
+    void Leave()
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        if (clients > 0)
+            --clients;
+        // The others may only have been waiting for this client.
+        if (!pending.empty() && pending.size() >= clients)
+            FlushLocked(false);
+    }
+
+    // Blocks until the batch holding the item has been submitted. Returns its fence value.
+    uint64_t Submit(const Item& item)
+    {
+        std::unique_lock<std::mutex> l{ mtx };
+        Clock& clock{ Clock::Get() };
+        if (pending.empty())
+            openedNs = clock.NowNs();
+        pending.push_back(item);
+        const uint64_t seq{ openSeq };
+        if (pending.size() >= clients)
+            FlushLocked(false);
+
+        uint64_t fence{};
+        const uint64_t deadlineNs{ openedNs + collectWindowNs };
+        while (!FlushedFence(seq, fence)) {
+            if (clock.WaitUntilNs(cv, l, deadlineNs) == std::cv_status::timeout && openSeq == seq)
+                FlushLocked(true);
+        }
+        return fence;
+    }
+
+    Stats GetStats()
+    {
+        std::scoped_lock<std::mutex> l{ mtx };
+        return stats;
+    }
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <span>
+#include <deque>
+#include <tuple>
+#include <algorithm>
+#include <limits>
+
+// Throughput, latency and missed vblanks of a window for each swap chain configuration it ran with: the back buffer
+// count and the maximum frame latency. The intervals across a configuration change are left out, so the rows of a
+// window switched through the configurations compare like runs of their own.
+class SwapChainConfigStats final
+{
+public:
+    static constexpr uint32_t MaxConfigs{ 16 };
+
+    class Row final {
+    public:
+        uint32_t    backBuffers{};
+        uint32_t    maxFrameLatency{};
+        uint64_t    frames{};
+        uint64_t    intervals{};
+        uint64_t    intervalNs{};       // Sum of the present intervals.
+        uint64_t    missedVblanks{};
+        uint64_t    latencySamples{};
+        double      sumLatencyNs{};     // Record start, where input gets sampled, to scan out.
+        uint64_t    maxLatencyNs{};
+
+        double Fps() const
+        {
+            return intervalNs > 0 ? intervals * 1'000'000'000.0 / intervalNs : 0.0;
+        }
+
+        double MeanLatencyMs() const
+        {
+            return latencySamples > 0 ? sumLatencyNs / latencySamples / 1'000'000.0 : 0.0;
+        }
+
+        // Per present interval.
+        double MissedRate() const
+        {
+            return intervals > 0 ? (double)missedVblanks / intervals : 0.0;
+        }
+    };
+
+    class Table final {
+    public:
+        std::array<Row, MaxConfigs> rows{};
+        uint32_t    numRows{};
+        uint32_t    current{};          // Row of the running configuration.
+    };
+
+private:
+    static constexpr size_t MaxPending{ 16 };
+
+    Table       table;
+    uint64_t    refreshPeriodNs{};
+    uint64_t    lastPresentNs{};        // 0 right after a configuration change.
+    std::deque<std::tuple<uint64_t, uint64_t>>  pending;    // Presented, flip not seen yet: id, record start.
+
+    Row& Current()
+    {
+        return table.rows[table.current];
+    }
+
+public:
+    void SetRefreshPeriod(uint64_t periodNs)
+    {
+        refreshPeriodNs = periodNs;
+    }
+
+    // Forgets every configuration but the running one.
+    void Reset()
+    {
+        if (table.numRows == 0)
+            return;
+        const Row r{ Current() };
+        table = {};
+        Select(r.backBuffers, r.maxFrameLatency);
+    }
+
+    // The frames from now on run with this configuration. The oldest row makes room for a new one.
+    void Select(uint32_t backBuffers, uint32_t maxFrameLatency)
+    {
+        lastPresentNs = 0;
+        pending.clear();
+        const auto rows{ std::span(table.rows).first(table.numRows) };
+        auto itr = std::find_if(rows.begin(), rows.end(), [&](const Row& r) { return r.backBuffers == backBuffers && r.maxFrameLatency == maxFrameLatency; });
+        if (itr != rows.end()) {
+            table.current = (uint32_t)(itr - rows.begin());
+            return;
+        }
+        if (table.numRows == MaxConfigs) {
+            std::shift_left(table.rows.begin(), table.rows.end(), 1);
+            --table.numRows;
+        }
+        table.rows[table.numRows] = { backBuffers, maxFrameLatency };
+        table.current = table.numRows++;
+    }
+
+    // A frame got presented, after the first Select. id orders the frames like the present count, its flip is
+    // reported with the same id.
+    void OnPresent(uint64_t presentNs, uint64_t id, uint64_t recordStartNs)
+    {
+        if (table.numRows == 0)
+            return;
+        Row& r{ Current() };
+        ++r.frames;
+        if (lastPresentNs != 0 && presentNs > lastPresentNs) {
+            const uint64_t interval{ presentNs - lastPresentNs };
+            ++r.intervals;
+            r.intervalNs += interval;
+            if (refreshPeriodNs > 0) {
+                // Round to the nearest refresh count, presents wobble around the vblank.
+                const uint64_t refreshes{ (interval + refreshPeriodNs / 2) / refreshPeriodNs };
+                if (refreshes > 1)
+                    r.missedVblanks += refreshes - 1;
+            }
+        }
+        lastPresentNs = presentNs;
+        if (pending.size() >= MaxPending)
+            pending.pop_front();
+        pending.push_back({ id, recordStartNs });
+    }
+
+    // The frame id was scanned out at flipNs. Only the latest flip needs to be reported, the ones before it are
+    // skipped.
+    void OnFlip(uint64_t id, uint64_t flipNs)
+    {
+        while (table.numRows > 0 && !pending.empty() && std::get<0>(pending.front()) <= id) {
+            const auto [frameId, recordStartNs] { pending.front() };
+            pending.pop_front();
+            if (frameId != id || flipNs < recordStartNs)
+                continue;
+            Row& r{ Current() };
+            const uint64_t latency{ flipNs - recordStartNs };
+            ++r.latencySamples;
+            r.sumLatencyNs += (double)latency;
+            r.maxLatencyNs = std::max(r.maxLatencyNs, latency);
+        }
+    }
+
+    const Table& GetTable() const
+    {
+        return table;
+    }
+
+    // The row to pick: of those with at least minFrames, and which miss no more vblanks than the best of them does
+    // plus missTolerance, the one with the lowest latency. -1 while none has run for long enough.
+    static int Best(const Table& t, uint64_t minFrames, double missTolerance = 0.0005)
+    {
+        const auto rows{ std::span(t.rows).first(t.numRows) };
+        double minMissed{ std::numeric_limits<double>::max() };
+        for (auto& r : rows) {
+            if (r.frames >= minFrames && r.latencySamples > 0)
+                minMissed = std::min(minMissed, r.MissedRate());
+        }
+        int best{ -1 };
+        for (uint32_t i = 0; i < t.numRows; ++i) {
+            const Row& r{ t.rows[i] };
+            if (r.frames < minFrames || r.latencySamples == 0 || r.MissedRate() > minMissed + missTolerance)
+                continue;
+            if (best < 0 || r.MeanLatencyMs() < t.rows[best].MeanLatencyMs())
+                best = (int)i;
+        }
+        return best;
+    }
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "SeqLock.h"
+
+// Master clock the globalCounter rendered by every window is derived from.
+enum class TimebaseSource : uint32_t {
+    timer,              // Fixed rate, extrapolated from the clock alone.
+    vblank,             // Vblanks of a chosen display, reported with OnTick.
+    presentBarrier,     // PresentBarrier present count of a chosen display, reported with OnCount.
+};
+
+// The counter is the number of master clock ticks since Configure. The last observed tick is published as a seqlocked
+// anchor, and the counter at any time is extrapolated from it by the tick period, so reading it is lock-free and
+// doesn't need a thread ticking it. Windows which sample it after the same tick get the same value.
+class Timebase final
+{
+public:
+    using ClockFunc = std::function<uint64_t()>;
+
+    class Anchor final {
+    public:
+        uint64_t    tickNs{};
+        uint64_t    count{};
+        uint64_t    periodNs{};
+    };
+
+private:
+    ClockFunc               clock;
+    TimebaseSource          source{ TimebaseSource::timer };
+    SeqLocked<Anchor>       anchor;
+    uint32_t                missedTicks{};      // Writer only.
+    uint64_t                countOffset{};      // Writer only, added to the reported counts.
+    bool                    counted{ false };
+
+public:
+    explicit Timebase(ClockFunc inClock)
+        : clock(std::move(inClock))
+    {
+        Configure(TimebaseSource::timer, 1'000'000'000 / 60);
+    }
+
+    Timebase(const Timebase&) = delete;
+    Timebase& operator=(const Timebase&) = delete;
+
+    // Before the readers start. The count restarts from 0 now.
+    void Configure(TimebaseSource inSource, uint64_t periodNs)
+    {
+        source = inSource;
+        missedTicks = 0;
+        countOffset = 0;
+        counted = false;
+        anchor.Store({ clock(), 0, periodNs > 0 ? periodNs : 1 });
+    }
+
+    TimebaseSource Source() const
+    {
+        return source;
+    }
+
+    uint64_t PeriodNs() const
+    {
+        return anchor.Load().periodNs;
+    }
+
+    // Writer: the master clock ticked at tickNs. The count advances by the ticks elapsed since the last one, so a
+    // missed vblank doesn't shift the counter.
+    void OnTick(uint64_t tickNs)
+    {
+        Anchor a{ anchor.Load() };
+        if (tickNs <= a.tickNs)
+            return;
+        const uint64_t ticks{ (tickNs - a.tickNs + a.periodNs / 2) / a.periodNs };
+        if (ticks == 0)
+            return;
+        missedTicks += (uint32_t)(ticks - 1);
+        anchor.Store({ tickNs, a.count + ticks, a.periodNs });
+    }
+
+    // Writer: the master clock reports its own count, e.g. the PresentBarrier present count. The counter follows its
+    // increments from where it was at the first report, and never goes backwards.
+    void OnCount(uint64_t tickNs, uint64_t count)
+    {
+        Anchor a{ anchor.Load() };
+        const uint64_t now{ CounterAt(a, tickNs + a.periodNs / 2) };
+        if (!counted) {
+            countOffset = now - count;
+            counted = true;
+        }
+        const uint64_t c{ count + countOffset };
+        anchor.Store({ tickNs, c > now ? c : now, a.periodNs });
+    }
+
+    // Ticks missed between OnTick calls so far. Writer only.
+    uint32_t MissedTicks() const
+    {
+        return missedTicks;
+    }
+
+    static uint64_t CounterAt(const Anchor& a, uint64_t ns)
+    {
+        return ns <= a.tickNs ? a.count : a.count + (ns - a.tickNs) / a.periodNs;
+    }
+
+    // Any thread.
+    uint64_t CounterAt(uint64_t ns) const
+    {
+        return CounterAt(anchor.Load(), ns);
+    }
+
+    // Counter of the tick nearest to ns, for a frame which starts recording shortly after the vblank it follows.
+    // Tolerates half a period of difference between the displays and the master clock.
+    uint64_t CounterNear(uint64_t ns) const
+    {
+        const Anchor a{ anchor.Load() };
+        return CounterAt(a, ns + a.periodNs / 2);
+    }
+
+    uint64_t Counter() const
+    {
+        return CounterAt(clock());
+    }
+};
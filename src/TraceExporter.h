@@ -0,0 +1,231 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "Clock.h"
+#include "MpscRing.h"
+
+// Streams Chrome Trace Event JSON, which loads in chrome://tracing and ui.perfetto.dev.
+// Threads push fixed size events into a lock-free ring and a background thread formats and writes them, so the
+// present path never touches the file. Events are dropped and counted when the writer can't keep up.
+// Event names and categories must be string literals, they are written out long after the call.
+class TraceExporter final
+{
+public:
+    class Event final {
+    public:
+        const char* name;
+        const char* category;
+        const char* argName;    // Optional.
+        uint64_t    arg;
+        uint64_t    tsNs;
+        uint64_t    durNs;
+        uint32_t    tid;
+        char        phase;      // 'X' complete, 'i' instant.
+    };
+
+    static constexpr size_t RingCapacity{ 1 << 14 };
+
+private:
+    MpscRing<Event, RingCapacity>   ring;
+    FILE*               fp{};
+    std::thread         writer;
+    std::atomic<bool>   exitReq{ false };
+    std::atomic<bool>   opened{ false };
+    std::atomic<uint64_t>   dropped{};
+    uint64_t            written{};
+    uint64_t            epochNs{};
+
+    // Thread names are rare and of any length, they go through a locked list instead of the ring.
+    std::mutex          threadNameMtx;
+    std::vector<std::tuple<uint32_t, std::string>>  pendingThreadNames;
+
+    static uint32_t NextThreadId()
+    {
+        static std::atomic<uint32_t> next{ 1 };
+        return next.fetch_add(1);
+    }
+
+    void WriteSeparator()
+    {
+        fputs(written++ == 0 ? "\n" : ",\n", fp);
+    }
+
+    static void WriteEscaped(FILE* f, const std::string& s)
+    {
+        for (char c : s) {
+            if (c == '"' || c == '\\')
+                fputc('\\', f);
+            if ((unsigned char)c >= 0x20)
+                fputc(c, f);
+        }
+    }
+
+    void WriteEvent(const Event& e)
+    {
+        const double tsUs{ e.tsNs >= epochNs ? (e.tsNs - epochNs) / 1000.0 : 0.0 };
+        WriteSeparator();
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f",
+            e.name, e.category, e.phase, e.tid, tsUs);
+        if (e.phase == 'X')
+            fprintf(fp, ",\"dur\":%.3f", e.durNs / 1000.0);
+        else if (e.phase == 'i')
+            fputs(",\"s\":\"t\"", fp);
+        if (e.argName != nullptr)
+            fprintf(fp, ",\"args\":{\"%s\":%llu}", e.argName, (unsigned long long)e.arg);
+        fputs("}", fp);
+    }
+
+    void WriteThreadNames()
+    {
+        std::vector<std::tuple<uint32_t, std::string>> names;
+        {
+            std::scoped_lock<std::mutex> l{ threadNameMtx };
+            std::swap(names, pendingThreadNames);
+        }
+        for (auto& [tid, name] : names) {
+            WriteSeparator();
+            fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", tid);
+            WriteEscaped(fp, name);
+            fputs("\"}}", fp);
+        }
+    }
+
+    // Returns the number of events written.
+    size_t Drain()
+    {
+        WriteThreadNames();
+        size_t n{};
+        for (Event e; ring.TryPop(e); ++n)
+            WriteEvent(e);
+        return n;
+    }
+
+    void Push(const Event& e)
+    {
+        if (!ring.TryPush(e))
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+public:
+    ~TraceExporter()
+    {
+        Close();
+    }
+
+    static uint64_t NowNs()
+    {
+        return Clock::Get().NowNs();
+    }
+
+    // Small sequential id of the calling thread.
+    static uint32_t ThreadId()
+    {
+        thread_local uint32_t tid{ NextThreadId() };
+        return tid;
+    }
+
+    bool Open(const std::string& path)
+    {
+        if (opened.load())
+            return false;
+#ifdef _MSC_VER
+        if (fopen_s(&fp, path.c_str(), "w") != 0)
+            fp = nullptr;
+#else
+        fp = fopen(path.c_str(), "w");
+#endif
+        if (fp == nullptr)
+            return false;
+
+        fputs("[", fp);
+        written = 0;
+        epochNs = NowNs();
+        exitReq.store(false);
+        writer = std::thread([this]() {
+            while (!exitReq.load()) {
+                if (Drain() == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            });
+        opened.store(true);
+        return true;
+    }
+
+    void Close()
+    {
+        if (!opened.exchange(false))
+            return;
+
+        exitReq.store(true);
+        writer.join();
+        Drain();
+        fputs("\n]\n", fp);
+        fclose(fp);
+        fp = nullptr;
+    }
+
+    bool IsOpen() const
+    {
+        return opened.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Dropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    void SetThreadName(const std::string& name)
+    {
+        std::scoped_lock<std::mutex> l{ threadNameMtx };
+        pendingThreadNames.push_back({ ThreadId(), name });
+    }
+
+    void Complete(const char* name, const char* category, uint64_t beginNs, uint64_t endNs, const char* argName = nullptr, uint64_t arg = 0)
+    {
+        if (!IsOpen())
+            return;
+        Push({ name, category, argName, arg, beginNs, endNs - beginNs, ThreadId(), 'X' });
+    }
+
+    void Instant(const char* name, const char* category, const char* argName = nullptr, uint64_t arg = 0)
+    {
+        if (!IsOpen())
+            return;
+        Push({ name, category, argName, arg, NowNs(), 0, ThreadId(), 'i' });
+    }
+
+    // Records a complete event for the lifetime of the scope.
+    class Scope final {
+        TraceExporter*  exporter;
+        const char*     name;
+        const char*     category;
+        uint64_t        beginNs;
+
+    public:
+        const char*     argName{};
+        uint64_t        arg{};
+
+        Scope(TraceExporter* inExporter, const char* inName, const char* inCategory)
+            : exporter(inExporter != nullptr && inExporter->IsOpen() ? inExporter : nullptr), name(inName), category(inCategory),
+            beginNs(exporter != nullptr ? NowNs() : 0)
+        {
+        }
+        ~Scope()
+        {
+            if (exporter != nullptr)
+                exporter->Complete(name, category, beginNs, NowNs(), argName, arg);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// Online estimate of the refresh period and phase of a display, fitted to timestamps which each fall near one of its
+// vblanks, e.g. the flip times from the frame statistics of a swap chain or, more noisily, the present return times.
+// A Kalman filter tracks the time of the last vblank and the period. Each timestamp is assigned to the nearest
+// predicted vblank, so missed frames only skip vblanks. Timestamps too far from their vblank are rejected, and a run
+// of them restarts the fit at the new phase. An update is a few dozen floating point operations.
+class VblankEstimator final
+{
+public:
+    class Config final {
+    public:
+        double      nominalPeriodNs{};              // From the display mode. 0 takes the first interval.
+        double      phaseNoiseNs{ 10.0 };           // Vblank to vblank wander of the display, per vblank.
+        double      periodNoiseNs{ 0.01 };          // Period change per vblank, e.g. from the temperature.
+        double      minTimestampNoiseNs{ 1'000.0 }; // Floor of the adaptive timestamp noise.
+        double      gateSigmas{ 5.0 };              // Timestamps further from the prediction are outliers.
+        uint32_t    resetOutliers{ 8 };             // Consecutive outliers which restart the fit.
+        uint32_t    minSamples{ 16 };
+    };
+
+    // The first vblank after a time, within boundNs at about 3 sigma.
+    class Prediction final {
+    public:
+        bool        valid{ false };
+        uint64_t    vblankNs{};
+        uint64_t    boundNs{};
+        uint64_t    vblanksAhead{};     // Since the last vblank seen.
+    };
+
+    class Summary final {
+    public:
+        bool        converged{ false };
+        double      periodNs{};
+        double      periodStdDevNs{};
+        double      timestampNoiseNs{};     // Standard deviation of the timestamps around their vblanks.
+        uint64_t    lastVblankNs{};
+        uint64_t    samples{};
+        uint64_t    outliers{};
+        uint64_t    missedVblanks{};        // Without an accepted timestamp.
+        uint32_t    resets{};
+    };
+
+    // Relative rate and phase of two displays.
+    class Drift final {
+    public:
+        double      ppm{};              // Refresh rate of a over b, minus one, in ppm. Also the phase drift in us/s.
+        double      phaseOffsetNs{};    // Of the vblanks of a from those of b, within half a period.
+        bool        significant{ false };   // The periods differ by more than 3 sigma of their estimates.
+    };
+
+private:
+    Config      cfg;
+    bool        started{ false };
+    uint64_t    baseNs{};
+    // State, relative to baseNs: time of the last vblank, and the period. c is their covariance.
+    double      vblank{};
+    double      period{};
+    double      c00{}, c01{}, c11{};
+    double      r{};                // Timestamp noise variance.
+    uint64_t    samples{};          // Accepted.
+    uint64_t    outliers{};
+    uint64_t    missedVblanks{};
+    uint32_t    resets{};
+    uint32_t    consecutiveOutliers{};
+    uint64_t    firstNs{};          // No nominal period: the first timestamp, until the second one.
+
+    void Restart(uint64_t tNs)
+    {
+        baseNs = tNs;
+        vblank = 0.0;
+        // Until the innovations tell better, the timestamps may be off by a twentieth of a period.
+        const double initialNoise{ period / 20.0 };
+        r = std::max(r, initialNoise * initialNoise);
+        c00 = r;
+        c01 = 0.0;
+        const double periodSigma{ period * 1e-3 };
+        c11 = periodSigma * periodSigma;
+        consecutiveOutliers = 0;
+        started = true;
+    }
+
+    // Keeps the relative times small.
+    void Rebase()
+    {
+        if (vblank < 1e12)
+            return;
+        const double whole{ std::floor(vblank) };
+        baseNs += (uint64_t)whole;
+        vblank -= whole;
+    }
+
+public:
+    VblankEstimator()
+    {
+        Reset(Config{});
+    }
+
+    explicit VblankEstimator(const Config& inCfg)
+    {
+        Reset(inCfg);
+    }
+
+    void Reset(const Config& inCfg)
+    {
+        cfg = inCfg;
+        started = false;
+        period = cfg.nominalPeriodNs;
+        r = cfg.minTimestampNoiseNs * cfg.minTimestampNoiseNs;
+        samples = outliers = missedVblanks = 0;
+        resets = 0;
+        consecutiveOutliers = 0;
+        firstNs = 0;
+    }
+
+    // A timestamp near a vblank, in increasing order. Returns false when it was rejected or fell on the last vblank.
+    bool Update(uint64_t tNs)
+    {
+        if (period <= 0.0) {
+            if (firstNs == 0 || tNs <= firstNs) {
+                firstNs = tNs;
+                return false;
+            }
+            period = (double)(tNs - firstNs);
+        }
+        if (!started) {
+            Restart(tNs);
+            ++samples;
+            return true;
+        }
+        if (tNs < baseNs)
+            return false;
+
+        const double dt{ (double)(tNs - baseNs) - vblank };
+        const double m{ std::round(dt / period) };
+        if (m < 1.0)
+            return false;
+
+        // Predict m vblanks ahead.
+        const double p00{ c00 + 2.0 * m * c01 + m * m * c11 + m * cfg.phaseNoiseNs * cfg.phaseNoiseNs };
+        const double p01{ c01 + m * c11 };
+        const double p11{ c11 + m * cfg.periodNoiseNs * cfg.periodNoiseNs };
+        const double y{ dt - m * period };
+        const double s{ p00 + r };
+
+        // A timestamp beyond the gate, or so far off that it may belong to a neighbouring vblank.
+        if (y * y > cfg.gateSigmas * cfg.gateSigmas * s || std::abs(y) > period / 4.0) {
+            ++outliers;
+            if (++consecutiveOutliers >= cfg.resetOutliers) {
+                ++resets;
+                Restart(tNs);
+            }
+            return false;
+        }
+        consecutiveOutliers = 0;
+
+        const double k0{ p00 / s };
+        const double k1{ p01 / s };
+        vblank += m * period + k0 * y;
+        period += k1 * y;
+        c00 = (1.0 - k0) * p00;
+        c01 = (1.0 - k0) * p01;
+        c11 = p11 - k1 * p01;
+
+        // Track the timestamp noise from the innovations.
+        constexpr double alpha{ 1.0 / 64.0 };
+        r = std::max(cfg.minTimestampNoiseNs * cfg.minTimestampNoiseNs, (1.0 - alpha) * r + alpha * std::max(0.0, y * y - p00));
+
+        missedVblanks += (uint64_t)m - 1;
+        ++samples;
+        Rebase();
+        return true;
+    }
+
+    bool Converged() const
+    {
+        if (!started || samples < cfg.minSamples)
+            return false;
+        const double sigma{ std::sqrt(c00 + 2.0 * c01 + c11) };
+        return 3.0 * sigma < period / 10.0;
+    }
+
+    double PeriodNs() const
+    {
+        return period;
+    }
+
+    Prediction Predict(uint64_t nowNs) const
+    {
+        Prediction p;
+        if (!started || period <= 0.0)
+            return p;
+        const double dt{ nowNs > baseNs ? (double)(nowNs - baseNs) - vblank : -vblank };
+        const double m{ std::max(1.0, std::floor(dt / period) + 1.0) };
+        const double var{ c00 + 2.0 * m * c01 + m * m * c11 + m * cfg.phaseNoiseNs * cfg.phaseNoiseNs };
+        p.valid = true;
+        p.vblankNs = baseNs + (uint64_t)std::llround(vblank + m * period);
+        p.boundNs = (uint64_t)std::llround(3.0 * std::sqrt(var));
+        p.vblanksAhead = (uint64_t)m;
+        return p;
+    }
+
+    Summary Summarize() const
+    {
+        Summary s;
+        s.converged = Converged();
+        s.periodNs = period;
+        s.periodStdDevNs = std::sqrt(std::max(0.0, c11));
+        s.timestampNoiseNs = std::sqrt(r);
+        s.lastVblankNs = started ? baseNs + (uint64_t)std::llround(vblank) : 0;
+        s.samples = samples;
+        s.outliers = outliers;
+        s.missedVblanks = missedVblanks;
+        s.resets = resets;
+        return s;
+    }
+
+    static Drift Compare(const Summary& a, const Summary& b)
+    {
+        Drift d;
+        if (a.periodNs <= 0.0 || b.periodNs <= 0.0)
+            return d;
+        d.ppm = (b.periodNs / a.periodNs - 1.0) * 1e6;
+        const double offset{ std::fmod((double)a.lastVblankNs - (double)b.lastVblankNs, b.periodNs) };
+        d.phaseOffsetNs = offset >= b.periodNs / 2.0 ? offset - b.periodNs : offset < -b.periodNs / 2.0 ? offset + b.periodNs : offset;
+        const double sigma{ std::sqrt(a.periodStdDevNs * a.periodStdDevNs + b.periodStdDevNs * b.periodStdDevNs) };
+        d.significant = a.converged && b.converged && std::abs(a.periodNs - b.periodNs) > 3.0 * sigma;
+        return d;
+    }
+};
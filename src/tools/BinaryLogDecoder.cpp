@@ -0,0 +1,57 @@
+// Prints a binary log written with "PresentBarrierTest.exe -binlog <file>" as text.
+//
+//   BinaryLogDecoder <file> [-sort]
+//
+// Lines are printed in file order, which is time order per thread. -sort merges the threads by time.
+// Only depends on the C++ standard library:
+//   cl /std:c++20 /EHsc /O2 /I.. BinaryLogDecoder.cpp
+//   g++ -std=c++20 -O2 -I.. BinaryLogDecoder.cpp -o BinaryLogDecoder
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "BinaryLog.h"
+
+namespace {
+    void Print(const BinaryLogReader& reader, const BinaryLogReader::Line& l)
+    {
+        std::string text{ l.text };
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+            text.pop_back();
+        printf("[%14.6f] %-24s %s\n", l.ns / 1'000'000'000.0, reader.ThreadName(l.tid).c_str(), text.c_str());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file> [-sort]\n", argv[0]);
+        return 1;
+    }
+    const bool sort{ argc > 2 && std::string(argv[2]) == "-sort" };
+
+    BinaryLogReader reader;
+    if (!reader.Open(argv[1])) {
+        fprintf(stderr, "Failed to open %s or it isn't a binary log.\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<BinaryLogReader::Line> lines;
+    for (BinaryLogReader::Line l; reader.Next(l);) {
+        if (sort)
+            lines.push_back(std::move(l));
+        else
+            Print(reader, l);
+    }
+    std::stable_sort(lines.begin(), lines.end(), [](const auto& a, const auto& b) { return a.ns < b.ns; });
+    for (auto& l : lines)
+        Print(reader, l);
+
+    if (reader.Malformed() > 0) {
+        fprintf(stderr, "%llu malformed records.\n", (unsigned long long)reader.Malformed());
+        return 1;
+    }
+    return 0;
+}